@@ -40,4 +40,106 @@ CREATE TRIGGER roles_parents_updated
 CREATE TRIGGER rules_updated
 	AFTER INSERT OR UPDATE OR DELETE
 	ON rules
-	EXECUTE PROCEDURE update_update();
\ No newline at end of file
+	EXECUTE PROCEDURE update_update();
+
+--
+-- 0.0.2 -> 0.0.3
+--
+
+-- optional: a monitored policy reads only the rows after the last one it
+-- has seen; the old rows can be deleted (DELETE FROM changelog WHERE seq < ...),
+-- a policy that hasn't seen them yet gets reloaded from scratch
+CREATE TABLE changelog
+(
+	seq bigserial NOT NULL,
+	table_name character varying(255) NOT NULL,
+	operation character(1) NOT NULL, -- I inserted, D deleted (an update is both)
+	id integer, -- roles, resources, rules
+	value character varying(255), -- role_id, resource_id
+	type integer, -- rules
+	id_roles integer, -- roles_parents, rules
+	id_resources integer, -- resources_parents, rules
+	id_parent integer, -- roles_parents, resources_parents
+	txid bigint NOT NULL DEFAULT txid_current(), -- seq is taken on insert: rows of a transaction still running can commit after later ones
+	CONSTRAINT changelog_pkey PRIMARY KEY (seq)
+);
+
+CREATE OR REPLACE FUNCTION changelog_add() RETURNS trigger AS
+$BODY$
+	begin
+	if TG_OP <> 'INSERT' then
+		if TG_ARGV[0] = 'roles' then
+			insert into changelog (table_name, operation, id, value) values (TG_ARGV[0], 'D', OLD.id, OLD.role_id);
+		elsif TG_ARGV[0] = 'resources' then
+			insert into changelog (table_name, operation, id, value) values (TG_ARGV[0], 'D', OLD.id, OLD.resource_id);
+		elsif TG_ARGV[0] = 'roles_parents' then
+			insert into changelog (table_name, operation, id_roles, id_parent) values (TG_ARGV[0], 'D', OLD.id_roles, OLD.id_roles_parent);
+		elsif TG_ARGV[0] = 'resources_parents' then
+			insert into changelog (table_name, operation, id_resources, id_parent) values (TG_ARGV[0], 'D', OLD.id_resources, OLD.id_resources_parent);
+		elsif TG_ARGV[0] = 'rules' then
+			insert into changelog (table_name, operation, id, type, id_roles, id_resources) values (TG_ARGV[0], 'D', OLD.id, OLD.type, OLD.id_roles, OLD.id_resources);
+		end if;
+	end if;
+	if TG_OP <> 'DELETE' then
+		if TG_ARGV[0] = 'roles' then
+			insert into changelog (table_name, operation, id, value) values (TG_ARGV[0], 'I', NEW.id, NEW.role_id);
+		elsif TG_ARGV[0] = 'resources' then
+			insert into changelog (table_name, operation, id, value) values (TG_ARGV[0], 'I', NEW.id, NEW.resource_id);
+		elsif TG_ARGV[0] = 'roles_parents' then
+			insert into changelog (table_name, operation, id_roles, id_parent) values (TG_ARGV[0], 'I', NEW.id_roles, NEW.id_roles_parent);
+		elsif TG_ARGV[0] = 'resources_parents' then
+			insert into changelog (table_name, operation, id_resources, id_parent) values (TG_ARGV[0], 'I', NEW.id_resources, NEW.id_resources_parent);
+		elsif TG_ARGV[0] = 'rules' then
+			insert into changelog (table_name, operation, id, type, id_roles, id_resources) values (TG_ARGV[0], 'I', NEW.id, NEW.type, NEW.id_roles, NEW.id_resources);
+		end if;
+	end if;
+	return NULL;
+end;
+$BODY$ LANGUAGE plpgsql;
+
+CREATE TRIGGER resources_changelog
+	AFTER INSERT OR UPDATE OR DELETE
+	ON resources
+	FOR EACH ROW
+	EXECUTE PROCEDURE changelog_add('resources');
+
+CREATE TRIGGER resources_parents_changelog
+	AFTER INSERT OR UPDATE OR DELETE
+	ON resources_parents
+	FOR EACH ROW
+	EXECUTE PROCEDURE changelog_add('resources_parents');
+
+CREATE TRIGGER roles_changelog
+	AFTER INSERT OR UPDATE OR DELETE
+	ON roles
+	FOR EACH ROW
+	EXECUTE PROCEDURE changelog_add('roles');
+
+CREATE TRIGGER roles_parents_changelog
+	AFTER INSERT OR UPDATE OR DELETE
+	ON roles_parents
+	FOR EACH ROW
+	EXECUTE PROCEDURE changelog_add('roles_parents');
+
+CREATE TRIGGER rules_changelog
+	AFTER INSERT OR UPDATE OR DELETE
+	ON rules
+	FOR EACH ROW
+	EXECUTE PROCEDURE changelog_add('rules');
+
+
+--
+-- 0.0.3 -> 0.0.4
+--
+
+-- bumped by every statement changing the policy: a monitored policy is
+-- reloaded when it differs from the one it was loaded at
+ALTER TABLE timestamp_update ADD COLUMN policy_version bigint NOT NULL DEFAULT 0;
+
+CREATE OR REPLACE FUNCTION update_update() RETURNS trigger AS
+$BODY$
+	begin
+	update timestamp_update set update=now(), policy_version=policy_version+1;
+	return NULL;
+end;
+$BODY$ LANGUAGE plpgsql;
@@ -33,7 +33,7 @@ CREATE FUNCTION update_update() RETURNS trigger
     LANGUAGE plpgsql
     AS $$
 	begin
-	update timestamp_update set update=now();
+	update timestamp_update set update=now(), policy_version=policy_version+1;
 	return NULL;
 end;
 $$;
@@ -120,7 +120,8 @@ COMMENT ON COLUMN rules.type IS '1 - allow
 --
 
 CREATE TABLE timestamp_update (
-    update timestamp without time zone
+    update timestamp without time zone,
+    policy_version bigint DEFAULT 0 NOT NULL
 );
 
 
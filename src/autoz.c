@@ -21,7 +21,14 @@
 #endif
 
 #include <stdarg.h>
+#include <stdio.h>
 #include <string.h>
+#include <errno.h>
+
+#include <glib/gstdio.h>
+
+#include <libxml/xmlreader.h>
+#include <libxml/xmlwriter.h>
 
 #include "autoz.h"
 
@@ -32,21 +39,160 @@ typedef struct _Role Role;
 struct _Role
 	{
 		ZakAuthoIRole *irole;
+		guint32 idx;
 		GList *parents; /* struct Role */
+		guint db_id; /* 0 if unknown */
 	};
 
 typedef struct _Resource Resource;
 struct _Resource
 	{
 		ZakAuthoIResource *iresource;
+		guint32 idx;
 		GList *parents; /* struct Resource */
+		guint db_id; /* 0 if unknown */
 	};
 
+/* index used in the rule key for the NULL resource (every resource) */
+#define ZAK_AUTHO_RESOURCE_IDX_NULL G_MAXUINT32
+
+#define ZAK_AUTHO_RULE_KEY(role_idx, resource_idx) ((((guint64)(role_idx)) << 32) | (guint64)(resource_idx))
+
+typedef enum
+	{
+		ZAK_AUTHO_RULE_ALLOW = 1 << 0,
+		ZAK_AUTHO_RULE_DENY = 1 << 1
+	} ZakAuthoRuleType;
+
 typedef struct _Rule Rule;
 struct _Rule
 	{
 		Role *role;
 		Resource *resource;
+		gint64 key; /* ZAK_AUTHO_RULE_KEY */
+		guint8 type; /* ZakAuthoRuleType flags */
+	};
+
+/* what changed since the policy matched the database: a node, a parent
+ * or one type of a rule, with how it was in the database before */
+typedef enum
+	{
+		ZAK_AUTHO_JOURNAL_ROLE,
+		ZAK_AUTHO_JOURNAL_RESOURCE,
+		ZAK_AUTHO_JOURNAL_ROLE_PARENT,
+		ZAK_AUTHO_JOURNAL_RESOURCE_PARENT,
+		ZAK_AUTHO_JOURNAL_RULE
+	} ZakAuthoJournalKind;
+
+typedef struct _JournalEntry JournalEntry;
+struct _JournalEntry
+	{
+		guint8 kind; /* ZakAuthoJournalKind */
+		guint8 type; /* ZakAuthoRuleType of a rule */
+		guint32 idx; /* of the node, of the child, of the role of a rule */
+		guint32 other_idx; /* of the parent, of the resource of a rule */
+		gboolean in_db;
+	};
+
+/* ms without changes to a monitored xml file before it's read again */
+#define ZAK_AUTHO_XML_RELOAD_DELAY 500
+
+/* decision cache: ZAK_AUTHO_CACHE_WAYS entries per set, CLOCK eviction
+ * inside the set; entries of an old generation are free slots */
+#define ZAK_AUTHO_CACHE_WAYS 4
+#define ZAK_AUTHO_CACHE_SIZE_DEFAULT 4096
+
+typedef struct _CacheEntry CacheEntry;
+struct _CacheEntry
+	{
+		guint64 key; /* ZAK_AUTHO_RULE_KEY */
+		guint generation; /* 0 never used */
+		guint8 exclude_null;
+		guint8 allowed;
+		guint8 referenced;
+	};
+
+/* role or resource hierarchy flattened for ancestry queries: the parents
+ * in CSR form, the pre/post numbering of the spanning tree made of the
+ * first parents and, for the nodes with more than one path to a root, an
+ * ancestor bitset */
+typedef struct _Hierarchy Hierarchy;
+struct _Hierarchy
+	{
+		guint32 n;
+		guint32 *parents_offset; /* n + 1 */
+		guint32 *parents; /* of node i from parents_offset[i] to parents_offset[i + 1] */
+		guint32 *order; /* topological, parents first */
+		guint32 *rank; /* position of every node in order */
+		guint32 *children_offset; /* n + 1 */
+		guint32 *children; /* of node i from children_offset[i] to children_offset[i + 1] */
+		guint32 *pre;
+		guint32 *post;
+		guint8 *multi; /* the spanning tree path isn't enough */
+		gint ancestors_built; /* the following are built on first use */
+		guint32 **ancestors; /* bitset of the multi nodes, if they fit in ZAK_AUTHO_HIERARCHY_MAX_WORDS */
+		guint32 *ancestors_block;
+		gsize stride; /* guint32 words per bitset */
+	};
+
+/* above this the multi nodes are answered walking the parents */
+#define ZAK_AUTHO_HIERARCHY_MAX_WORDS (16 * 1024 * 1024)
+
+/* what the checks read: an immutable copy of the policy, replaced as a
+ * whole when the policy changes and freed when its last reader leaves */
+typedef struct _Snapshot Snapshot;
+struct _Snapshot
+	{
+		gint ref_count;
+		guint generation; /* of the policy it was built from */
+		guint32 epoch;
+
+		gchar *role_name_prefix;
+		gsize role_name_prefix_len;
+		gchar *resource_name_prefix;
+		gsize resource_name_prefix_len;
+
+		GHashTable *roles; /* id to idx + 1 */
+		GHashTable *resources; /* id to idx + 1 */
+		ZakAuthoIRole **iroles; /* by idx */
+		ZakAuthoIResource **iresources; /* by idx */
+
+		Hierarchy roles_hierarchy;
+		Hierarchy resources_hierarchy;
+
+		/* the rules of role i on specific resources, from rules_offset[i]
+		 * to rules_offset[i + 1], sorted by resource */
+		guint32 *rules_offset;
+		guint32 *rules_resource;
+		guint8 *rules_decision; /* ZakAuthoIsAllowed */
+		guint8 *rules_type; /* ZakAuthoRuleType, kept for saving */
+		guint8 *rules_null; /* ZakAuthoIsAllowed of the rule on every resource, by role */
+		guint8 *rules_null_type;
+
+		/* the roles with a rule on resource i, from roles_offset[i] to
+		 * roles_offset[i + 1]; and the roles with a rule on every resource */
+		guint32 *roles_offset;
+		guint32 *roles_role;
+		guint32 *roles_null;
+		guint32 n_roles_null;
+
+		/* compiled mode: for every role and exclude_null value, an allow
+		 * bitset and a deny bitset over all resources, built on first use */
+		GMutex lazy_mutex;
+		guint32 *matrix;
+		gsize matrix_stride; /* guint32 words per bitset */
+
+		/* a snapshot read in place from a file written by
+		 * zak_autho_save_snapshot(): the hash tables are NULL and ids are
+		 * looked up in the sorted arrays below, the objects in iroles and
+		 * iresources are created on first use and every other array, but
+		 * the ones built on first use, points into the file */
+		GMappedFile *mapped;
+		const gchar *strings;
+		guint32 *role_ids; /* offset in strings, by idx */
+		guint32 *roles_sorted; /* idx, by id */
+		guint32 *resource_ids;
+		guint32 *resources_sorted;
 	};
 
 typedef enum ZakAuthoIsAllowed
@@ -58,23 +204,50 @@ typedef enum ZakAuthoIsAllowed
 
 static void zak_autho_class_init (ZakAuthoClass *class);
 static void zak_autho_init (ZakAutho *zak_autho);
+static void zak_autho_finalize (GObject *object);
+
+static void _zak_autho_role_free (Role *role);
+static void _zak_autho_resource_free (Resource *resource);
+
+static void _zak_autho_add_rule (ZakAutho *zak_autho, Role *role, Resource *resource, ZakAuthoRuleType type);
+static ZakAuthoIsAllowed _zak_autho_get_rule (Snapshot *snap, guint32 role_idx, guint32 resource_idx);
+
+static ZakAuthoIsAllowed _zak_autho_is_allowed_role (Snapshot *snap, guint32 role_idx, guint32 resource_idx, gboolean exclude_null);
+static ZakAuthoIsAllowed _zak_autho_is_allowed_resource (Snapshot *snap, guint32 role_idx, guint32 resource_idx);
 
-static ZakAuthoIsAllowed _zak_autho_is_allowed_role (ZakAutho *zak_autho, Role *role, Resource *resource, gboolean exclude_null);
-static ZakAuthoIsAllowed _zak_autho_is_allowed_resource (ZakAutho *zak_autho, Role *role, Resource *resource);
+static void _zak_autho_policy_changed (ZakAutho *zak_autho);
+
+static Snapshot *_zak_autho_snapshot_enter (ZakAutho *zak_autho, guint *phase);
+static void _zak_autho_snapshot_leave (ZakAutho *zak_autho, guint phase);
+static void _zak_autho_snapshot_publish (ZakAutho *zak_autho);
+static Hierarchy *_zak_autho_snapshot_get_hierarchy (Snapshot *snap, gboolean roles);
+static guint32 _zak_autho_snapshot_search (Snapshot *snap, gboolean roles, const gchar *prefix, const gchar *id);
+static ZakAuthoIRole *_zak_autho_snapshot_get_irole (Snapshot *snap, guint32 role_idx);
+static ZakAuthoIResource *_zak_autho_snapshot_get_iresource (Snapshot *snap, guint32 resource_idx);
+static void _zak_autho_materialize (ZakAutho *zak_autho);
+
+static gboolean _zak_autho_hierarchy_walk (Hierarchy *h, guint32 node, guint32 ancestor, guint8 *marks);
+static gboolean _zak_autho_hierarchy_is_ancestor (Hierarchy *h, guint32 node, guint32 ancestor);
+static gboolean _zak_autho_reaches (ZakAutho *zak_autho, gboolean roles, guint32 node, guint32 ancestor);
+static void _zak_autho_break_cycles (ZakAutho *zak_autho, gboolean roles);
 
 static gboolean _zak_autho_delete_table_content (GdaConnection *gdacon, const gchar *table_prefix);
-static guint _zak_autho_find_new_table_id (GdaConnection *gdacon, const gchar *table_name);
-static guint _zak_autho_get_role_id_db (GdaConnection *gdacon, const gchar *table_name, const gchar *role_id);
-static guint _zak_autho_get_resource_id_db (GdaConnection *gdacon, const gchar *table_name, const gchar *resource_id);
 
 static void _zak_autho_check_updated (ZakAutho *zak_autho);
+static gpointer _zak_autho_reload_thread (gpointer data);
+static void _zak_autho_take_policy (ZakAutho *zak_autho, ZakAutho *loaded);
+static gboolean _zak_autho_load_changes (ZakAutho *zak_autho, GdaConnection *gdacon, const gchar *table_prefix, gint64 changelog_seq, gint64 changelog_xmin, guint *rows);
+
+static void _zak_autho_xml_monitor_clear (ZakAutho *zak_autho);
+
+static void _zak_autho_journal_reset (ZakAutho *zak_autho, GdaConnection *gdacon, const gchar *table_prefix);
+static void _zak_autho_journal_add (ZakAutho *zak_autho, ZakAuthoJournalKind kind, guint32 idx, guint32 other_idx, guint8 type, gboolean in_db);
+static void _zak_autho_journal_forget (GHashTable *journal, ZakAuthoJournalKind kind, guint32 idx, guint32 other_idx, guint8 type);
 
+static gpointer _zak_autho_lookup_with_prefix (GHashTable *table, const gchar *prefix, const gchar *id);
 static Role *_zak_autho_get_role_from_id (ZakAutho *zak_autho, const gchar *role_id);
 static Resource *_zak_autho_get_resource_from_id (ZakAutho *zak_autho, const gchar *resource_id);
 
-static gchar *_zak_autho_remove_role_name_prefix_from_id (ZakAutho *zak_autho, const gchar *role_id);
-static gchar *_zak_autho_remove_resource_name_prefix_from_id (ZakAutho *zak_autho, const gchar *resource_id);
-
 static void zak_autho_set_property (GObject *object,
                                guint property_id,
                                const GValue *value,
@@ -84,6 +257,22 @@ static void zak_autho_get_property (GObject *object,
                                GValue *value,
                                GParamSpec *pspec);
 
+enum
+	{
+		PROP_0,
+		PROP_COMPILED,
+		PROP_CACHE_SIZE,
+		PROP_CHECK_INTERVAL
+	};
+
+enum
+	{
+		RELOADED,
+		LAST_SIGNAL
+	};
+
+static guint signals[LAST_SIGNAL] = { 0 };
+
 #define ZAK_AUTHO_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE ((obj), ZAK_TYPE_AUTHO, ZakAuthoPrivate))
 
 typedef struct _ZakAuthoPrivate ZakAuthoPrivate;
@@ -95,13 +284,85 @@ struct _ZakAuthoPrivate
 		GHashTable *roles; /* struct Role */
 		GHashTable *resources; /* struct Resource */
 
-		GHashTable *rules_allow; /* struct Rule */
-		GHashTable *rules_deny; /* struct Rule */
+		GPtrArray *roles_idx; /* struct Role, by Role->idx */
+		GPtrArray *resources_idx; /* struct Resource, by Resource->idx */
+
+		GHashTable *rules; /* struct Rule, by Rule->key */
+
+		/* held by who changes the policy */
+		GRecMutex mutex;
+
+		/* bumped on every change of the policy */
+		guint generation;
+		/* bumped when the indexes are reassigned (handles are out of date) */
+		guint32 epoch;
+
+		/* what the checks read, without locking */
+		Snapshot *snapshot;
+		/* loaded with zak_autho_load_snapshot(): the tables above are
+		 * filled from it the first time they're needed */
+		Snapshot *mapped_snapshot;
+		gint read_phase;
+		gint readers[2];
+
+		gint compiled;
+
+		/* the cache is skipped by a check that finds it busy */
+		GMutex cache_mutex;
+		CacheEntry *cache;
+		guint cache_size;
+		guint cache_sets;
+		guint8 *cache_hands; /* CLOCK hand of every set */
+		guint64 cache_hits;
+		guint64 cache_misses;
+
+		/* scratch space of _zak_autho_reaches */
+		guint32 *visit_marks;
+		guint32 visit_marks_len;
+		guint32 visit_stamp;
+		GArray *visit_stack;
 
 		GdaConnection *gdacon;
 		gchar *table_prefix;
-		GDateTime *gdt_last_load;
+
+		/* loaded with zak_autho_load_from_xml_file_with_monitor(): the
+		 * changes of the file are seen in xml_context, and reloaded after
+		 * xml_reload_source fires */
+		GFile *xml_file;
+		GFileMonitor *xml_monitor;
+		gulong xml_monitor_changed;
+		GMainContext *xml_context;
+		GSource *xml_reload_source;
+		/* of the tables when the policy was loaded, -1 if unknown */
+		gint64 policy_version;
+		/* reads it, prepared for gdacon and table_prefix on first use */
+		GdaStatement *version_stmt;
 		gboolean on_loading;
+
+		/* the database is asked for updates at most once every
+		 * check_interval ms (0 on every call); check_next is in ms from
+		 * check_base, wrapping around */
+		guint check_interval;
+		gint64 check_base;
+		gint check_next;
+
+		/* a reload is running in its own thread */
+		gint reloading;
+		/* rows read by the last zak_autho_load_from_db() */
+		guint load_rows;
+		/* last row of the changelog table already in the policy, 0 if
+		 * unknown (no table): then only full reloads */
+		gint64 changelog_seq;
+		/* the oldest transaction that could still be running when the
+		 * changelog table was read: its rows may come after changelog_seq */
+		gint64 changelog_xmin;
+
+		/* the changes since the policy was the same as the tables of
+		 * journal_gdacon with journal_table_prefix, struct JournalEntry;
+		 * NULL if it isn't, then the next save writes everything */
+		GHashTable *journal;
+		GdaConnection *journal_gdacon;
+		gchar *journal_table_prefix;
 	};
 
 G_DEFINE_TYPE (ZakAutho, zak_autho, G_TYPE_OBJECT)
@@ -113,8 +374,54 @@ zak_autho_class_init (ZakAuthoClass *class)
 
 	object_class->set_property = zak_autho_set_property;
 	object_class->get_property = zak_autho_get_property;
+	object_class->finalize = zak_autho_finalize;
 
 	g_type_class_add_private (object_class, sizeof (ZakAuthoPrivate));
+
+	g_object_class_install_property (object_class, PROP_COMPILED,
+	                                 g_param_spec_boolean ("compiled",
+	                                                       "Compiled",
+	                                                       "Whether to precompute every decision",
+	                                                       FALSE,
+	                                                       G_PARAM_READWRITE));
+
+	g_object_class_install_property (object_class, PROP_CACHE_SIZE,
+	                                 g_param_spec_uint ("cache-size",
+	                                                    "Cache size",
+	                                                    "Number of decisions kept in the cache (0 to disable it)",
+	                                                    0, G_MAXUINT, ZAK_AUTHO_CACHE_SIZE_DEFAULT,
+	                                                    G_PARAM_READWRITE));
+
+	g_object_class_install_property (object_class, PROP_CHECK_INTERVAL,
+	                                 g_param_spec_uint ("check-interval",
+	                                                    "Check interval",
+	                                                    "Milliseconds between checks for updates of a monitored database (0 to check on every call)",
+	                                                    0, G_MAXINT, 0,
+	                                                    G_PARAM_READWRITE));
+
+	/**
+	 * ZakAutho::reloaded:
+	 * @zak_autho: the object that received the signal.
+	 * @duration: microseconds the reload took.
+	 * @rows: rows read from the database; for a file, the roles,
+	 * resources and rules read.
+	 *
+	 * Emitted, in the thread that did it, when a policy loaded with
+	 * zak_autho_load_from_db_with_monitor() or
+	 * zak_autho_load_from_xml_file_with_monitor() has been reloaded
+	 * because the database or the file changed. With the changelog table (see DBChangeLog.sql)
+	 * only the changes are read, and @rows counts them.
+	 */
+	signals[RELOADED] = g_signal_new ("reloaded",
+	                                  G_TYPE_FROM_CLASS (object_class),
+	                                  G_SIGNAL_RUN_LAST,
+	                                  0,
+	                                  NULL,
+	                                  NULL,
+	                                  NULL,
+	                                  G_TYPE_NONE,
+	                                  2,
+	                                  G_TYPE_INT64, G_TYPE_UINT);
 }
 
 static void
@@ -128,13 +435,62 @@ zak_autho_init (ZakAutho *zak_autho)
 	priv->roles = g_hash_table_new (g_str_hash, g_str_equal);
 	priv->resources = g_hash_table_new (g_str_hash, g_str_equal);
 
-	priv->rules_allow = g_hash_table_new (g_str_hash, g_str_equal);
-	priv->rules_deny = g_hash_table_new (g_str_hash, g_str_equal);
+	priv->roles_idx = g_ptr_array_new_with_free_func ((GDestroyNotify)_zak_autho_role_free);
+	priv->resources_idx = g_ptr_array_new_with_free_func ((GDestroyNotify)_zak_autho_resource_free);
+
+	priv->rules = g_hash_table_new_full (g_int64_hash, g_int64_equal, NULL, g_free);
+
+	g_rec_mutex_init (&priv->mutex);
+
+	priv->generation = 1;
+	priv->epoch = 1;
+
+	priv->snapshot = NULL;
+	priv->mapped_snapshot = NULL;
+	priv->read_phase = 0;
+	priv->readers[0] = 0;
+	priv->readers[1] = 0;
+
+	priv->compiled = FALSE;
+
+	g_mutex_init (&priv->cache_mutex);
+	priv->cache = NULL;
+	priv->cache_size = ZAK_AUTHO_CACHE_SIZE_DEFAULT;
+	priv->cache_sets = 0;
+	priv->cache_hands = NULL;
+	priv->cache_hits = 0;
+	priv->cache_misses = 0;
+
+	priv->visit_marks = NULL;
+	priv->visit_marks_len = 0;
+	priv->visit_stamp = 0;
+	priv->visit_stack = g_array_new (FALSE, FALSE, sizeof (guint32));
 
 	priv->gdacon = NULL;
 	priv->table_prefix = NULL;
-	priv->gdt_last_load = NULL;
+	priv->xml_file = NULL;
+	priv->xml_monitor = NULL;
+	priv->xml_monitor_changed = 0;
+	priv->xml_context = NULL;
+	priv->xml_reload_source = NULL;
+	priv->policy_version = -1;
+	priv->version_stmt = NULL;
 	priv->on_loading = FALSE;
+
+	priv->check_interval = 0;
+	priv->check_base = g_get_monotonic_time ();
+	priv->check_next = 0;
+
+	priv->reloading = FALSE;
+	priv->load_rows = 0;
+	priv->changelog_seq = 0;
+	priv->changelog_xmin = 0;
+
+	priv->journal = NULL;
+	priv->journal_gdacon = NULL;
+	priv->journal_table_prefix = NULL;
+
+	_zak_autho_snapshot_publish (zak_autho);
 }
 
 /**
@@ -163,6 +519,9 @@ zak_autho_set_role_name_prefix (ZakAutho *zak_autho, const gchar *prefix)
 
 	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
 
+	g_rec_mutex_lock (&priv->mutex);
+	_zak_autho_materialize (zak_autho);
+
 	if (priv->role_name_prefix != NULL)
 		{
 			g_free (priv->role_name_prefix);
@@ -176,6 +535,11 @@ zak_autho_set_role_name_prefix (ZakAutho *zak_autho, const gchar *prefix)
 		{
 			priv->role_name_prefix = g_strdup (prefix);
 		}
+
+	/* ids are resolved with the prefix */
+	_zak_autho_policy_changed (zak_autho);
+
+	g_rec_mutex_unlock (&priv->mutex);
 }
 
 /**
@@ -186,13 +550,19 @@ zak_autho_set_role_name_prefix (ZakAutho *zak_autho, const gchar *prefix)
 const gchar
 *zak_autho_get_role_name_prefix (ZakAutho *zak_autho)
 {
+	const gchar *ret;
+
 	ZakAuthoPrivate *priv;
 
 	g_return_val_if_fail (IS_ZAK_AUTHO (zak_autho), NULL);
 
 	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
 
-	return priv->role_name_prefix == NULL ? NULL : g_strdup (priv->role_name_prefix);
+	g_rec_mutex_lock (&priv->mutex);
+	ret = priv->role_name_prefix == NULL ? NULL : g_strdup (priv->role_name_prefix);
+	g_rec_mutex_unlock (&priv->mutex);
+
+	return ret;
 }
 
 /**
@@ -210,6 +580,9 @@ zak_autho_set_resource_name_prefix (ZakAutho *zak_autho, const gchar *prefix)
 
 	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
 
+	g_rec_mutex_lock (&priv->mutex);
+	_zak_autho_materialize (zak_autho);
+
 	if (priv->resource_name_prefix != NULL)
 		{
 			g_free (priv->resource_name_prefix);
@@ -223,6 +596,11 @@ zak_autho_set_resource_name_prefix (ZakAutho *zak_autho, const gchar *prefix)
 		{
 			priv->resource_name_prefix = g_strdup (prefix);
 		}
+
+	/* ids are resolved with the prefix */
+	_zak_autho_policy_changed (zak_autho);
+
+	g_rec_mutex_unlock (&priv->mutex);
 }
 
 /**
@@ -233,13 +611,172 @@ zak_autho_set_resource_name_prefix (ZakAutho *zak_autho, const gchar *prefix)
 const gchar
 *zak_autho_get_resource_name_prefix (ZakAutho *zak_autho)
 {
+	const gchar *ret;
+
 	ZakAuthoPrivate *priv;
 
 	g_return_val_if_fail (IS_ZAK_AUTHO (zak_autho), NULL);
 
 	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
 
-	return priv->resource_name_prefix == NULL ? NULL : g_strdup (priv->resource_name_prefix);
+	g_rec_mutex_lock (&priv->mutex);
+	ret = priv->resource_name_prefix == NULL ? NULL : g_strdup (priv->resource_name_prefix);
+	g_rec_mutex_unlock (&priv->mutex);
+
+	return ret;
+}
+
+/**
+ * zak_autho_set_compiled:
+ * @zak_autho: an #ZakAutho object.
+ * @compiled: whether to precompute every decision.
+ *
+ * When compiled, the effective decision of every role on every resource
+ * is computed once for each version of the policy, and
+ * zak_autho_is_allowed() becomes a bit test.
+ */
+void
+zak_autho_set_compiled (ZakAutho *zak_autho, gboolean compiled)
+{
+	ZakAuthoPrivate *priv;
+
+	g_return_if_fail (IS_ZAK_AUTHO (zak_autho));
+
+	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
+
+	g_atomic_int_set (&priv->compiled, compiled ? TRUE : FALSE);
+}
+
+/**
+ * zak_autho_get_compiled:
+ * @zak_autho: an #ZakAutho object.
+ *
+ */
+gboolean
+zak_autho_get_compiled (ZakAutho *zak_autho)
+{
+	ZakAuthoPrivate *priv;
+
+	g_return_val_if_fail (IS_ZAK_AUTHO (zak_autho), FALSE);
+
+	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
+
+	return g_atomic_int_get (&priv->compiled);
+}
+
+/**
+ * zak_autho_set_cache_size:
+ * @zak_autho: an #ZakAutho object.
+ * @cache_size: number of decisions to keep; 0 disables the cache.
+ *
+ */
+void
+zak_autho_set_cache_size (ZakAutho *zak_autho, guint cache_size)
+{
+	ZakAuthoPrivate *priv;
+
+	g_return_if_fail (IS_ZAK_AUTHO (zak_autho));
+
+	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
+
+	g_mutex_lock (&priv->cache_mutex);
+
+	g_free (priv->cache);
+	g_free (priv->cache_hands);
+	priv->cache = NULL;
+	priv->cache_hands = NULL;
+	priv->cache_sets = 0;
+
+	g_atomic_int_set (&priv->cache_size, cache_size);
+
+	g_mutex_unlock (&priv->cache_mutex);
+}
+
+/**
+ * zak_autho_get_cache_size:
+ * @zak_autho: an #ZakAutho object.
+ *
+ */
+guint
+zak_autho_get_cache_size (ZakAutho *zak_autho)
+{
+	ZakAuthoPrivate *priv;
+
+	g_return_val_if_fail (IS_ZAK_AUTHO (zak_autho), 0);
+
+	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
+
+	return g_atomic_int_get (&priv->cache_size);
+}
+
+/**
+ * zak_autho_get_cache_stats:
+ * @zak_autho: an #ZakAutho object.
+ * @hits: (out) (allow-none): checks answered by the cache.
+ * @misses: (out) (allow-none): checks that had to be evaluated.
+ *
+ */
+void
+zak_autho_get_cache_stats (ZakAutho *zak_autho, guint64 *hits, guint64 *misses)
+{
+	ZakAuthoPrivate *priv;
+
+	g_return_if_fail (IS_ZAK_AUTHO (zak_autho));
+
+	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
+
+	g_mutex_lock (&priv->cache_mutex);
+	if (hits != NULL)
+		{
+			*hits = priv->cache_hits;
+		}
+	if (misses != NULL)
+		{
+			*misses = priv->cache_misses;
+		}
+	g_mutex_unlock (&priv->cache_mutex);
+}
+
+/**
+ * zak_autho_set_check_interval:
+ * @zak_autho: an #ZakAutho object.
+ * @check_interval: milliseconds; 0 to check on every call.
+ *
+ * A policy loaded with zak_autho_load_from_db_with_monitor() asks the
+ * database whether it changed at most once every @check_interval ms, so
+ * the other calls meanwhile don't wait for it and can see a policy up to
+ * @check_interval ms old.
+ */
+void
+zak_autho_set_check_interval (ZakAutho *zak_autho, guint check_interval)
+{
+	ZakAuthoPrivate *priv;
+
+	g_return_if_fail (IS_ZAK_AUTHO (zak_autho));
+	g_return_if_fail (check_interval <= G_MAXINT);
+
+	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
+
+	g_atomic_int_set (&priv->check_interval, check_interval);
+	/* the next call checks */
+	g_atomic_int_set (&priv->check_next, (gint)((g_get_monotonic_time () - priv->check_base) / 1000));
+}
+
+/**
+ * zak_autho_get_check_interval:
+ * @zak_autho: an #ZakAutho object.
+ *
+ */
+guint
+zak_autho_get_check_interval (ZakAutho *zak_autho)
+{
+	ZakAuthoPrivate *priv;
+
+	g_return_val_if_fail (IS_ZAK_AUTHO (zak_autho), 0);
+
+	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
+
+	return g_atomic_int_get (&priv->check_interval);
 }
 
 /**
@@ -274,18 +811,23 @@ zak_autho_add_role_with_parents (ZakAutho *zak_autho, ZakAuthoIRole *irole, ...)
 
 	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
 
+	g_rec_mutex_lock (&priv->mutex);
+	_zak_autho_materialize (zak_autho);
+
 	role_id = zak_autho_irole_get_role_id (irole);
 
 	if (g_hash_table_lookup (priv->roles, role_id) == NULL)
 		{
 			va_list args;
 			Role *role;
+			GList *parents;
 
 			ZakAuthoIRole *irole_parent;
 			Role *role_parent;
 
 			role = (Role *)g_malloc0 (sizeof (Role));
 			role->irole = irole;
+			role->idx = priv->roles_idx->len;
 			role->parents = NULL;
 
 			va_start (args, irole);
@@ -312,11 +854,22 @@ zak_autho_add_role_with_parents (ZakAutho *zak_autho, ZakAuthoIRole *irole, ...)
 			va_end (args);
 
 			g_hash_table_insert (priv->roles, (gpointer)role_id, (gpointer)role);
+			g_ptr_array_add (priv->roles_idx, role);
+
+			_zak_autho_journal_add (zak_autho, ZAK_AUTHO_JOURNAL_ROLE, role->idx, 0, 0, FALSE);
+			for (parents = role->parents; parents != NULL; parents = g_list_next (parents))
+				{
+					_zak_autho_journal_add (zak_autho, ZAK_AUTHO_JOURNAL_ROLE_PARENT, role->idx, ((Role *)parents->data)->idx, 0, FALSE);
+				}
+
+			_zak_autho_policy_changed (zak_autho);
 		}
 	else
 		{
 			g_warning ("Role «%s» not found.", role_id);
 		}
+
+	g_rec_mutex_unlock (&priv->mutex);
 }
 
 /**
@@ -354,6 +907,9 @@ zak_autho_add_parents_to_role (ZakAutho *zak_autho, ZakAuthoIRole *irole, ...)
 
 	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
 
+	g_rec_mutex_lock (&priv->mutex);
+	_zak_autho_materialize (zak_autho);
+
 	role_id = zak_autho_irole_get_role_id (irole);
 
 	role = g_hash_table_lookup (priv->roles, role_id);
@@ -375,22 +931,37 @@ zak_autho_add_parents_to_role (ZakAutho *zak_autho, ZakAuthoIRole *irole, ...)
 					else
 						{
 							role_parent = g_hash_table_lookup (priv->roles, role_id_parent);
-							if (role_parent != NULL)
+							if (role_parent == NULL)
 								{
-									role->parents = g_list_append (role->parents, role_parent);
+									g_warning ("Role «%s» not found.", role_id);
+								}
+							else if (!priv->on_loading
+							         && _zak_autho_reaches (zak_autho, TRUE, role_parent->idx, role->idx))
+								{
+									/* bulk loads are checked once at the end */
+									g_warning ("Role «%s» cannot be a parent of «%s»: it would close a cycle.", role_id_parent, role_id);
 								}
 							else
 								{
-									g_warning ("Role «%s» not found.", role_id);
+									if (priv->journal != NULL
+									    && g_list_find (role->parents, role_parent) == NULL)
+										{
+											_zak_autho_journal_add (zak_autho, ZAK_AUTHO_JOURNAL_ROLE_PARENT, role->idx, role_parent->idx, 0, FALSE);
+										}
+									role->parents = g_list_append (role->parents, role_parent);
 								}
 						}
 				}
 			va_end (args);
+
+			_zak_autho_policy_changed (zak_autho);
 		}
 	else
 		{
 			g_warning ("Role «%s» not found.", role_id);
 		}
+
+	g_rec_mutex_unlock (&priv->mutex);
 }
 
 /**
@@ -399,18 +970,18 @@ zak_autho_add_parents_to_role (ZakAutho *zak_autho, ZakAuthoIRole *irole, ...)
  * @irole: an #ZakAuthoIRole object.
  * @irole_parent: an #ZakAuthoIRole object.
  *
- * Returns: #TRUE if @irole is a @irole_parent's child; #FALSE otherwise.
+ * Returns: #TRUE if @irole descends from @irole_parent, directly or
+ * through other roles; #FALSE otherwise.
  */
 gboolean
 zak_autho_role_is_child (ZakAutho *zak_autho, ZakAuthoIRole *irole, ZakAuthoIRole *irole_parent)
 {
-	ZakAuthoPrivate *priv;
 	gboolean ret;
 
-	Role *role;
-	Role *role_parent;
-	const gchar *role_id_parent;
-	GList *parent;
+	Snapshot *snap;
+	guint phase;
+	guint32 role_idx;
+	guint32 role_idx_parent;
 
 	g_return_val_if_fail (IS_ZAK_AUTHO (zak_autho), FALSE);
 	g_return_val_if_fail (ZAK_AUTHO_IS_IROLE (irole), FALSE);
@@ -419,88 +990,206 @@ zak_autho_role_is_child (ZakAutho *zak_autho, ZakAuthoIRole *irole, ZakAuthoIRol
 	_zak_autho_check_updated (zak_autho);
 
 	ret = FALSE;
-	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
 
-	role = g_hash_table_lookup (priv->roles, zak_autho_irole_get_role_id (irole));
-	if (role == NULL)
+	snap = _zak_autho_snapshot_enter (zak_autho, &phase);
+
+	role_idx = _zak_autho_snapshot_search (snap, TRUE, NULL, zak_autho_irole_peek_role_id (irole));
+	role_idx_parent = _zak_autho_snapshot_search (snap, TRUE, NULL, zak_autho_irole_peek_role_id (irole_parent));
+	if (role_idx == G_MAXUINT32)
 		{
-			g_warning ("Role «%s» not found.", zak_autho_irole_get_role_id (irole));
-			return ret;
+			g_warning ("Role «%s» not found.", zak_autho_irole_peek_role_id (irole));
 		}
-	role_id_parent = zak_autho_irole_get_role_id (irole_parent);
-	role_parent = g_hash_table_lookup (priv->roles, role_id_parent);
-	if (role_parent == NULL)
+	else if (role_idx_parent == G_MAXUINT32)
 		{
-			g_warning ("Role parent «%s» not found.", role_id_parent);
-			return ret;
+			g_warning ("Role parent «%s» not found.", zak_autho_irole_peek_role_id (irole_parent));
 		}
-
-	parent = g_list_first (role->parents);
-	while (parent != NULL)
+	else
 		{
-			/* TODO recursion */
-			role_parent = (Role *)parent->data;
-			if (g_strcmp0 (role_id_parent, zak_autho_irole_get_role_id (role_parent->irole)) == 0)
-				{
-					ret = TRUE;
-					break;
-				}
-
-			parent = g_list_next (parent);
+			ret = _zak_autho_hierarchy_is_ancestor (_zak_autho_snapshot_get_hierarchy (snap, TRUE), role_idx, role_idx_parent);
 		}
 
+	_zak_autho_snapshot_leave (zak_autho, phase);
+
 	return ret;
 }
 
-static Role
-*_zak_autho_get_role_from_id (ZakAutho *zak_autho, const gchar *role_id)
+/**
+ * zak_autho_role_get_ancestors:
+ * @zak_autho: an #ZakAutho object.
+ * @irole: an #ZakAuthoIRole object.
+ *
+ * Returns: (transfer container): a #GList of every #ZakAuthoIRole @irole
+ * descends from; free it with g_list_free().
+ */
+GList
+*zak_autho_role_get_ancestors (ZakAutho *zak_autho, ZakAuthoIRole *irole)
 {
-	ZakAuthoPrivate *priv;
-	Role *role;
+	GList *ret;
 
-	gchar *_role_id;
+	Snapshot *snap;
+	guint phase;
+	Hierarchy *h;
+	guint8 *marks;
+	guint32 role_idx;
+	guint32 i;
 
 	g_return_val_if_fail (IS_ZAK_AUTHO (zak_autho), NULL);
+	g_return_val_if_fail (ZAK_AUTHO_IS_IROLE (irole), NULL);
 
 	_zak_autho_check_updated (zak_autho);
 
-	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
+	ret = NULL;
 
-	if (priv->role_name_prefix != NULL)
+	snap = _zak_autho_snapshot_enter (zak_autho, &phase);
+
+	role_idx = _zak_autho_snapshot_search (snap, TRUE, NULL, zak_autho_irole_peek_role_id (irole));
+	if (role_idx == G_MAXUINT32)
+		{
+			g_warning ("Role «%s» not found.", zak_autho_irole_peek_role_id (irole));
+			_zak_autho_snapshot_leave (zak_autho, phase);
+			return ret;
+		}
+
+	h = _zak_autho_snapshot_get_hierarchy (snap, TRUE);
+
+	if (h->ancestors[role_idx] != NULL)
+		{
+			for (i = h->n; i > 0; i--)
+				{
+					if (i - 1 != role_idx
+					    && (h->ancestors[role_idx][(i - 1) >> 5] & (1u << ((i - 1) & 31))))
+						{
+							ret = g_list_prepend (ret, _zak_autho_snapshot_get_irole (snap, i - 1));
+						}
+				}
+		}
+	else if (h->multi[role_idx])
 		{
-			_role_id = g_strdup_printf ("%s%s", priv->role_name_prefix, role_id);
+			marks = g_new0 (guint8, h->n + 1);
+			_zak_autho_hierarchy_walk (h, role_idx, G_MAXUINT32, marks);
+			for (i = h->n; i > 0; i--)
+				{
+					if (i - 1 != role_idx && marks[i - 1])
+						{
+							ret = g_list_prepend (ret, _zak_autho_snapshot_get_irole (snap, i - 1));
+						}
+				}
+			g_free (marks);
 		}
 	else
 		{
-			_role_id = g_strdup (role_id);
+			/* the spanning tree path */
+			i = role_idx;
+			while (h->parents_offset[i] < h->parents_offset[i + 1])
+				{
+					i = h->parents[h->parents_offset[i]];
+					ret = g_list_prepend (ret, _zak_autho_snapshot_get_irole (snap, i));
+				}
+			ret = g_list_reverse (ret);
 		}
 
-	role = g_hash_table_lookup (priv->roles, _role_id);
-	g_free (_role_id);
+	_zak_autho_snapshot_leave (zak_autho, phase);
 
-	return role;
+	return ret;
 }
 
-/**
- * zak_autho_get_role_from_id:
- * @zak_autho: an #ZakAutho object.
- * @role_id:
- *
- */
-ZakAuthoIRole
-*zak_autho_get_role_from_id (ZakAutho *zak_autho, const gchar *role_id)
+/* ids are looked up on every check: build the prefixed key on the stack
+ * so that the common case doesn't touch the heap */
+#define ZAK_AUTHO_ID_BUF_SIZE 256
+
+static gpointer
+_zak_autho_lookup_with_prefix (GHashTable *table, const gchar *prefix, const gchar *id)
 {
-	Role *role;
+	gpointer ret;
 
-	role = _zak_autho_get_role_from_id (zak_autho, role_id);
-	if (role == NULL)
-		{
-			return NULL;
+	gchar buf[ZAK_AUTHO_ID_BUF_SIZE];
+	gchar *_id;
+	gsize prefix_len;
+	gsize id_len;
+
+	if (prefix == NULL)
+		{
+			return g_hash_table_lookup (table, id);
+		}
+
+	prefix_len = strlen (prefix);
+	id_len = strlen (id);
+
+	if (prefix_len + id_len < sizeof (buf))
+		{
+			memcpy (buf, prefix, prefix_len);
+			memcpy (buf + prefix_len, id, id_len + 1);
+			_id = buf;
+		}
+	else
+		{
+			_id = g_strconcat (prefix, id, NULL);
+		}
+
+	ret = g_hash_table_lookup (table, _id);
+
+	if (_id != buf)
+		{
+			g_free (_id);
+		}
+
+	return ret;
+}
+
+static Role
+*_zak_autho_get_role_from_id (ZakAutho *zak_autho, const gchar *role_id)
+{
+	ZakAuthoPrivate *priv;
+
+	g_return_val_if_fail (IS_ZAK_AUTHO (zak_autho), NULL);
+
+	_zak_autho_check_updated (zak_autho);
+
+	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
+
+	return (Role *)_zak_autho_lookup_with_prefix (priv->roles, priv->role_name_prefix, role_id);
+}
+
+/**
+ * zak_autho_get_role_from_id:
+ * @zak_autho: an #ZakAutho object.
+ * @role_id:
+ *
+ */
+ZakAuthoIRole
+*zak_autho_get_role_from_id (ZakAutho *zak_autho, const gchar *role_id)
+{
+	ZakAuthoIRole *ret;
+	Role *role;
+	guint32 role_idx;
+
+	ZakAuthoPrivate *priv;
+
+	g_return_val_if_fail (IS_ZAK_AUTHO (zak_autho), NULL);
+
+	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
+
+	g_rec_mutex_lock (&priv->mutex);
+
+	role = _zak_autho_get_role_from_id (zak_autho, role_id);
+	if (role != NULL)
+		{
+			ret = role->irole;
+		}
+	else if (priv->mapped_snapshot != NULL)
+		{
+			/* no need to fill the tables for this */
+			role_idx = _zak_autho_snapshot_search (priv->mapped_snapshot, TRUE, priv->role_name_prefix, role_id);
+			ret = role_idx == G_MAXUINT32 ? NULL : _zak_autho_snapshot_get_irole (priv->mapped_snapshot, role_idx);
 		}
 	else
 		{
-			return role->irole;
+			ret = NULL;
 		}
+
+	g_rec_mutex_unlock (&priv->mutex);
+
+	return ret;
 }
 
 /**
@@ -525,7 +1214,7 @@ zak_autho_add_resource (ZakAutho *zak_autho, ZakAuthoIResource *iresource)
 void
 zak_autho_add_resource_with_parents (ZakAutho *zak_autho, ZakAuthoIResource *iresource, ...)
 {
-	ZakAuthoPrivate *priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
+	ZakAuthoPrivate *priv;
 
 	const gchar *resource_id;
 	const gchar *resource_id_parent;
@@ -533,18 +1222,25 @@ zak_autho_add_resource_with_parents (ZakAutho *zak_autho, ZakAuthoIResource *ire
 	g_return_if_fail (IS_ZAK_AUTHO (zak_autho));
 	g_return_if_fail (ZAK_AUTHO_IS_IRESOURCE (iresource));
 
+	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
+
+	g_rec_mutex_lock (&priv->mutex);
+	_zak_autho_materialize (zak_autho);
+
 	resource_id = zak_autho_iresource_get_resource_id (iresource);
 
 	if (g_hash_table_lookup (priv->resources, resource_id) == NULL)
 		{
 			va_list args;
 			Resource *resource;
+			GList *parents;
 
 			ZakAuthoIResource *iresource_parent;
 			Resource *resource_parent;
 
 			resource = (Resource *)g_malloc0 (sizeof (Resource));
 			resource->iresource = iresource;
+			resource->idx = priv->resources_idx->len;
 			resource->parents = NULL;
 
 			va_start (args, iresource);
@@ -571,11 +1267,22 @@ zak_autho_add_resource_with_parents (ZakAutho *zak_autho, ZakAuthoIResource *ire
 			va_end (args);
 
 			g_hash_table_insert (priv->resources, (gpointer)resource_id, (gpointer)resource);
+			g_ptr_array_add (priv->resources_idx, resource);
+
+			_zak_autho_journal_add (zak_autho, ZAK_AUTHO_JOURNAL_RESOURCE, resource->idx, 0, 0, FALSE);
+			for (parents = resource->parents; parents != NULL; parents = g_list_next (parents))
+				{
+					_zak_autho_journal_add (zak_autho, ZAK_AUTHO_JOURNAL_RESOURCE_PARENT, resource->idx, ((Resource *)parents->data)->idx, 0, FALSE);
+				}
+
+			_zak_autho_policy_changed (zak_autho);
 		}
 	else
 		{
 			g_warning ("Resource «%s» not found.", resource_id);
 		}
+
+	g_rec_mutex_unlock (&priv->mutex);
 }
 
 /**
@@ -613,6 +1320,9 @@ zak_autho_add_parents_to_resource (ZakAutho *zak_autho, ZakAuthoIResource *ireso
 
 	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
 
+	g_rec_mutex_lock (&priv->mutex);
+	_zak_autho_materialize (zak_autho);
+
 	resource_id = zak_autho_iresource_get_resource_id (iresource);
 
 	resource = g_hash_table_lookup (priv->resources, resource_id);
@@ -634,22 +1344,37 @@ zak_autho_add_parents_to_resource (ZakAutho *zak_autho, ZakAuthoIResource *ireso
 					else
 						{
 							resource_parent = g_hash_table_lookup (priv->resources, resource_id_parent);
-							if (resource_parent != NULL)
+							if (resource_parent == NULL)
 								{
-									resource->parents = g_list_append (resource->parents, resource_parent);
+									g_warning ("Resource «%s» not found.", resource_id);
+								}
+							else if (!priv->on_loading
+							         && _zak_autho_reaches (zak_autho, FALSE, resource_parent->idx, resource->idx))
+								{
+									/* bulk loads are checked once at the end */
+									g_warning ("Resource «%s» cannot be a parent of «%s»: it would close a cycle.", resource_id_parent, resource_id);
 								}
 							else
 								{
-									g_warning ("Resource «%s» not found.", resource_id);
+									if (priv->journal != NULL
+									    && g_list_find (resource->parents, resource_parent) == NULL)
+										{
+											_zak_autho_journal_add (zak_autho, ZAK_AUTHO_JOURNAL_RESOURCE_PARENT, resource->idx, resource_parent->idx, 0, FALSE);
+										}
+									resource->parents = g_list_append (resource->parents, resource_parent);
 								}
 						}
 				}
 			va_end (args);
+
+			_zak_autho_policy_changed (zak_autho);
 		}
 	else
 		{
 			g_warning ("Resource «%s» not found.", resource_id);
 		}
+
+	g_rec_mutex_unlock (&priv->mutex);
 }
 
 /**
@@ -658,18 +1383,18 @@ zak_autho_add_parents_to_resource (ZakAutho *zak_autho, ZakAuthoIResource *ireso
  * @iresource: an #ZakAuthoIResource object.
  * @iresource_parent: an #ZakAuthoIResource object.
  *
- * Returns: #TRUE if @iresource is a @iresource_parent's child; #FALSE otherwise.
+ * Returns: #TRUE if @iresource descends from @iresource_parent, directly or
+ * through other resources; #FALSE otherwise.
  */
 gboolean
 zak_autho_resource_is_child (ZakAutho *zak_autho, ZakAuthoIResource *iresource, ZakAuthoIResource *iresource_parent)
 {
-	ZakAuthoPrivate *priv;
 	gboolean ret;
 
-	Resource *resource;
-	Resource *resource_parent;
-	const gchar *resource_id_parent;
-	GList *parent;
+	Snapshot *snap;
+	guint phase;
+	guint32 resource_idx;
+	guint32 resource_idx_parent;
 
 	g_return_val_if_fail (IS_ZAK_AUTHO (zak_autho), FALSE);
 	g_return_val_if_fail (ZAK_AUTHO_IS_IRESOURCE (iresource), FALSE);
@@ -678,66 +1403,121 @@ zak_autho_resource_is_child (ZakAutho *zak_autho, ZakAuthoIResource *iresource,
 	_zak_autho_check_updated (zak_autho);
 
 	ret = FALSE;
-	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
 
-	resource = g_hash_table_lookup (priv->resources, zak_autho_iresource_get_resource_id (iresource));
-	if (resource == NULL)
+	snap = _zak_autho_snapshot_enter (zak_autho, &phase);
+
+	resource_idx = _zak_autho_snapshot_search (snap, FALSE, NULL, zak_autho_iresource_peek_resource_id (iresource));
+	resource_idx_parent = _zak_autho_snapshot_search (snap, FALSE, NULL, zak_autho_iresource_peek_resource_id (iresource_parent));
+	if (resource_idx == G_MAXUINT32)
 		{
-			g_warning ("Resource «%s» not found.", zak_autho_iresource_get_resource_id (iresource));
-			return ret;
+			g_warning ("Resource «%s» not found.", zak_autho_iresource_peek_resource_id (iresource));
 		}
-	resource_id_parent = zak_autho_iresource_get_resource_id (iresource_parent);
-	resource_parent = g_hash_table_lookup (priv->resources, resource_id_parent);
-	if (resource_parent == NULL)
+	else if (resource_idx_parent == G_MAXUINT32)
 		{
-			g_warning ("Resource parent «%s» not found.", resource_id_parent);
-			return ret;
+			g_warning ("Resource parent «%s» not found.", zak_autho_iresource_peek_resource_id (iresource_parent));
 		}
-
-	parent = g_list_first (resource->parents);
-	while (parent != NULL)
+	else
 		{
-			/* TODO recursion */
-			resource_parent = (Resource *)parent->data;
-			if (g_strcmp0 (resource_id_parent, zak_autho_iresource_get_resource_id (resource_parent->iresource)) == 0)
-				{
-					ret = TRUE;
-					break;
-				}
-
-			parent = g_list_next (parent);
+			ret = _zak_autho_hierarchy_is_ancestor (_zak_autho_snapshot_get_hierarchy (snap, FALSE), resource_idx, resource_idx_parent);
 		}
 
+	_zak_autho_snapshot_leave (zak_autho, phase);
+
 	return ret;
 }
 
-static Resource
-*_zak_autho_get_resource_from_id (ZakAutho *zak_autho, const gchar *resource_id)
+/**
+ * zak_autho_resource_get_ancestors:
+ * @zak_autho: an #ZakAutho object.
+ * @iresource: an #ZakAuthoIResource object.
+ *
+ * Returns: (transfer container): a #GList of every #ZakAuthoIResource @iresource
+ * descends from; free it with g_list_free().
+ */
+GList
+*zak_autho_resource_get_ancestors (ZakAutho *zak_autho, ZakAuthoIResource *iresource)
 {
-	ZakAuthoPrivate *priv;
-	Resource *resource;
+	GList *ret;
 
-	gchar *_resource_id;
+	Snapshot *snap;
+	guint phase;
+	Hierarchy *h;
+	guint8 *marks;
+	guint32 resource_idx;
+	guint32 i;
 
 	g_return_val_if_fail (IS_ZAK_AUTHO (zak_autho), NULL);
+	g_return_val_if_fail (ZAK_AUTHO_IS_IRESOURCE (iresource), NULL);
 
 	_zak_autho_check_updated (zak_autho);
 
-	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
+	ret = NULL;
 
-	if (priv->resource_name_prefix != NULL)
+	snap = _zak_autho_snapshot_enter (zak_autho, &phase);
+
+	resource_idx = _zak_autho_snapshot_search (snap, FALSE, NULL, zak_autho_iresource_peek_resource_id (iresource));
+	if (resource_idx == G_MAXUINT32)
+		{
+			g_warning ("Resource «%s» not found.", zak_autho_iresource_peek_resource_id (iresource));
+			_zak_autho_snapshot_leave (zak_autho, phase);
+			return ret;
+		}
+
+	h = _zak_autho_snapshot_get_hierarchy (snap, FALSE);
+
+	if (h->ancestors[resource_idx] != NULL)
+		{
+			for (i = h->n; i > 0; i--)
+				{
+					if (i - 1 != resource_idx
+					    && (h->ancestors[resource_idx][(i - 1) >> 5] & (1u << ((i - 1) & 31))))
+						{
+							ret = g_list_prepend (ret, _zak_autho_snapshot_get_iresource (snap, i - 1));
+						}
+				}
+		}
+	else if (h->multi[resource_idx])
 		{
-			_resource_id = g_strdup_printf ("%s%s", priv->resource_name_prefix, resource_id);
+			marks = g_new0 (guint8, h->n + 1);
+			_zak_autho_hierarchy_walk (h, resource_idx, G_MAXUINT32, marks);
+			for (i = h->n; i > 0; i--)
+				{
+					if (i - 1 != resource_idx && marks[i - 1])
+						{
+							ret = g_list_prepend (ret, _zak_autho_snapshot_get_iresource (snap, i - 1));
+						}
+				}
+			g_free (marks);
 		}
 	else
 		{
-			_resource_id = g_strdup (resource_id);
+			/* the spanning tree path */
+			i = resource_idx;
+			while (h->parents_offset[i] < h->parents_offset[i + 1])
+				{
+					i = h->parents[h->parents_offset[i]];
+					ret = g_list_prepend (ret, _zak_autho_snapshot_get_iresource (snap, i));
+				}
+			ret = g_list_reverse (ret);
 		}
 
-	resource = g_hash_table_lookup (priv->resources, _resource_id);
-	g_free (_resource_id);
+	_zak_autho_snapshot_leave (zak_autho, phase);
 
-	return resource;
+	return ret;
+}
+
+static Resource
+*_zak_autho_get_resource_from_id (ZakAutho *zak_autho, const gchar *resource_id)
+{
+	ZakAuthoPrivate *priv;
+
+	g_return_val_if_fail (IS_ZAK_AUTHO (zak_autho), NULL);
+
+	_zak_autho_check_updated (zak_autho);
+
+	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
+
+	return (Resource *)_zak_autho_lookup_with_prefix (priv->resources, priv->resource_name_prefix, resource_id);
 }
 
 /**
@@ -749,17 +1529,71 @@ static Resource
 ZakAuthoIResource
 *zak_autho_get_resource_from_id (ZakAutho *zak_autho, const gchar *resource_id)
 {
+	ZakAuthoIResource *ret;
 	Resource *resource;
+	guint32 resource_idx;
+
+	ZakAuthoPrivate *priv;
+
+	g_return_val_if_fail (IS_ZAK_AUTHO (zak_autho), NULL);
+
+	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
+
+	g_rec_mutex_lock (&priv->mutex);
 
 	resource = _zak_autho_get_resource_from_id (zak_autho, resource_id);
-	if (resource == NULL)
+	if (resource != NULL)
 		{
-			return NULL;
+			ret = resource->iresource;
+		}
+	else if (priv->mapped_snapshot != NULL)
+		{
+			/* no need to fill the tables for this */
+			resource_idx = _zak_autho_snapshot_search (priv->mapped_snapshot, FALSE, priv->resource_name_prefix, resource_id);
+			ret = resource_idx == G_MAXUINT32 ? NULL : _zak_autho_snapshot_get_iresource (priv->mapped_snapshot, resource_idx);
 		}
 	else
 		{
-			return resource->iresource;
+			ret = NULL;
+		}
+
+	g_rec_mutex_unlock (&priv->mutex);
+
+	return ret;
+}
+
+static void
+_zak_autho_add_rule (ZakAutho *zak_autho, Role *role, Resource *resource, ZakAuthoRuleType type)
+{
+	ZakAuthoPrivate *priv;
+
+	Rule *r;
+	gint64 key;
+
+	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
+
+	key = (gint64)ZAK_AUTHO_RULE_KEY (role->idx, resource == NULL ? ZAK_AUTHO_RESOURCE_IDX_NULL : resource->idx);
+
+	r = (Rule *)g_hash_table_lookup (priv->rules, &key);
+	if (r == NULL)
+		{
+			r = (Rule *)g_malloc0 (sizeof (Rule));
+			r->role = role;
+			r->resource = resource;
+			r->key = key;
+
+			g_hash_table_insert (priv->rules, &r->key, r);
+		}
+
+	if (!(r->type & type))
+		{
+			_zak_autho_journal_add (zak_autho, ZAK_AUTHO_JOURNAL_RULE,
+			                        role->idx, resource == NULL ? ZAK_AUTHO_RESOURCE_IDX_NULL : resource->idx,
+			                        type, FALSE);
 		}
+	r->type |= type;
+
+	_zak_autho_policy_changed (zak_autho);
 }
 
 /**
@@ -777,52 +1611,39 @@ zak_autho_allow (ZakAutho *zak_autho, ZakAuthoIRole *irole, ZakAuthoIResource *i
 	Role *role;
 	Resource *resource;
 
-	Rule *r;
-
-	gchar *str_id;
-
 	g_return_if_fail (IS_ZAK_AUTHO (zak_autho));
+	g_return_if_fail (iresource == NULL || ZAK_AUTHO_IS_IRESOURCE (iresource));
 
 	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
 
+	g_rec_mutex_lock (&priv->mutex);
+	_zak_autho_materialize (zak_autho);
+
 	/* check if exists */
 	role = g_hash_table_lookup (priv->roles, zak_autho_irole_get_role_id (irole));
 	if (role == NULL)
 		{
 			g_warning ("Role «%s» not found.", zak_autho_irole_get_role_id (irole));
-			return;
 		}
-
-	/* accept also NULL resource (equal to allow every resource) */
-	if (iresource == NULL)
+	else if (iresource == NULL)
 		{
-			resource = NULL;
+			/* accept also NULL resource (equal to allow every resource) */
+			_zak_autho_add_rule (zak_autho, role, NULL, ZAK_AUTHO_RULE_ALLOW);
 		}
 	else
 		{
-			g_return_if_fail (ZAK_AUTHO_IS_IRESOURCE (iresource));
-
 			resource = g_hash_table_lookup (priv->resources, zak_autho_iresource_get_resource_id (iresource));
 			if (resource == NULL)
 				{
 					g_warning ("Resource «%s» not found.", zak_autho_iresource_get_resource_id (iresource));
-					return;
+				}
+			else
+				{
+					_zak_autho_add_rule (zak_autho, role, resource, ZAK_AUTHO_RULE_ALLOW);
 				}
 		}
 
-	r = (Rule *)g_malloc0 (sizeof (Rule));
-	r->role = role;
-	r->resource = resource;
-
-	str_id = g_strconcat (zak_autho_irole_get_role_id (r->role->irole),
-	                      "|",
-	                      (resource == NULL ? "NULL" : zak_autho_iresource_get_resource_id (r->resource->iresource)),
-	                      NULL);
-
-	if (g_hash_table_lookup (priv->rules_allow, str_id) == NULL)
-		{
-			g_hash_table_insert (priv->rules_allow, str_id, r);
-		}
+	g_rec_mutex_unlock (&priv->mutex);
 }
 
 /**
@@ -840,873 +1661,6009 @@ zak_autho_deny (ZakAutho *zak_autho, ZakAuthoIRole *irole, ZakAuthoIResource *ir
 	Role *role;
 	Resource *resource;
 
-	Rule *r;
-
-	gchar *str_id;
-
 	g_return_if_fail (IS_ZAK_AUTHO (zak_autho));
+	g_return_if_fail (iresource == NULL || ZAK_AUTHO_IS_IRESOURCE (iresource));
 
 	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
 
+	g_rec_mutex_lock (&priv->mutex);
+	_zak_autho_materialize (zak_autho);
+
 	/* check if exists */
 	role = g_hash_table_lookup (priv->roles, zak_autho_irole_get_role_id (irole));
 	if (role == NULL)
 		{
 			g_warning ("Role «%s» not found.", zak_autho_irole_get_role_id (irole));
-			return;
 		}
-
-	/* accept also NULL resource (equal to deny every resource) */
-	if (iresource == NULL)
+	else if (iresource == NULL)
 		{
-			resource = NULL;
+			/* accept also NULL resource (equal to deny every resource) */
+			_zak_autho_add_rule (zak_autho, role, NULL, ZAK_AUTHO_RULE_DENY);
 		}
 	else
 		{
-			g_return_if_fail (ZAK_AUTHO_IS_IRESOURCE (iresource));
-
 			resource = g_hash_table_lookup (priv->resources, zak_autho_iresource_get_resource_id (iresource));
 			if (resource == NULL)
 				{
-					return;
+					g_warning ("Resource «%s» not found.", zak_autho_iresource_get_resource_id (iresource));
+				}
+			else
+				{
+					_zak_autho_add_rule (zak_autho, role, resource, ZAK_AUTHO_RULE_DENY);
 				}
 		}
 
-	r = (Rule *)g_malloc0 (sizeof (Rule));
-	r->role = role;
-	r->resource = resource;
-
-	str_id = g_strconcat (zak_autho_irole_get_role_id (r->role->irole),
-	                      "|",
-	                      (resource == NULL ? "NULL" : zak_autho_iresource_get_resource_id (r->resource->iresource)),
-	                      NULL);
-
-	if (g_hash_table_lookup (priv->rules_deny, str_id) == NULL)
-		{
-			g_hash_table_insert (priv->rules_deny, str_id, r);
-		}
+	g_rec_mutex_unlock (&priv->mutex);
 }
 
 static ZakAuthoIsAllowed
-_zak_autho_is_allowed_role (ZakAutho *zak_autho, Role *role, Resource *resource, gboolean exclude_null)
+_zak_autho_rule_decision (guint8 type)
 {
-	ZakAuthoIsAllowed ret;
+	/* deny wins over allow */
+	if (type & ZAK_AUTHO_RULE_DENY)
+		{
+			return ZAK_AUTHO_DENIED;
+		}
+	if (type & ZAK_AUTHO_RULE_ALLOW)
+		{
+			return ZAK_AUTHO_ALLOWED;
+		}
 
-	gchar *str_id;
+	return ZAK_AUTHO_NOT_FOUND;
+}
 
+static void
+_zak_autho_policy_changed (ZakAutho *zak_autho)
+{
 	ZakAuthoPrivate *priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
 
-	ret = ZAK_AUTHO_NOT_FOUND;
-
-	if (!exclude_null)
+	/* the snapshot and the cached decisions of older generations are
+	 * out of date */
+	if (g_atomic_int_add (&priv->generation, 1) == -1)
 		{
-			/* first trying for a rule for every resource */
-			str_id = g_strconcat (zak_autho_irole_get_role_id (role->irole),
-			                     "|NULL",
-			                     NULL);
+			g_atomic_int_set (&priv->generation, 1);
 
-			if (g_hash_table_lookup (priv->rules_deny, str_id) != NULL)
-				{
-					ret = ZAK_AUTHO_DENIED;
-					return ret;
-				}
-			if (g_hash_table_lookup (priv->rules_allow, str_id) != NULL)
+			g_mutex_lock (&priv->cache_mutex);
+			if (priv->cache != NULL)
 				{
-					ret = ZAK_AUTHO_ALLOWED;
-					return ret;
+					memset (priv->cache, 0, sizeof (CacheEntry) * priv->cache_sets * ZAK_AUTHO_CACHE_WAYS);
 				}
+			g_mutex_unlock (&priv->cache_mutex);
 		}
+}
 
-	/* and after for specific resource */
-	str_id = g_strconcat (zak_autho_irole_get_role_id (role->irole),
-	                      "|",
-	                      zak_autho_iresource_get_resource_id (resource->iresource),
-	                      NULL);
+static guint
+_zak_autho_journal_entry_hash (gconstpointer key)
+{
+	const JournalEntry *entry = (const JournalEntry *)key;
+
+	return ((entry->idx * 31 + entry->other_idx) * 31 + entry->type) * 8 + entry->kind;
+}
+
+static gboolean
+_zak_autho_journal_entry_equal (gconstpointer a, gconstpointer b)
+{
+	const JournalEntry *entry_a = (const JournalEntry *)a;
+	const JournalEntry *entry_b = (const JournalEntry *)b;
+
+	return entry_a->kind == entry_b->kind
+	       && entry_a->type == entry_b->type
+	       && entry_a->idx == entry_b->idx
+	       && entry_a->other_idx == entry_b->other_idx;
+}
+
+/* from now on the policy is the same as the tables of @gdacon; with a
+ * NULL @gdacon it matches no database */
+static void
+_zak_autho_journal_reset (ZakAutho *zak_autho, GdaConnection *gdacon, const gchar *table_prefix)
+{
+	ZakAuthoPrivate *priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
 
-	if (g_hash_table_lookup (priv->rules_deny, str_id) != NULL)
+	if (priv->journal != NULL)
 		{
-			ret = ZAK_AUTHO_DENIED;
-			return ret;
+			g_hash_table_destroy (priv->journal);
+			priv->journal = NULL;
 		}
-	if (g_hash_table_lookup (priv->rules_allow, str_id) != NULL)
+	g_free (priv->journal_table_prefix);
+	priv->journal_table_prefix = NULL;
+	priv->journal_gdacon = gdacon;
+
+	if (gdacon != NULL)
 		{
-			ret = ZAK_AUTHO_ALLOWED;
-			return ret;
+			priv->journal = g_hash_table_new_full (_zak_autho_journal_entry_hash, _zak_autho_journal_entry_equal, g_free, NULL);
+			priv->journal_table_prefix = g_strdup (table_prefix);
 		}
+}
 
-	if (ret == ZAK_AUTHO_NOT_FOUND && resource->parents != NULL)
-		{
-			/* trying parents */
-			GList *parents;
+/* only the first change of an entry is kept: @in_db tells what the
+ * database holds, the policy what it has to hold */
+static void
+_zak_autho_journal_add (ZakAutho *zak_autho, ZakAuthoJournalKind kind, guint32 idx, guint32 other_idx, guint8 type, gboolean in_db)
+{
+	JournalEntry *entry;
 
-			parents = g_list_first (resource->parents);
-			while (parents != NULL)
-				{
-					ret = _zak_autho_is_allowed_resource (zak_autho, role, (Resource *)parents->data);
-					if (ret != ZAK_AUTHO_NOT_FOUND)
-						 {
-						 	break;
-						 }
+	ZakAuthoPrivate *priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
 
-					parents = g_list_next (parents);
-				}
+	if (priv->journal == NULL)
+		{
+			return;
 		}
 
-	if (ret == ZAK_AUTHO_NOT_FOUND && role->parents != NULL)
-		{
-			/* trying parents */
-			GList *parents;
+	entry = g_new (JournalEntry, 1);
+	entry->kind = kind;
+	entry->type = type;
+	entry->idx = idx;
+	entry->other_idx = other_idx;
+	entry->in_db = in_db;
 
-			parents = g_list_first (role->parents);
-			while (parents != NULL)
-				{
-					ret = _zak_autho_is_allowed_role (zak_autho, (Role *)parents->data, resource, exclude_null);
-					if (ret != ZAK_AUTHO_NOT_FOUND)
-						 {
-						 	break;
-						 }
-
-					parents = g_list_next (parents);
-				}
+	if (g_hash_table_contains (priv->journal, entry))
+		{
+			g_free (entry);
+		}
+	else
+		{
+			g_hash_table_add (priv->journal, entry);
 		}
+}
 
-	return ret;
+/* the database got the change of the entry by itself */
+static void
+_zak_autho_journal_forget (GHashTable *journal, ZakAuthoJournalKind kind, guint32 idx, guint32 other_idx, guint8 type)
+{
+	JournalEntry entry;
+
+	entry.kind = kind;
+	entry.type = type;
+	entry.idx = idx;
+	entry.other_idx = other_idx;
+
+	g_hash_table_remove (journal, &entry);
 }
 
-static ZakAuthoIsAllowed
-_zak_autho_is_allowed_resource (ZakAutho *zak_autho, Role *role, Resource *resource)
+/* readers count themselves in one of two phases while they look at a
+ * snapshot; after replacing the snapshot, the writer flips the phase
+ * twice and waits for the old one to drain every time, so no reader can
+ * still be looking at the previous snapshot */
+static guint
+_zak_autho_read_lock (ZakAuthoPrivate *priv)
 {
-	ZakAuthoIsAllowed ret;
+	guint phase;
 
-	gchar *str_id;
+	phase = (guint)g_atomic_int_get (&priv->read_phase) & 1;
+	g_atomic_int_inc (&priv->readers[phase]);
 
-	ZakAuthoPrivate *priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
+	return phase;
+}
 
-	ret = ZAK_AUTHO_NOT_FOUND;
+static void
+_zak_autho_read_unlock (ZakAuthoPrivate *priv, guint phase)
+{
+	g_atomic_int_add (&priv->readers[phase], -1);
+}
 
-	str_id = g_strconcat (zak_autho_irole_get_role_id (role->irole),
-	                      "|",
-	                      zak_autho_iresource_get_resource_id (resource->iresource),
-	                      NULL);
+static void
+_zak_autho_synchronize (ZakAuthoPrivate *priv)
+{
+	guint phase;
+	guint i;
 
-	if (g_hash_table_lookup (priv->rules_deny, str_id) != NULL)
-		{
-			ret = ZAK_AUTHO_DENIED;
-			return ret;
-		}
-	else if (g_hash_table_lookup (priv->rules_allow, str_id) != NULL)
-		{
-			ret = ZAK_AUTHO_ALLOWED;
-			return ret;
-		}
-	else if (resource->parents != NULL)
+	for (i = 0; i < 2; i++)
 		{
-			/* trying parents */
-			GList *parents;
+			phase = (guint)g_atomic_int_get (&priv->read_phase) & 1;
+			g_atomic_int_set (&priv->read_phase, phase ^ 1);
 
-			parents = g_list_first (resource->parents);
-			while (parents != NULL)
+			while (g_atomic_int_get (&priv->readers[phase]) > 0)
 				{
-					ret = _zak_autho_is_allowed_resource (zak_autho, role, (Resource *)parents->data);
-					if (ret != ZAK_AUTHO_NOT_FOUND)
-						 {
-							break;
-						}
-
-					parents = g_list_next (parents);
+					g_thread_yield ();
 				}
 		}
-
-	return ret;
 }
 
-static gchar
-*_zak_autho_remove_role_name_prefix_from_id (ZakAutho *zak_autho, const gchar *role_id)
+static void
+_zak_autho_hierarchy_free (Hierarchy *h)
 {
-	gchar *ret;
+	g_free (h->parents_offset);
+	g_free (h->parents);
+	g_free (h->order);
+	g_free (h->rank);
+	g_free (h->children_offset);
+	g_free (h->children);
+	g_free (h->pre);
+	g_free (h->post);
+	g_free (h->multi);
+	g_free (h->ancestors);
+	g_free (h->ancestors_block);
+
+	memset (h, 0, sizeof (Hierarchy));
+}
 
-	ZakAuthoPrivate *priv;
+/* only what is built on first use, for the hierarchies of a mapped snapshot */
+static void
+_zak_autho_hierarchy_free_ancestors (Hierarchy *h)
+{
+	g_free (h->ancestors);
+	g_free (h->ancestors_block);
 
-	g_return_val_if_fail (IS_ZAK_AUTHO (zak_autho), FALSE);
+	h->ancestors = NULL;
+	h->ancestors_block = NULL;
+}
 
-	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
+static void
+_zak_autho_hierarchy_set_parents (Hierarchy *h, GPtrArray *nodes, gboolean roles)
+{
+	guint32 i;
+	guint32 j;
+	GList *parents;
 
-	ret = NULL;
+	h->n = nodes->len;
 
-	if (priv->role_name_prefix == NULL
-	    || strlen (priv->role_name_prefix) > strlen (role_id))
+	h->parents_offset = g_new (guint32, h->n + 1);
+	h->parents_offset[0] = 0;
+	for (i = 0; i < h->n; i++)
 		{
-			ret = g_strdup (role_id);
+			parents = roles ? ((Role *)g_ptr_array_index (nodes, i))->parents : ((Resource *)g_ptr_array_index (nodes, i))->parents;
+			h->parents_offset[i + 1] = h->parents_offset[i] + g_list_length (parents);
 		}
-	else
+
+	h->parents = g_new (guint32, h->parents_offset[h->n] + 1);
+	for (i = 0; i < h->n; i++)
 		{
-			ret = g_strdup (role_id + strlen (priv->role_name_prefix));
+			parents = roles ? ((Role *)g_ptr_array_index (nodes, i))->parents : ((Resource *)g_ptr_array_index (nodes, i))->parents;
+			for (j = h->parents_offset[i]; parents != NULL; j++)
+				{
+					h->parents[j] = roles ? ((Role *)parents->data)->idx : ((Resource *)parents->data)->idx;
+					parents = g_list_next (parents);
+				}
 		}
-
-	return ret;
 }
 
-static gchar
-*_zak_autho_remove_resource_name_prefix_from_id (ZakAutho *zak_autho, const gchar *resource_id)
+/* Tarjan's strongly connected components over the parents, without
+ * recursion; components come out parents first, so @order is a
+ * topological order when there are no cycles */
+static guint32
+_zak_autho_hierarchy_scc (Hierarchy *h, guint32 *comp, guint32 *order)
 {
-	gchar *ret;
-
-	ZakAuthoPrivate *priv;
-
-	g_return_val_if_fail (IS_ZAK_AUTHO (zak_autho), FALSE);
-
-	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
-
-	ret = NULL;
-
-	if (priv->resource_name_prefix == NULL
-	    || strlen (priv->resource_name_prefix) > strlen (resource_id))
+	guint32 *index;
+	guint32 *low;
+	guint32 *stack;
+	guint32 *call;
+	guint32 *call_pos;
+	guint8 *on_stack;
+
+	guint32 i;
+	guint32 node;
+	guint32 parent;
+	guint32 counter;
+	guint32 sp;
+	guint32 csp;
+	guint32 n_comp;
+	guint32 n_order;
+
+	index = g_new (guint32, h->n + 1);
+	low = g_new (guint32, h->n + 1);
+	stack = g_new (guint32, h->n + 1);
+	call = g_new (guint32, h->n + 1);
+	call_pos = g_new (guint32, h->n + 1);
+	on_stack = g_new0 (guint8, h->n + 1);
+
+	for (i = 0; i < h->n; i++)
 		{
-			ret = g_strdup (resource_id);
+			index[i] = G_MAXUINT32;
 		}
-	else
+
+	counter = 0;
+	sp = 0;
+	n_comp = 0;
+	n_order = 0;
+	for (i = 0; i < h->n; i++)
 		{
-			ret = g_strdup (resource_id + strlen (priv->resource_name_prefix));
-		}
+			if (index[i] != G_MAXUINT32)
+				{
+					continue;
+				}
 
-	return ret;
-}
+			index[i] = low[i] = counter++;
+			stack[sp++] = i;
+			on_stack[i] = 1;
+			call[0] = i;
+			call_pos[0] = h->parents_offset[i];
+			csp = 1;
 
-/**
- * zak_autho_is_allowed:
- * @zak_autho: an #ZakAutho object.
- * @irole: an #ZakAuthoIRole object.
- * @iresource: an #ZakAuthoIResource object.
- * @exclude_null: whether or not to exclude roles allowed to every resource.
- *
- */
-gboolean
-zak_autho_is_allowed (ZakAutho *zak_autho, ZakAuthoIRole *irole, ZakAuthoIResource *iresource, gboolean exclude_null)
-{
-	gboolean ret;
-	ZakAuthoIsAllowed isAllowed;
+			while (csp > 0)
+				{
+					node = call[csp - 1];
+					if (call_pos[csp - 1] < h->parents_offset[node + 1])
+						{
+							parent = h->parents[call_pos[csp - 1]++];
+							if (index[parent] == G_MAXUINT32)
+								{
+									index[parent] = low[parent] = counter++;
+									stack[sp++] = parent;
+									on_stack[parent] = 1;
+									call[csp] = parent;
+									call_pos[csp] = h->parents_offset[parent];
+									csp++;
+								}
+							else if (on_stack[parent] && index[parent] < low[node])
+								{
+									low[node] = index[parent];
+								}
+							continue;
+						}
 
-	Role *role;
-	Resource *resource;
+					csp--;
+					if (csp > 0 && low[node] < low[call[csp - 1]])
+						{
+							low[call[csp - 1]] = low[node];
+						}
 
-	gchar *str_id;
+					if (low[node] == index[node])
+						{
+							do
+								{
+									parent = stack[--sp];
+									on_stack[parent] = 0;
+									comp[parent] = n_comp;
+									order[n_order++] = parent;
+								}
+							while (parent != node);
+							n_comp++;
+						}
+				}
+		}
 
-	ZakAuthoPrivate *priv;
+	g_free (index);
+	g_free (low);
+	g_free (stack);
+	g_free (call);
+	g_free (call_pos);
+	g_free (on_stack);
 
-	g_return_val_if_fail (IS_ZAK_AUTHO (zak_autho), FALSE);
-	g_return_val_if_fail (ZAK_AUTHO_IS_IROLE (irole), FALSE);
+	return n_comp;
+}
 
-	_zak_autho_check_updated (zak_autho);
+static void
+_zak_autho_hierarchy_build (Hierarchy *h, GPtrArray *nodes, gboolean roles)
+{
+	guint32 i;
+	guint32 j;
+	guint32 node;
+	guint32 counter;
+
+	guint32 *comp;
+	guint32 *children_offset;
+	guint32 *children;
+	guint32 *stack;
+	guint32 *stack_pos;
+	guint32 sp;
+	guint8 *multi;
+
+	_zak_autho_hierarchy_free (h);
+	_zak_autho_hierarchy_set_parents (h, nodes, roles);
+
+	h->order = g_new (guint32, h->n + 1);
+	comp = g_new (guint32, h->n + 1);
+	_zak_autho_hierarchy_scc (h, comp, h->order);
+	g_free (comp);
+
+	h->rank = g_new (guint32, h->n + 1);
+	for (i = 0; i < h->n; i++)
+		{
+			h->rank[h->order[i]] = i;
+		}
 
-	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
-	ret = FALSE;
-	isAllowed = ZAK_AUTHO_NOT_FOUND;
+	/* every child of every node */
+	h->children_offset = g_new0 (guint32, h->n + 2);
+	h->children = g_new (guint32, h->parents_offset[h->n] + 1);
+	for (i = 0; i < h->parents_offset[h->n]; i++)
+		{
+			h->children_offset[h->parents[i] + 2]++;
+		}
+	for (i = 0; i < h->n; i++)
+		{
+			h->children_offset[i + 2] += h->children_offset[i + 1];
+		}
+	for (i = 0; i < h->n; i++)
+		{
+			for (j = h->parents_offset[i]; j < h->parents_offset[i + 1]; j++)
+				{
+					h->children[h->children_offset[h->parents[j] + 1]++] = i;
+				}
+		}
 
-	role = _zak_autho_get_role_from_id (zak_autho, _zak_autho_remove_role_name_prefix_from_id (zak_autho, zak_autho_irole_get_role_id (irole)));
-	if (role == NULL)
+	/* the spanning tree: every node is a child of its first parent */
+	children_offset = g_new0 (guint32, h->n + 1);
+	children = g_new (guint32, h->n + 1);
+	stack_pos = g_new (guint32, h->n + 1);
+	for (i = 0; i < h->n; i++)
 		{
-			g_warning ("Role «%s» not found.", zak_autho_irole_get_role_id (irole));
-			return ret;
+			if (h->parents_offset[i] < h->parents_offset[i + 1])
+				{
+					children_offset[h->parents[h->parents_offset[i]] + 1]++;
+				}
+		}
+	for (i = 0; i < h->n; i++)
+		{
+			children_offset[i + 1] += children_offset[i];
+			stack_pos[i] = children_offset[i];
+		}
+	for (i = 0; i < h->n; i++)
+		{
+			if (h->parents_offset[i] < h->parents_offset[i + 1])
+				{
+					children[stack_pos[h->parents[h->parents_offset[i]]]++] = i;
+				}
 		}
 
-	if (!exclude_null)
+	/* pre/post numbering from the roots; a node that is only reachable
+	 * from a cycle is given a bitset */
+	h->pre = g_new (guint32, h->n + 1);
+	h->post = g_new (guint32, h->n + 1);
+	multi = g_new (guint8, h->n + 1);
+	stack = g_new (guint32, h->n + 1);
+	for (i = 0; i < h->n; i++)
 		{
-			/* first trying for a rule for every resource */
-			str_id = g_strconcat (zak_autho_irole_get_role_id (irole),
-			                      "|NULL",
-			                      NULL);
+			h->pre[i] = G_MAXUINT32;
+			multi[i] = 1;
+		}
 
-			if (g_hash_table_lookup (priv->rules_deny, str_id) != NULL)
+	counter = 0;
+	for (i = 0; i < h->n; i++)
+		{
+			if (h->parents_offset[i] < h->parents_offset[i + 1])
 				{
-					ret = FALSE;
-					return ret;
+					continue;
 				}
-			if (g_hash_table_lookup (priv->rules_allow, str_id) != NULL)
+
+			h->pre[i] = counter++;
+			multi[i] = 0;
+			stack[0] = i;
+			stack_pos[0] = children_offset[i];
+			sp = 1;
+			while (sp > 0)
 				{
-					ret = TRUE;
-					return ret;
+					node = stack[sp - 1];
+					if (stack_pos[sp - 1] < children_offset[node + 1])
+						{
+							j = children[stack_pos[sp - 1]++];
+
+							h->pre[j] = counter++;
+							multi[j] = multi[node] || (h->parents_offset[j + 1] - h->parents_offset[j] > 1);
+							stack[sp] = j;
+							stack_pos[sp] = children_offset[j];
+							sp++;
+						}
+					else
+						{
+							h->post[node] = counter++;
+							sp--;
+						}
 				}
 		}
 
-	g_return_val_if_fail (ZAK_AUTHO_IS_IRESOURCE (iresource), FALSE);
+	h->multi = multi;
+
+	g_free (stack);
+	g_free (stack_pos);
+	g_free (children);
+	g_free (children_offset);
+}
 
-	resource = _zak_autho_get_resource_from_id (zak_autho, _zak_autho_remove_resource_name_prefix_from_id (zak_autho, zak_autho_iresource_get_resource_id (iresource)));
-	if (resource == NULL)
+/* bitsets where the spanning tree isn't enough, filled parents first */
+static void
+_zak_autho_hierarchy_build_ancestors (Hierarchy *h)
+{
+	guint32 i;
+	guint32 j;
+	guint32 node;
+	guint32 parent;
+	guint32 n_multi;
+	gsize w;
+
+	n_multi = 0;
+	for (i = 0; i < h->n; i++)
 		{
-			g_warning ("Resource «%s» not found.", zak_autho_iresource_get_resource_id (iresource));
-			return ret;
+			if (h->multi[i])
+				{
+					n_multi++;
+				}
 		}
 
-	/* and after for specific resource */
-	str_id = g_strconcat (zak_autho_irole_get_role_id (irole),
-	                      "|",
-	                      zak_autho_iresource_get_resource_id (iresource),
-	                      NULL);
-
-	if (g_hash_table_lookup (priv->rules_deny, str_id) != NULL)
+	h->stride = (h->n + 31) / 32;
+	h->ancestors = g_new0 (guint32 *, h->n + 1);
+	if ((gsize)n_multi * h->stride > ZAK_AUTHO_HIERARCHY_MAX_WORDS)
 		{
-			ret = FALSE;
-			return ret;
+			n_multi = 0;
 		}
-	if (g_hash_table_lookup (priv->rules_allow, str_id) != NULL)
+	h->ancestors_block = g_new0 (guint32, (gsize)n_multi * h->stride + 1);
+	for (i = 0, j = 0; n_multi > 0 && i < h->n; i++)
 		{
-			ret = TRUE;
-			return ret;
+			if (h->multi[i])
+				{
+					h->ancestors[i] = h->ancestors_block + (gsize)j * h->stride;
+					j++;
+				}
 		}
 
-	if (!ret && resource->parents != NULL)
+	for (i = 0; n_multi > 0 && i < h->n; i++)
 		{
-			/* trying parents */
-			GList *parents;
+			node = h->order[i];
+			if (!h->multi[node])
+				{
+					continue;
+				}
 
-			parents = g_list_first (resource->parents);
-			while (parents != NULL)
+			for (j = h->parents_offset[node]; j < h->parents_offset[node + 1]; j++)
 				{
-					isAllowed = _zak_autho_is_allowed_resource (zak_autho, role, (Resource *)parents->data);
-					if (isAllowed == ZAK_AUTHO_DENIED)
-						 {
-						 	ret = FALSE;
-						 	break;
-						 }
-					else if (isAllowed == ZAK_AUTHO_ALLOWED)
+					parent = h->parents[j];
+					h->ancestors[node][parent >> 5] |= 1u << (parent & 31);
+
+					if (h->ancestors[parent] != NULL)
 						{
-							ret = TRUE;
-							break;
+							for (w = 0; w < h->stride; w++)
+								{
+									h->ancestors[node][w] |= h->ancestors[parent][w];
+								}
+						}
+					else
+						{
+							while (h->parents_offset[parent] < h->parents_offset[parent + 1])
+								{
+									parent = h->parents[h->parents_offset[parent]];
+									h->ancestors[node][parent >> 5] |= 1u << (parent & 31);
+								}
 						}
-
-					parents = g_list_next (parents);
 				}
 		}
+}
 
-	if (!ret && isAllowed == ZAK_AUTHO_NOT_FOUND && role->parents != NULL)
-		{
-			/* trying parents */
-			GList *parents;
+/* sets in @marks (h->n bytes, zeroed) every ancestor of @node, stopping
+ * if @ancestor is found */
+static gboolean
+_zak_autho_hierarchy_walk (Hierarchy *h, guint32 node, guint32 ancestor, guint8 *marks)
+{
+	gboolean ret;
+	guint32 *stack;
+	guint32 sp;
+	guint32 i;
+	guint32 parent;
 
-			parents = g_list_first (role->parents);
-			while (parents != NULL)
+	ret = FALSE;
+	stack = g_new (guint32, h->n + 1);
+
+	sp = 0;
+	stack[sp++] = node;
+	while (!ret && sp > 0)
+		{
+			node = stack[--sp];
+			for (i = h->parents_offset[node]; i < h->parents_offset[node + 1]; i++)
 				{
-					isAllowed = _zak_autho_is_allowed_role (zak_autho, (Role *)parents->data, resource, exclude_null);
-					if (isAllowed == ZAK_AUTHO_DENIED)
-						 {
-						 	ret = FALSE;
-						 	break;
-						 }
-					else if (isAllowed == ZAK_AUTHO_ALLOWED)
+					parent = h->parents[i];
+					if (!marks[parent])
 						{
-							ret = TRUE;
-							break;
+							if (parent == ancestor)
+								{
+									ret = TRUE;
+									break;
+								}
+							marks[parent] = 1;
+							stack[sp++] = parent;
 						}
-
-					parents = g_list_next (parents);
 				}
 		}
 
+	g_free (stack);
+
 	return ret;
 }
 
-/**
- * zak_autho_clear:
- * @zak_autho:
- *
- */
-gboolean
-zak_autho_clear (ZakAutho *zak_autho)
+static gboolean
+_zak_autho_hierarchy_is_ancestor (Hierarchy *h, guint32 node, guint32 ancestor)
 {
 	gboolean ret;
+	guint8 *marks;
 
-	ZakAuthoPrivate *priv;
-
-	g_return_val_if_fail (IS_ZAK_AUTHO (zak_autho), FALSE);
-
-	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
-
-	ret = TRUE;
-
-	g_hash_table_destroy (priv->roles);
-	g_hash_table_destroy (priv->resources);
-	g_hash_table_destroy (priv->rules_allow);
-	g_hash_table_destroy (priv->rules_deny);
+	if (node == ancestor)
+		{
+			return FALSE;
+		}
 
-	priv->roles = g_hash_table_new (g_str_hash, g_str_equal);
-	priv->resources = g_hash_table_new (g_str_hash, g_str_equal);
-	priv->rules_allow = g_hash_table_new (g_str_hash, g_str_equal);
-	priv->rules_deny = g_hash_table_new (g_str_hash, g_str_equal);
+	if (h->ancestors[node] != NULL)
+		{
+			return (h->ancestors[node][ancestor >> 5] & (1u << (ancestor & 31))) != 0;
+		}
+	if (h->multi[node])
+		{
+			marks = g_new0 (guint8, h->n + 1);
+			ret = _zak_autho_hierarchy_walk (h, node, ancestor, marks);
+			g_free (marks);
+			return ret;
+		}
 
-	return ret;
+	return h->pre[ancestor] < h->pre[node] && h->post[node] < h->post[ancestor];
 }
 
-/**
- * zak_autho_get_xml:
- * @zak_autho: an #ZakAutho object.
- *
- */
-xmlNodePtr
-zak_autho_get_xml (ZakAutho *zak_autho)
+/* whether @ancestor is @node or one of its ancestors; only the ancestors
+ * of @node are visited, so it's cheap enough for every new parent */
+static gboolean
+_zak_autho_reaches (ZakAutho *zak_autho, gboolean roles, guint32 node, guint32 ancestor)
 {
-	ZakAuthoPrivate *priv;
-	xmlNodePtr ret;
-	xmlNodePtr xnode_parent;
-	xmlNodePtr xnode;
+	GPtrArray *nodes;
+	GList *parents;
+	guint32 idx;
 
-	GHashTableIter iter;
-	gpointer key, value;
+	ZakAuthoPrivate *priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
 
-	Role *role;
-	Resource *resource;
-	Rule *rule;
+	nodes = roles ? priv->roles_idx : priv->resources_idx;
 
-	GList *parent;
+	if (priv->visit_marks_len < nodes->len)
+		{
+			priv->visit_marks = g_renew (guint32, priv->visit_marks, nodes->len);
+			memset (priv->visit_marks + priv->visit_marks_len, 0, sizeof (guint32) * (nodes->len - priv->visit_marks_len));
+			priv->visit_marks_len = nodes->len;
+		}
 
-	g_return_val_if_fail (IS_ZAK_AUTHO (zak_autho), FALSE);
+	priv->visit_stamp++;
+	if (priv->visit_stamp == 0)
+		{
+			memset (priv->visit_marks, 0, sizeof (guint32) * priv->visit_marks_len);
+			priv->visit_stamp = 1;
+		}
 
-	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
+	g_array_set_size (priv->visit_stack, 0);
+	g_array_append_val (priv->visit_stack, node);
+	priv->visit_marks[node] = priv->visit_stamp;
 
-	ret = xmlNewNode (NULL, "zak_autho");
-
-	/* roles */
-	g_hash_table_iter_init (&iter, priv->roles);
-	while (g_hash_table_iter_next (&iter, &key, &value))
+	while (priv->visit_stack->len > 0)
 		{
-			xnode_parent = xmlNewNode (NULL, "role");
-
-			role = (Role *)value;
-			xmlSetProp (xnode_parent, "id", zak_autho_irole_get_role_id (ZAK_AUTHO_IROLE (role->irole)));
+			idx = g_array_index (priv->visit_stack, guint32, priv->visit_stack->len - 1);
+			g_array_set_size (priv->visit_stack, priv->visit_stack->len - 1);
 
-			xmlAddChild (ret, xnode_parent);
-
-			parent = role->parents;
-			while (parent != NULL)
+			if (idx == ancestor)
 				{
-					xnode = xmlNewNode (NULL, "parent");
-
-					role = (Role *)parent->data;
-					xmlSetProp (xnode, "id", zak_autho_irole_get_role_id (ZAK_AUTHO_IROLE (role->irole)));
+					return TRUE;
+				}
 
-					xmlAddChild (xnode_parent, xnode);
+			parents = roles ? ((Role *)g_ptr_array_index (nodes, idx))->parents : ((Resource *)g_ptr_array_index (nodes, idx))->parents;
+			while (parents != NULL)
+				{
+					idx = roles ? ((Role *)parents->data)->idx : ((Resource *)parents->data)->idx;
+					if (priv->visit_marks[idx] != priv->visit_stamp)
+						{
+							priv->visit_marks[idx] = priv->visit_stamp;
+							g_array_append_val (priv->visit_stack, idx);
+						}
 
-					parent = g_list_next (parent);
+					parents = g_list_next (parents);
 				}
 		}
 
-	/* resources */
-	g_hash_table_iter_init (&iter, priv->resources);
-	while (g_hash_table_iter_next (&iter, &key, &value))
-		{
-			xnode_parent = xmlNewNode (NULL, "resource");
+	return FALSE;
+}
 
-			resource = (Resource *)value;
-			xmlSetProp (xnode_parent, "id", zak_autho_iresource_get_resource_id (ZAK_AUTHO_IRESOURCE (resource->iresource)));
+/* after a bulk load: every cycle is reported, and the parents linking
+ * nodes of the same cycle are dropped */
+static void
+_zak_autho_break_cycles (ZakAutho *zak_autho, gboolean roles)
+{
+	Hierarchy h;
+	guint32 *comp;
+	guint32 *order;
+	guint32 *comp_size;
+	guint32 i;
+	guint32 j;
+	gboolean found;
+
+	GPtrArray *nodes;
+	GString *str;
+	GList *parents;
+	GList *next;
 
-			xmlAddChild (ret, xnode_parent);
+	ZakAuthoPrivate *priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
 
-			parent = resource->parents;
-			while (parent != NULL)
-				{
-					xnode = xmlNewNode (NULL, "parent");
+	nodes = roles ? priv->roles_idx : priv->resources_idx;
 
-					resource = (Resource *)parent->data;
-					xmlSetProp (xnode, "id", zak_autho_iresource_get_resource_id (ZAK_AUTHO_IRESOURCE (resource->iresource)));
+	memset (&h, 0, sizeof (Hierarchy));
+	_zak_autho_hierarchy_set_parents (&h, nodes, roles);
 
-					xmlAddChild (xnode_parent, xnode);
+	comp = g_new (guint32, h.n + 1);
+	order = g_new (guint32, h.n + 1);
+	comp_size = g_new0 (guint32, _zak_autho_hierarchy_scc (&h, comp, order) + 1);
 
-					parent = g_list_next (parent);
+	found = FALSE;
+	for (i = 0; i < h.n; i++)
+		{
+			comp_size[comp[i]]++;
+		}
+	for (i = 0; i < h.n; i++)
+		{
+			for (j = h.parents_offset[i]; j < h.parents_offset[i + 1]; j++)
+				{
+					if (h.parents[j] == i)
+						{
+							comp_size[comp[i]]++;
+						}
 				}
 		}
 
-	/* rules allow */
-	g_hash_table_iter_init (&iter, priv->rules_allow);
-	while (g_hash_table_iter_next (&iter, &key, &value))
+	/* order groups the nodes of a component together */
+	str = NULL;
+	for (i = 0; i <= h.n; i++)
 		{
-			xnode = xmlNewNode (NULL, "rule");
-
-			xmlSetProp (xnode, "allow", "yes");
-
-			rule = (Rule *)value;
-			xmlSetProp (xnode, "role", zak_autho_irole_get_role_id (ZAK_AUTHO_IROLE (rule->role->irole)));
-			if (rule->resource != NULL)
+			if (str != NULL
+			    && (i == h.n || comp[order[i]] != comp[order[i - 1]]))
 				{
-					xmlSetProp (xnode, "resource", zak_autho_iresource_get_resource_id (ZAK_AUTHO_IRESOURCE (rule->resource->iresource)));
+					g_warning ("%s", str->str);
+					g_string_free (str, TRUE);
+					str = NULL;
 				}
-			else
+			if (i == h.n || comp_size[comp[order[i]]] < 2)
 				{
-					xmlSetProp (xnode, "resource", "");
+					continue;
 				}
 
-			xmlAddChild (ret, xnode);
-		}
-
-	/* rules deny */
-	g_hash_table_iter_init (&iter, priv->rules_deny);
-	while (g_hash_table_iter_next (&iter, &key, &value))
-		{
-			xnode = xmlNewNode (NULL, "rule");
-
-			xmlSetProp (xnode, "allow", "no");
+			found = TRUE;
+			if (str == NULL)
+				{
+					str = g_string_new (roles ? "Cycle between roles:" : "Cycle between resources:");
+				}
+			g_string_append_printf (str, " «%s»",
+			                        roles ? zak_autho_irole_peek_role_id (((Role *)g_ptr_array_index (nodes, order[i]))->irole)
+			                              : zak_autho_iresource_peek_resource_id (((Resource *)g_ptr_array_index (nodes, order[i]))->iresource));
 
-			rule = (Rule *)value;
-			xmlSetProp (xnode, "role", zak_autho_irole_get_role_id (ZAK_AUTHO_IROLE (rule->role->irole)));
-			if (rule->resource != NULL)
+			if (roles)
 				{
-					xmlSetProp (xnode, "resource", zak_autho_iresource_get_resource_id (ZAK_AUTHO_IRESOURCE (rule->resource->iresource)));
+					Role *role = (Role *)g_ptr_array_index (nodes, order[i]);
+
+					parents = role->parents;
+					while (parents != NULL)
+						{
+							next = g_list_next (parents);
+							if (comp[((Role *)parents->data)->idx] == comp[order[i]])
+								{
+									_zak_autho_journal_add (zak_autho, ZAK_AUTHO_JOURNAL_ROLE_PARENT, role->idx, ((Role *)parents->data)->idx, 0, TRUE);
+									role->parents = g_list_delete_link (role->parents, parents);
+								}
+							parents = next;
+						}
 				}
 			else
 				{
-					xmlSetProp (xnode, "resource", "all");
+					Resource *resource = (Resource *)g_ptr_array_index (nodes, order[i]);
+
+					parents = resource->parents;
+					while (parents != NULL)
+						{
+							next = g_list_next (parents);
+							if (comp[((Resource *)parents->data)->idx] == comp[order[i]])
+								{
+									_zak_autho_journal_add (zak_autho, ZAK_AUTHO_JOURNAL_RESOURCE_PARENT, resource->idx, ((Resource *)parents->data)->idx, 0, TRUE);
+									resource->parents = g_list_delete_link (resource->parents, parents);
+								}
+							parents = next;
+						}
 				}
+		}
 
-			xmlAddChild (ret, xnode);
+	if (found)
+		{
+			_zak_autho_policy_changed (zak_autho);
 		}
 
-	return ret;
+	g_free (comp);
+	g_free (order);
+	g_free (comp_size);
+	_zak_autho_hierarchy_free (&h);
 }
 
-/**
- * zak_autho_load_from_xml:
- * @zak_autho: an #ZakAutho object.
- * @xnode:
- * @replace:
- *
- */
-gboolean
-zak_autho_load_from_xml (ZakAutho *zak_autho, xmlNodePtr xnode, gboolean replace)
+static gint
+_zak_autho_rule_compare (gconstpointer a, gconstpointer b)
 {
-	gboolean ret;
-
-	ZakAuthoPrivate *priv;
+	guint64 key_a = (guint64)(*(Rule **)a)->key;
+	guint64 key_b = (guint64)(*(Rule **)b)->key;
 
-	xmlNodePtr current;
-	xmlNodePtr current_parent;
+	return key_a < key_b ? -1 : (key_a > key_b ? 1 : 0);
+}
 
-	ZakAuthoIRole *irole;
-	ZakAuthoIResource *iresource;
-	gchar *prop;
+/* called with the policy locked */
+static Snapshot
+*_zak_autho_snapshot_new (ZakAutho *zak_autho)
+{
+	Snapshot *snap;
+	Role *role;
+	Resource *resource;
+	Rule **rules;
+	GHashTableIter iter;
+	gpointer value;
+	guint32 n_rules;
+	guint32 i;
 
-	g_return_val_if_fail (IS_ZAK_AUTHO (zak_autho), FALSE);
-	g_return_val_if_fail (xnode != NULL, FALSE);
+	ZakAuthoPrivate *priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
 
-	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
+	snap = g_new0 (Snapshot, 1);
+	snap->ref_count = 1;
+	snap->generation = (guint)g_atomic_int_get (&priv->generation);
+	snap->epoch = priv->epoch;
+	g_mutex_init (&snap->lazy_mutex);
 
-	ret = TRUE;
+	snap->role_name_prefix = g_strdup (priv->role_name_prefix);
+	snap->role_name_prefix_len = snap->role_name_prefix == NULL ? 0 : strlen (snap->role_name_prefix);
+	snap->resource_name_prefix = g_strdup (priv->resource_name_prefix);
+	snap->resource_name_prefix_len = snap->resource_name_prefix == NULL ? 0 : strlen (snap->resource_name_prefix);
 
-	if (replace)
+	snap->roles = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	snap->iroles = g_new (ZakAuthoIRole *, priv->roles_idx->len + 1);
+	for (i = 0; i < priv->roles_idx->len; i++)
 		{
-			/* clearing current authorizations */
-			zak_autho_clear (zak_autho);
+			role = (Role *)g_ptr_array_index (priv->roles_idx, i);
+			snap->iroles[i] = role->irole;
+			g_hash_table_insert (snap->roles, g_strdup (zak_autho_irole_peek_role_id (role->irole)), GUINT_TO_POINTER (i + 1));
 		}
 
-	if (xmlStrcmp (xnode->name, "zak_autho") != 0)
+	snap->resources = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	snap->iresources = g_new (ZakAuthoIResource *, priv->resources_idx->len + 1);
+	for (i = 0; i < priv->resources_idx->len; i++)
 		{
-			g_warning ("Invalid xml structure.");
-			ret = FALSE;
+			resource = (Resource *)g_ptr_array_index (priv->resources_idx, i);
+			snap->iresources[i] = resource->iresource;
+			g_hash_table_insert (snap->resources, g_strdup (zak_autho_iresource_peek_resource_id (resource->iresource)), GUINT_TO_POINTER (i + 1));
 		}
-	else
+
+	_zak_autho_hierarchy_build (&snap->roles_hierarchy, priv->roles_idx, TRUE);
+	_zak_autho_hierarchy_build (&snap->resources_hierarchy, priv->resources_idx, FALSE);
+
+	/* the rules of every role, in CSR form */
+	snap->rules_null = g_new (guint8, priv->roles_idx->len + 1);
+	memset (snap->rules_null, ZAK_AUTHO_NOT_FOUND, priv->roles_idx->len + 1);
+	snap->rules_null_type = g_new0 (guint8, priv->roles_idx->len + 1);
+	snap->rules_offset = g_new0 (guint32, priv->roles_idx->len + 1);
+
+	rules = g_new (Rule *, g_hash_table_size (priv->rules) + 1);
+	n_rules = 0;
+	g_hash_table_iter_init (&iter, priv->rules);
+	while (g_hash_table_iter_next (&iter, NULL, &value))
 		{
-			current = xnode->children;
-			while (current != NULL)
+			if (((Rule *)value)->resource == NULL)
 				{
-					if (!xmlNodeIsText (current))
-						{
-							if (xmlStrcmp (current->name, "role") == 0)
-								{
-									prop = g_strstrip (g_strdup ((gchar *)xmlGetProp (current, "id")));
-									if (g_strcmp0 (prop, "") != 0)
-										{
-											irole = ZAK_AUTHO_IROLE (zak_autho_role_new (prop));
-											g_free (prop);
-											zak_autho_add_role (zak_autho, irole);
+					snap->rules_null[((Rule *)value)->role->idx] = _zak_autho_rule_decision (((Rule *)value)->type);
+					snap->rules_null_type[((Rule *)value)->role->idx] = ((Rule *)value)->type;
+				}
+			else
+				{
+					rules[n_rules++] = (Rule *)value;
+					snap->rules_offset[((Rule *)value)->role->idx + 1]++;
+				}
+		}
+	qsort (rules, n_rules, sizeof (Rule *), _zak_autho_rule_compare);
 
-											current_parent = current->children;
-											while (current_parent != NULL)
-												{
-													if (!xmlNodeIsText (current_parent) &&
-													    xmlStrcmp (current_parent->name, "parent") == 0)
-														{
-															prop = g_strstrip (g_strdup ((gchar *)xmlGetProp (current_parent, "id")));
-															if (g_strcmp0 (prop, "") != 0)
-																{
-																	zak_autho_add_parent_to_role (zak_autho, irole,  zak_autho_get_role_from_id (zak_autho, prop));
-																}
-															g_free (prop);
-														}
-													current_parent = current_parent->next;
-												}
-										}
-								}
-							else if (xmlStrcmp (current->name, "resource") == 0)
-								{
-									prop = g_strstrip (g_strdup ((gchar *)xmlGetProp (current, "id")));
-									if (g_strcmp0 (prop, "") != 0)
-										{
-											iresource = ZAK_AUTHO_IRESOURCE (zak_autho_resource_new (prop));
-											zak_autho_add_resource (zak_autho, iresource);
-											g_free (prop);
+	for (i = 0; i < priv->roles_idx->len; i++)
+		{
+			snap->rules_offset[i + 1] += snap->rules_offset[i];
+		}
 
-											current_parent = current->children;
-											while (current_parent != NULL)
-												{
-													if (!xmlNodeIsText (current_parent) &&
-													    xmlStrcmp (current_parent->name, "parent") == 0)
-														{
-															prop = g_strstrip (g_strdup ((gchar *)xmlGetProp (current_parent, "id")));
-															if (g_strcmp0 (prop, "") != 0)
-																{
-																	zak_autho_add_parent_to_resource (zak_autho, iresource, zak_autho_get_resource_from_id (zak_autho, prop));
-																}
-															g_free (prop);
-														}
-													current_parent = current_parent->next;
-												}
-										}
-								}
-							else if (xmlStrcmp (current->name, "rule") == 0)
-								{
-									prop = g_strstrip (g_strdup ((gchar *)xmlGetProp (current, "role")));
-									irole = zak_autho_get_role_from_id (zak_autho, prop);
-									if (irole != NULL)
-										{
-											prop = g_strstrip (g_strdup ((gchar *)xmlGetProp (current, "resource")));
-											if (g_strcmp0 (prop, "") == 0)
-												{
-													iresource = NULL;
-												}
-											else
-												{
-													iresource = zak_autho_get_resource_from_id (zak_autho, prop);
-												}
-											g_free (prop);
+	snap->rules_resource = g_new (guint32, n_rules + 1);
+	snap->rules_decision = g_new (guint8, n_rules + 1);
+	snap->rules_type = g_new (guint8, n_rules + 1);
+	for (i = 0; i < n_rules; i++)
+		{
+			snap->rules_resource[i] = rules[i]->resource->idx;
+			snap->rules_decision[i] = _zak_autho_rule_decision (rules[i]->type);
+			snap->rules_type[i] = rules[i]->type;
+		}
 
-											prop = g_strstrip (g_strdup ((gchar *)xmlGetProp (current, "allow")));
-											if (g_strcmp0 (prop, "yes") == 0)
-												{
-													zak_autho_allow (zak_autho, irole, iresource);
-												}
-											else
-												{
-													zak_autho_deny (zak_autho, irole, iresource);
-												}
-											g_free (prop);
-										}
-								}
-						}
+	/* and by resource */
+	snap->roles_offset = g_new0 (guint32, priv->resources_idx->len + 2);
+	snap->roles_role = g_new (guint32, n_rules + 1);
+	for (i = 0; i < n_rules; i++)
+		{
+			snap->roles_offset[rules[i]->resource->idx + 2]++;
+		}
+	for (i = 0; i < priv->resources_idx->len; i++)
+		{
+			snap->roles_offset[i + 2] += snap->roles_offset[i + 1];
+		}
+	for (i = 0; i < n_rules; i++)
+		{
+			snap->roles_role[snap->roles_offset[rules[i]->resource->idx + 1]++] = rules[i]->role->idx;
+		}
+	g_free (rules);
 
-					current = current->next;
+	snap->roles_null = g_new (guint32, priv->roles_idx->len + 1);
+	snap->n_roles_null = 0;
+	for (i = 0; i < priv->roles_idx->len; i++)
+		{
+			if (snap->rules_null[i] != ZAK_AUTHO_NOT_FOUND)
+				{
+					snap->roles_null[snap->n_roles_null++] = i;
 				}
 		}
 
-	return ret;
+	return snap;
 }
 
-static gboolean
-_zak_autho_delete_table_content (GdaConnection *gdacon, const gchar *table_prefix)
+static void
+_zak_autho_snapshot_unref (Snapshot *snap)
 {
-	gboolean ret;
+	if (!g_atomic_int_dec_and_test (&snap->ref_count))
+		{
+			return;
+		}
 
-	gchar *sql;
-	GError *error;
+	g_free (snap->role_name_prefix);
+	g_free (snap->resource_name_prefix);
+	g_free (snap->iroles);
+	g_free (snap->iresources);
+	g_free (snap->matrix);
+	g_mutex_clear (&snap->lazy_mutex);
 
-	ret = TRUE;
+	if (snap->mapped != NULL)
+		{
+			_zak_autho_hierarchy_free_ancestors (&snap->roles_hierarchy);
+			_zak_autho_hierarchy_free_ancestors (&snap->resources_hierarchy);
+			g_mapped_file_unref (snap->mapped);
+			g_free (snap);
+			return;
+		}
 
-	error = NULL;
-	sql = g_strdup_printf ("DELETE FROM %sroles", table_prefix);
-	gda_connection_execute_non_select_command (gdacon, sql, &error);
-	g_free (sql);
-	if (error != NULL)
+	g_hash_table_destroy (snap->roles);
+	g_hash_table_destroy (snap->resources);
+	_zak_autho_hierarchy_free (&snap->roles_hierarchy);
+	_zak_autho_hierarchy_free (&snap->resources_hierarchy);
+	g_free (snap->rules_offset);
+	g_free (snap->rules_resource);
+	g_free (snap->rules_decision);
+	g_free (snap->rules_type);
+	g_free (snap->rules_null);
+	g_free (snap->rules_null_type);
+	g_free (snap->roles_offset);
+	g_free (snap->roles_role);
+	g_free (snap->roles_null);
+	g_free (snap);
+}
+
+/* called with the policy locked: makes @snap, with its reference, the
+ * one the checks read; the old one goes away when no reader can see it
+ * anymore */
+static void
+_zak_autho_snapshot_replace (ZakAutho *zak_autho, Snapshot *snap)
+{
+	Snapshot *old;
+
+	ZakAuthoPrivate *priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
+
+	old = priv->snapshot;
+	g_atomic_pointer_set (&priv->snapshot, snap);
+
+	if (old != NULL)
 		{
-			g_warning ("Error on deleting roles table content: %s",
-			           error->message != NULL ? error->message : "No details");
+			_zak_autho_synchronize (priv);
+			_zak_autho_snapshot_unref (old);
 		}
-	error = NULL;
-	sql = g_strdup_printf ("DELETE FROM %sroles_parents", table_prefix);
-	gda_connection_execute_non_select_command (gdacon, sql, &error);
+}
+
+/* called with the policy locked: replaces the snapshot if it's out of date */
+static void
+_zak_autho_snapshot_publish (ZakAutho *zak_autho)
+{
+	Snapshot *snap;
+
+	ZakAuthoPrivate *priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
+
+	snap = priv->snapshot;
+	if (snap != NULL
+	    && snap->generation == (guint)g_atomic_int_get (&priv->generation))
+		{
+			return;
+		}
+
+	_zak_autho_snapshot_replace (zak_autho, _zak_autho_snapshot_new (zak_autho));
+}
+
+/* the current snapshot, to be released with _zak_autho_snapshot_leave();
+ * if the policy changed since it was built, and nobody else is changing
+ * it, a new one is published first */
+static Snapshot
+*_zak_autho_snapshot_enter (ZakAutho *zak_autho, guint *phase)
+{
+	Snapshot *snap;
+
+	ZakAuthoPrivate *priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
+
+	*phase = _zak_autho_read_lock (priv);
+	snap = (Snapshot *)g_atomic_pointer_get (&priv->snapshot);
+	if (snap->generation != (guint)g_atomic_int_get (&priv->generation))
+		{
+			_zak_autho_read_unlock (priv, *phase);
+
+			if (g_rec_mutex_trylock (&priv->mutex))
+				{
+					/* bulk loads publish once at the end */
+					if (!priv->on_loading)
+						{
+							_zak_autho_snapshot_publish (zak_autho);
+						}
+					g_rec_mutex_unlock (&priv->mutex);
+				}
+
+			*phase = _zak_autho_read_lock (priv);
+			snap = (Snapshot *)g_atomic_pointer_get (&priv->snapshot);
+		}
+
+	return snap;
+}
+
+static void
+_zak_autho_snapshot_leave (ZakAutho *zak_autho, guint phase)
+{
+	_zak_autho_read_unlock (ZAK_AUTHO_GET_PRIVATE (zak_autho), phase);
+}
+
+/* the hierarchy with its ancestor bitsets, built on first use */
+static Hierarchy
+*_zak_autho_snapshot_get_hierarchy (Snapshot *snap, gboolean roles)
+{
+	Hierarchy *h;
+
+	h = roles ? &snap->roles_hierarchy : &snap->resources_hierarchy;
+	if (!g_atomic_int_get (&h->ancestors_built))
+		{
+			g_mutex_lock (&snap->lazy_mutex);
+			if (!h->ancestors_built)
+				{
+					_zak_autho_hierarchy_build_ancestors (h);
+					g_atomic_int_set (&h->ancestors_built, 1);
+				}
+			g_mutex_unlock (&snap->lazy_mutex);
+		}
+
+	return h;
+}
+
+/* strcmp() of @id against @prefix (@prefix_len bytes) followed by @rest */
+static gint
+_zak_autho_compare_id (const gchar *id, const gchar *prefix, gsize prefix_len, const gchar *rest)
+{
+	gint ret;
+
+	ret = strncmp (id, prefix, prefix_len);
+	if (ret != 0)
+		{
+			return ret;
+		}
+
+	return strcmp (id + prefix_len, rest);
+}
+
+/* the index of the id made of @prefix (may be NULL) followed by @id;
+ * G_MAXUINT32 if not found */
+static guint32
+_zak_autho_snapshot_search (Snapshot *snap, gboolean roles, const gchar *prefix, const gchar *id)
+{
+	const gchar *strings;
+	guint32 *ids;
+	guint32 *sorted;
+	gsize prefix_len;
+	guint32 lo;
+	guint32 hi;
+	guint32 mid;
+	gint cmp;
+
+	if (snap->mapped == NULL)
+		{
+			return GPOINTER_TO_UINT (_zak_autho_lookup_with_prefix (roles ? snap->roles : snap->resources, prefix, id)) - 1;
+		}
+
+	strings = snap->strings;
+	ids = roles ? snap->role_ids : snap->resource_ids;
+	sorted = roles ? snap->roles_sorted : snap->resources_sorted;
+	prefix_len = prefix == NULL ? 0 : strlen (prefix);
+
+	lo = 0;
+	hi = roles ? snap->roles_hierarchy.n : snap->resources_hierarchy.n;
+	while (lo < hi)
+		{
+			mid = lo + (hi - lo) / 2;
+			cmp = _zak_autho_compare_id (strings + ids[sorted[mid]], prefix == NULL ? "" : prefix, prefix_len, id);
+			if (cmp == 0)
+				{
+					return sorted[mid];
+				}
+			if (cmp < 0)
+				{
+					lo = mid + 1;
+				}
+			else
+				{
+					hi = mid;
+				}
+		}
+
+	return G_MAXUINT32;
+}
+
+/* the index of @id, with its prefix replaced by the snapshot's one as
+ * zak_autho_is_allowed() always did; G_MAXUINT32 if not found */
+static guint32
+_zak_autho_snapshot_lookup (Snapshot *snap, gboolean roles, const gchar *id)
+{
+	const gchar *prefix;
+	gsize prefix_len;
+
+	prefix = roles ? snap->role_name_prefix : snap->resource_name_prefix;
+	prefix_len = roles ? snap->role_name_prefix_len : snap->resource_name_prefix_len;
+
+	if (prefix == NULL
+	    || strncmp (id, prefix, prefix_len) == 0)
+		{
+			/* stripping and adding back the prefix gives the id itself */
+			return _zak_autho_snapshot_search (snap, roles, NULL, id);
+		}
+
+	return _zak_autho_snapshot_search (snap, roles, prefix, strlen (id) < prefix_len ? id : id + prefix_len);
+}
+
+/* the objects of a mapped snapshot are created on first use and belong
+ * to the policy from then on */
+static ZakAuthoIRole
+*_zak_autho_snapshot_get_irole (Snapshot *snap, guint32 role_idx)
+{
+	ZakAuthoIRole *irole;
+
+	irole = (ZakAuthoIRole *)g_atomic_pointer_get (&snap->iroles[role_idx]);
+	if (irole == NULL)
+		{
+			irole = ZAK_AUTHO_IROLE (zak_autho_role_new (snap->strings + snap->role_ids[role_idx]));
+			if (!g_atomic_pointer_compare_and_exchange (&snap->iroles[role_idx], NULL, irole))
+				{
+					g_object_unref (irole);
+					irole = (ZakAuthoIRole *)g_atomic_pointer_get (&snap->iroles[role_idx]);
+				}
+		}
+
+	return irole;
+}
+
+static ZakAuthoIResource
+*_zak_autho_snapshot_get_iresource (Snapshot *snap, guint32 resource_idx)
+{
+	ZakAuthoIResource *iresource;
+
+	iresource = (ZakAuthoIResource *)g_atomic_pointer_get (&snap->iresources[resource_idx]);
+	if (iresource == NULL)
+		{
+			iresource = ZAK_AUTHO_IRESOURCE (zak_autho_resource_new (snap->strings + snap->resource_ids[resource_idx]));
+			if (!g_atomic_pointer_compare_and_exchange (&snap->iresources[resource_idx], NULL, iresource))
+				{
+					g_object_unref (iresource);
+					iresource = (ZakAuthoIResource *)g_atomic_pointer_get (&snap->iresources[resource_idx]);
+				}
+		}
+
+	return iresource;
+}
+
+static const gchar
+*_zak_autho_snapshot_peek_role_id (Snapshot *snap, guint32 role_idx)
+{
+	return snap->mapped != NULL ? snap->strings + snap->role_ids[role_idx] : zak_autho_irole_peek_role_id (snap->iroles[role_idx]);
+}
+
+static const gchar
+*_zak_autho_snapshot_peek_resource_id (Snapshot *snap, guint32 resource_idx)
+{
+	return snap->mapped != NULL ? snap->strings + snap->resource_ids[resource_idx] : zak_autho_iresource_peek_resource_id (snap->iresources[resource_idx]);
+}
+
+/* called with the policy locked: fills the tables from the snapshot
+ * loaded with zak_autho_load_snapshot(), if they still aren't; the policy
+ * doesn't change, so the snapshot stays the one the checks read */
+static void
+_zak_autho_materialize (ZakAutho *zak_autho)
+{
+	Snapshot *snap;
+	Role *role;
+	Resource *resource;
+	Rule *rule;
+	Hierarchy *h;
+	guint32 i;
+	guint32 j;
+
+	ZakAuthoPrivate *priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
+
+	snap = priv->mapped_snapshot;
+	if (snap == NULL)
+		{
+			return;
+		}
+	priv->mapped_snapshot = NULL;
+
+	h = &snap->roles_hierarchy;
+	for (i = 0; i < h->n; i++)
+		{
+			role = (Role *)g_malloc0 (sizeof (Role));
+			role->irole = _zak_autho_snapshot_get_irole (snap, i);
+			role->idx = i;
+
+			g_hash_table_insert (priv->roles, (gpointer)zak_autho_irole_get_role_id (role->irole), role);
+			g_ptr_array_add (priv->roles_idx, role);
+		}
+	for (i = h->n; i > 0; i--)
+		{
+			role = (Role *)g_ptr_array_index (priv->roles_idx, i - 1);
+			for (j = h->parents_offset[i]; j > h->parents_offset[i - 1]; j--)
+				{
+					role->parents = g_list_prepend (role->parents, g_ptr_array_index (priv->roles_idx, h->parents[j - 1]));
+				}
+		}
+
+	h = &snap->resources_hierarchy;
+	for (i = 0; i < h->n; i++)
+		{
+			resource = (Resource *)g_malloc0 (sizeof (Resource));
+			resource->iresource = _zak_autho_snapshot_get_iresource (snap, i);
+			resource->idx = i;
+
+			g_hash_table_insert (priv->resources, (gpointer)zak_autho_iresource_get_resource_id (resource->iresource), resource);
+			g_ptr_array_add (priv->resources_idx, resource);
+		}
+	for (i = h->n; i > 0; i--)
+		{
+			resource = (Resource *)g_ptr_array_index (priv->resources_idx, i - 1);
+			for (j = h->parents_offset[i]; j > h->parents_offset[i - 1]; j--)
+				{
+					resource->parents = g_list_prepend (resource->parents, g_ptr_array_index (priv->resources_idx, h->parents[j - 1]));
+				}
+		}
+
+	for (i = 0; i < priv->roles_idx->len; i++)
+		{
+			role = (Role *)g_ptr_array_index (priv->roles_idx, i);
+			if (snap->rules_null_type[i] != 0)
+				{
+					rule = (Rule *)g_malloc0 (sizeof (Rule));
+					rule->role = role;
+					rule->resource = NULL;
+					rule->key = (gint64)ZAK_AUTHO_RULE_KEY (i, ZAK_AUTHO_RESOURCE_IDX_NULL);
+					rule->type = snap->rules_null_type[i];
+					g_hash_table_insert (priv->rules, &rule->key, rule);
+				}
+			for (j = snap->rules_offset[i]; j < snap->rules_offset[i + 1]; j++)
+				{
+					rule = (Rule *)g_malloc0 (sizeof (Rule));
+					rule->role = role;
+					rule->resource = (Resource *)g_ptr_array_index (priv->resources_idx, snap->rules_resource[j]);
+					rule->key = (gint64)ZAK_AUTHO_RULE_KEY (i, snap->rules_resource[j]);
+					rule->type = snap->rules_type[j];
+					g_hash_table_insert (priv->rules, &rule->key, rule);
+				}
+		}
+
+	_zak_autho_snapshot_unref (snap);
+}
+
+static ZakAuthoIsAllowed
+_zak_autho_get_rule (Snapshot *snap, guint32 role_idx, guint32 resource_idx)
+{
+	guint32 lo;
+	guint32 hi;
+	guint32 mid;
+
+	if (resource_idx == ZAK_AUTHO_RESOURCE_IDX_NULL)
+		{
+			return (ZakAuthoIsAllowed)snap->rules_null[role_idx];
+		}
+
+	lo = snap->rules_offset[role_idx];
+	hi = snap->rules_offset[role_idx + 1];
+	while (lo < hi)
+		{
+			mid = lo + (hi - lo) / 2;
+			if (snap->rules_resource[mid] < resource_idx)
+				{
+					lo = mid + 1;
+				}
+			else
+				{
+					hi = mid;
+				}
+		}
+
+	if (lo < snap->rules_offset[role_idx + 1]
+	    && snap->rules_resource[lo] == resource_idx)
+		{
+			return (ZakAuthoIsAllowed)snap->rules_decision[lo];
+		}
+
+	return ZAK_AUTHO_NOT_FOUND;
+}
+
+static ZakAuthoIsAllowed
+_zak_autho_is_allowed_role (Snapshot *snap, guint32 role_idx, guint32 resource_idx, gboolean exclude_null)
+{
+	ZakAuthoIsAllowed ret;
+	Hierarchy *h;
+	guint32 i;
+
+	ret = ZAK_AUTHO_NOT_FOUND;
+
+	if (!exclude_null)
+		{
+			/* first trying for a rule for every resource */
+			ret = _zak_autho_get_rule (snap, role_idx, ZAK_AUTHO_RESOURCE_IDX_NULL);
+			if (ret != ZAK_AUTHO_NOT_FOUND)
+				{
+					return ret;
+				}
+		}
+
+	/* and after for specific resource, then its parents */
+	ret = _zak_autho_is_allowed_resource (snap, role_idx, resource_idx);
+
+	/* trying parents */
+	h = &snap->roles_hierarchy;
+	for (i = h->parents_offset[role_idx];
+	     ret == ZAK_AUTHO_NOT_FOUND && i < h->parents_offset[role_idx + 1];
+	     i++)
+		{
+			ret = _zak_autho_is_allowed_role (snap, h->parents[i], resource_idx, exclude_null);
+		}
+
+	return ret;
+}
+
+static ZakAuthoIsAllowed
+_zak_autho_is_allowed_resource (Snapshot *snap, guint32 role_idx, guint32 resource_idx)
+{
+	ZakAuthoIsAllowed ret;
+	Hierarchy *h;
+	guint32 i;
+
+	ret = _zak_autho_get_rule (snap, role_idx, resource_idx);
+
+	/* trying parents */
+	h = &snap->resources_hierarchy;
+	for (i = h->parents_offset[resource_idx];
+	     ret == ZAK_AUTHO_NOT_FOUND && i < h->parents_offset[resource_idx + 1];
+	     i++)
+		{
+			ret = _zak_autho_is_allowed_resource (snap, role_idx, h->parents[i]);
+		}
+
+	return ret;
+}
+
+/* called with the cache locked */
+static CacheEntry
+*_zak_autho_cache_get_set (ZakAuthoPrivate *priv, guint64 key, gboolean exclude_null, guint *set)
+{
+	guint64 h;
+
+	if (priv->cache == NULL)
+		{
+			if (priv->cache_size == 0)
+				{
+					return NULL;
+				}
+
+			priv->cache_sets = MAX (1, priv->cache_size / ZAK_AUTHO_CACHE_WAYS);
+			priv->cache = g_new0 (CacheEntry, priv->cache_sets * ZAK_AUTHO_CACHE_WAYS);
+			priv->cache_hands = g_new0 (guint8, priv->cache_sets);
+		}
+
+	h = (key ^ (exclude_null ? 1 : 0)) * G_GUINT64_CONSTANT (0x9e3779b97f4a7c15);
+	*set = (guint)((h >> 32) % priv->cache_sets);
+
+	return priv->cache + (gsize)*set * ZAK_AUTHO_CACHE_WAYS;
+}
+
+/* called with the cache locked */
+static gboolean
+_zak_autho_cache_lookup (ZakAuthoPrivate *priv, guint generation, guint64 key, gboolean exclude_null, gboolean *allowed)
+{
+	CacheEntry *entries;
+	guint set;
+	guint i;
+
+	entries = _zak_autho_cache_get_set (priv, key, exclude_null, &set);
+	if (entries == NULL)
+		{
+			return FALSE;
+		}
+
+	for (i = 0; i < ZAK_AUTHO_CACHE_WAYS; i++)
+		{
+			if (entries[i].generation == generation
+			    && entries[i].key == key
+			    && entries[i].exclude_null == (exclude_null ? 1 : 0))
+				{
+					entries[i].referenced = 1;
+					*allowed = entries[i].allowed;
+					priv->cache_hits++;
+					return TRUE;
+				}
+		}
+
+	priv->cache_misses++;
+	return FALSE;
+}
+
+/* called with the cache locked */
+static void
+_zak_autho_cache_insert (ZakAuthoPrivate *priv, guint generation, guint64 key, gboolean exclude_null, gboolean allowed)
+{
+	CacheEntry *entries;
+	CacheEntry *entry;
+	guint set;
+	guint i;
+
+	entries = _zak_autho_cache_get_set (priv, key, exclude_null, &set);
+	if (entries == NULL)
+		{
+			return;
+		}
+
+	entry = NULL;
+	for (i = 0; i < ZAK_AUTHO_CACHE_WAYS; i++)
+		{
+			if (entries[i].generation != generation)
+				{
+					entry = &entries[i];
+					break;
+				}
+		}
+
+	/* CLOCK: the first entry not referenced since the hand passed it */
+	while (entry == NULL)
+		{
+			i = priv->cache_hands[set];
+			priv->cache_hands[set] = (i + 1) % ZAK_AUTHO_CACHE_WAYS;
+
+			if (entries[i].referenced)
+				{
+					entries[i].referenced = 0;
+				}
+			else
+				{
+					entry = &entries[i];
+				}
+		}
+
+	entry->key = key;
+	entry->generation = generation;
+	entry->exclude_null = exclude_null ? 1 : 0;
+	entry->allowed = allowed ? 1 : 0;
+	entry->referenced = 0;
+}
+
+/* offset of the bitset of a role, exclude_null and plane (0 allow, 1 deny) */
+#define ZAK_AUTHO_MATRIX_ROW(matrix, stride, role_idx, exclude_null, plane) \
+	((matrix) + ((((gsize)(role_idx) * 2 + ((exclude_null) ? 1 : 0)) * 2 + (plane)) * (stride)))
+
+static ZakAuthoIsAllowed
+_zak_autho_matrix_get (guint32 *matrix, gsize stride, guint32 role_idx, guint32 resource_idx, gboolean exclude_null)
+{
+	guint32 bit;
+
+	bit = 1u << (resource_idx & 31);
+
+	if (ZAK_AUTHO_MATRIX_ROW (matrix, stride, role_idx, exclude_null, 1)[resource_idx >> 5] & bit)
+		{
+			return ZAK_AUTHO_DENIED;
+		}
+	if (ZAK_AUTHO_MATRIX_ROW (matrix, stride, role_idx, exclude_null, 0)[resource_idx >> 5] & bit)
+		{
+			return ZAK_AUTHO_ALLOWED;
+		}
+
+	return ZAK_AUTHO_NOT_FOUND;
+}
+
+/* same as _zak_autho_is_allowed_role, for every resource, as linear passes
+ * over the roles and the resources in topological order */
+static guint32
+*_zak_autho_matrix_build (Snapshot *snap, gsize *stride)
+{
+	Hierarchy *roles_h;
+	Hierarchy *resources_h;
+	ZakAuthoIsAllowed rule_null;
+	ZakAuthoIsAllowed ret;
+	guint32 *matrix;
+	guint8 *memo;
+	guint32 role_idx;
+	guint32 resource_idx;
+	guint32 i;
+	guint32 j;
+	guint32 k;
+	guint exclude_null;
+
+	roles_h = &snap->roles_hierarchy;
+	resources_h = &snap->resources_hierarchy;
+
+	*stride = (resources_h->n + 31) / 32;
+	matrix = g_new0 (guint32, (gsize)roles_h->n * 4 * *stride + 1);
+
+	memo = g_new (guint8, resources_h->n + 1);
+	memset (memo, ZAK_AUTHO_NOT_FOUND, resources_h->n + 1);
+
+	for (i = 0; i < roles_h->n; i++)
+		{
+			role_idx = roles_h->order[i];
+
+			/* same as _zak_autho_is_allowed_resource */
+			for (j = 0; j < resources_h->n; j++)
+				{
+					resource_idx = resources_h->order[j];
+
+					ret = _zak_autho_get_rule (snap, role_idx, resource_idx);
+					for (k = resources_h->parents_offset[resource_idx];
+					     ret == ZAK_AUTHO_NOT_FOUND && k < resources_h->parents_offset[resource_idx + 1];
+					     k++)
+						{
+							ret = (ZakAuthoIsAllowed)memo[resources_h->parents[k]];
+						}
+					memo[resource_idx] = ret;
+				}
+
+			rule_null = _zak_autho_get_rule (snap, role_idx, ZAK_AUTHO_RESOURCE_IDX_NULL);
+
+			for (exclude_null = 0; exclude_null < 2; exclude_null++)
+				{
+					for (resource_idx = 0; resource_idx < resources_h->n; resource_idx++)
+						{
+							if (!exclude_null && rule_null != ZAK_AUTHO_NOT_FOUND)
+								{
+									ret = rule_null;
+								}
+							else
+								{
+									ret = (ZakAuthoIsAllowed)memo[resource_idx];
+								}
+
+							for (k = roles_h->parents_offset[role_idx];
+							     ret == ZAK_AUTHO_NOT_FOUND && k < roles_h->parents_offset[role_idx + 1];
+							     k++)
+								{
+									ret = _zak_autho_matrix_get (matrix, *stride, roles_h->parents[k], resource_idx, exclude_null);
+								}
+
+							if (ret != ZAK_AUTHO_NOT_FOUND)
+								{
+									ZAK_AUTHO_MATRIX_ROW (matrix, *stride, role_idx, exclude_null, ret == ZAK_AUTHO_DENIED ? 1 : 0)[resource_idx >> 5] |= 1u << (resource_idx & 31);
+								}
+						}
+				}
+		}
+
+	g_free (memo);
+
+	return matrix;
+}
+
+/* the matrix of the snapshot, built on first use */
+static guint32
+*_zak_autho_snapshot_get_matrix (Snapshot *snap)
+{
+	guint32 *matrix;
+
+	matrix = (guint32 *)g_atomic_pointer_get (&snap->matrix);
+	if (matrix == NULL)
+		{
+			g_mutex_lock (&snap->lazy_mutex);
+			matrix = snap->matrix;
+			if (matrix == NULL)
+				{
+					matrix = _zak_autho_matrix_build (snap, &snap->matrix_stride);
+					g_atomic_pointer_set (&snap->matrix, matrix);
+				}
+			g_mutex_unlock (&snap->lazy_mutex);
+		}
+
+	return matrix;
+}
+
+/* the decision once role and resource are known and the NULL rule of the
+ * role itself didn't answer */
+static gboolean
+_zak_autho_decide (ZakAutho *zak_autho, Snapshot *snap, guint32 role_idx, guint32 resource_idx, gboolean exclude_null)
+{
+	gboolean ret;
+	gboolean cached;
+	ZakAuthoIsAllowed isAllowed;
+	guint32 *matrix;
+	guint64 key;
+
+	ZakAuthoPrivate *priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
+
+	key = ZAK_AUTHO_RULE_KEY (role_idx, resource_idx);
+
+	/* the cache is skipped rather than waited for */
+	cached = FALSE;
+	if (g_atomic_int_get (&priv->cache_size) > 0
+	    && g_mutex_trylock (&priv->cache_mutex))
+		{
+			cached = _zak_autho_cache_lookup (priv, snap->generation, key, exclude_null, &ret);
+			g_mutex_unlock (&priv->cache_mutex);
+		}
+	if (cached)
+		{
+			return ret;
+		}
+
+	if (g_atomic_int_get (&priv->compiled))
+		{
+			matrix = _zak_autho_snapshot_get_matrix (snap);
+			isAllowed = _zak_autho_matrix_get (matrix, snap->matrix_stride, role_idx, resource_idx, exclude_null);
+		}
+	else
+		{
+			isAllowed = _zak_autho_is_allowed_role (snap, role_idx, resource_idx, exclude_null);
+		}
+
+	ret = (isAllowed == ZAK_AUTHO_ALLOWED);
+
+	if (g_atomic_int_get (&priv->cache_size) > 0
+	    && g_mutex_trylock (&priv->cache_mutex))
+		{
+			_zak_autho_cache_insert (priv, snap->generation, key, exclude_null, ret);
+			g_mutex_unlock (&priv->cache_mutex);
+		}
+
+	return ret;
+}
+
+/**
+ * zak_autho_is_allowed:
+ * @zak_autho: an #ZakAutho object.
+ * @irole: an #ZakAuthoIRole object.
+ * @iresource: an #ZakAuthoIResource object.
+ * @exclude_null: whether or not to exclude roles allowed to every resource.
+ *
+ */
+gboolean
+zak_autho_is_allowed (ZakAutho *zak_autho, ZakAuthoIRole *irole, ZakAuthoIResource *iresource, gboolean exclude_null)
+{
+	gboolean ret;
+	ZakAuthoIsAllowed isAllowed;
+
+	Snapshot *snap;
+	guint phase;
+	guint32 role_idx;
+	guint32 resource_idx;
+
+	g_return_val_if_fail (IS_ZAK_AUTHO (zak_autho), FALSE);
+	g_return_val_if_fail (ZAK_AUTHO_IS_IROLE (irole), FALSE);
+
+	_zak_autho_check_updated (zak_autho);
+
+	ret = FALSE;
+	isAllowed = ZAK_AUTHO_NOT_FOUND;
+
+	snap = _zak_autho_snapshot_enter (zak_autho, &phase);
+
+	role_idx = _zak_autho_snapshot_lookup (snap, TRUE, zak_autho_irole_peek_role_id (irole));
+	if (role_idx == G_MAXUINT32)
+		{
+			g_warning ("Role «%s» not found.", zak_autho_irole_peek_role_id (irole));
+		}
+	else
+		{
+			if (!exclude_null)
+				{
+					/* first trying for a rule for every resource */
+					isAllowed = _zak_autho_get_rule (snap, role_idx, ZAK_AUTHO_RESOURCE_IDX_NULL);
+				}
+
+			if (isAllowed != ZAK_AUTHO_NOT_FOUND)
+				{
+					ret = (isAllowed == ZAK_AUTHO_ALLOWED);
+				}
+			else if (!ZAK_AUTHO_IS_IRESOURCE (iresource))
+				{
+					g_critical ("%s: assertion '%s' failed", G_STRFUNC, "ZAK_AUTHO_IS_IRESOURCE (iresource)");
+				}
+			else
+				{
+					resource_idx = _zak_autho_snapshot_lookup (snap, FALSE, zak_autho_iresource_peek_resource_id (iresource));
+					if (resource_idx == G_MAXUINT32)
+						{
+							g_warning ("Resource «%s» not found.", zak_autho_iresource_peek_resource_id (iresource));
+						}
+					else
+						{
+							ret = _zak_autho_decide (zak_autho, snap, role_idx, resource_idx, exclude_null);
+						}
+				}
+		}
+
+	_zak_autho_snapshot_leave (zak_autho, phase);
+
+	return ret;
+}
+
+#define ZAK_AUTHO_HANDLE(epoch, idx) ((((guint64)(epoch)) << 32) | ((guint64)(idx) + 1))
+#define ZAK_AUTHO_HANDLE_EPOCH(handle) ((guint32)((handle) >> 32))
+#define ZAK_AUTHO_HANDLE_IDX(handle) ((guint32)((handle) & G_MAXUINT32) - 1)
+
+/**
+ * zak_autho_lookup_role_handle:
+ * @zak_autho: an #ZakAutho object.
+ * @role_id: the id of a role, resolved as zak_autho_is_allowed() does.
+ *
+ * Returns: an handle for zak_autho_is_allowed_h(), valid until the
+ * policy is cleared or replaced; #ZAK_AUTHO_HANDLE_INVALID if @role_id
+ * isn't found.
+ */
+ZakAuthoRoleHandle
+zak_autho_lookup_role_handle (ZakAutho *zak_autho, const gchar *role_id)
+{
+	ZakAuthoRoleHandle ret;
+
+	Snapshot *snap;
+	guint phase;
+	guint32 role_idx;
+
+	g_return_val_if_fail (IS_ZAK_AUTHO (zak_autho), ZAK_AUTHO_HANDLE_INVALID);
+	g_return_val_if_fail (role_id != NULL, ZAK_AUTHO_HANDLE_INVALID);
+
+	_zak_autho_check_updated (zak_autho);
+
+	snap = _zak_autho_snapshot_enter (zak_autho, &phase);
+
+	role_idx = _zak_autho_snapshot_lookup (snap, TRUE, role_id);
+	if (role_idx == G_MAXUINT32)
+		{
+			g_warning ("Role «%s» not found.", role_id);
+			ret = ZAK_AUTHO_HANDLE_INVALID;
+		}
+	else
+		{
+			ret = ZAK_AUTHO_HANDLE (snap->epoch, role_idx);
+		}
+
+	_zak_autho_snapshot_leave (zak_autho, phase);
+
+	return ret;
+}
+
+/**
+ * zak_autho_lookup_resource_handle:
+ * @zak_autho: an #ZakAutho object.
+ * @resource_id: the id of a resource, resolved as zak_autho_is_allowed()
+ * does.
+ *
+ * Returns: an handle for zak_autho_is_allowed_h(), valid until the
+ * policy is cleared or replaced; #ZAK_AUTHO_HANDLE_INVALID if
+ * @resource_id isn't found.
+ */
+ZakAuthoResourceHandle
+zak_autho_lookup_resource_handle (ZakAutho *zak_autho, const gchar *resource_id)
+{
+	ZakAuthoResourceHandle ret;
+
+	Snapshot *snap;
+	guint phase;
+	guint32 resource_idx;
+
+	g_return_val_if_fail (IS_ZAK_AUTHO (zak_autho), ZAK_AUTHO_HANDLE_INVALID);
+	g_return_val_if_fail (resource_id != NULL, ZAK_AUTHO_HANDLE_INVALID);
+
+	_zak_autho_check_updated (zak_autho);
+
+	snap = _zak_autho_snapshot_enter (zak_autho, &phase);
+
+	resource_idx = _zak_autho_snapshot_lookup (snap, FALSE, resource_id);
+	if (resource_idx == G_MAXUINT32)
+		{
+			g_warning ("Resource «%s» not found.", resource_id);
+			ret = ZAK_AUTHO_HANDLE_INVALID;
+		}
+	else
+		{
+			ret = ZAK_AUTHO_HANDLE (snap->epoch, resource_idx);
+		}
+
+	_zak_autho_snapshot_leave (zak_autho, phase);
+
+	return ret;
+}
+
+/**
+ * zak_autho_is_allowed_h:
+ * @zak_autho: an #ZakAutho object.
+ * @role: an handle from zak_autho_lookup_role_handle().
+ * @resource: an handle from zak_autho_lookup_resource_handle().
+ * @exclude_null: whether or not to exclude roles allowed to every resource.
+ *
+ * Same as zak_autho_is_allowed(), without resolving ids.
+ *
+ * Returns: #FALSE also if an handle is invalid or out of date.
+ */
+gboolean
+zak_autho_is_allowed_h (ZakAutho *zak_autho, ZakAuthoRoleHandle role, ZakAuthoResourceHandle resource, gboolean exclude_null)
+{
+	gboolean ret;
+	ZakAuthoIsAllowed isAllowed;
+
+	Snapshot *snap;
+	guint phase;
+
+	_zak_autho_check_updated (zak_autho);
+
+	ret = FALSE;
+	isAllowed = ZAK_AUTHO_NOT_FOUND;
+
+	snap = _zak_autho_snapshot_enter (zak_autho, &phase);
+
+	if (role == ZAK_AUTHO_HANDLE_INVALID
+	    || ZAK_AUTHO_HANDLE_EPOCH (role) != snap->epoch
+	    || ZAK_AUTHO_HANDLE_IDX (role) >= snap->roles_hierarchy.n)
+		{
+			g_warning ("Invalid role handle.");
+		}
+	else
+		{
+			if (!exclude_null)
+				{
+					/* first trying for a rule for every resource */
+					isAllowed = _zak_autho_get_rule (snap, ZAK_AUTHO_HANDLE_IDX (role), ZAK_AUTHO_RESOURCE_IDX_NULL);
+				}
+
+			if (isAllowed != ZAK_AUTHO_NOT_FOUND)
+				{
+					ret = (isAllowed == ZAK_AUTHO_ALLOWED);
+				}
+			else if (resource == ZAK_AUTHO_HANDLE_INVALID
+			         || ZAK_AUTHO_HANDLE_EPOCH (resource) != snap->epoch
+			         || ZAK_AUTHO_HANDLE_IDX (resource) >= snap->resources_hierarchy.n)
+				{
+					g_warning ("Invalid resource handle.");
+				}
+			else
+				{
+					ret = _zak_autho_decide (zak_autho, snap, ZAK_AUTHO_HANDLE_IDX (role), ZAK_AUTHO_HANDLE_IDX (resource), exclude_null);
+				}
+		}
+
+	_zak_autho_snapshot_leave (zak_autho, phase);
+
+	return ret;
+}
+
+#define ZAK_AUTHO_FILTER_UNKNOWN 0xff
+
+/* what zak_autho_filter_allowed learns on a role and a resource: the
+ * decision through the resource parents and the one through the role
+ * parents; only the pairs met are kept, in an open addressing table */
+typedef struct _FilterEntry FilterEntry;
+struct _FilterEntry
+	{
+		guint64 key; /* ZAK_AUTHO_RULE_KEY, ZAK_AUTHO_FILTER_FREE if free */
+		guint8 resources;
+		guint8 roles;
+	};
+
+#define ZAK_AUTHO_FILTER_FREE G_MAXUINT64
+
+typedef struct _FilterFrame FilterFrame;
+struct _FilterFrame
+	{
+		guint32 node;
+		guint32 pos;
+	};
+
+typedef struct _FilterMemo FilterMemo;
+struct _FilterMemo
+	{
+		FilterEntry *entries;
+		guint32 n_entries;
+		guint32 size; /* a power of two */
+		FilterFrame *resources_stack;
+		guint32 resources_stack_size;
+		FilterFrame *roles_stack;
+		guint32 roles_stack_size;
+	};
+
+static void
+_zak_autho_filter_memo_init (FilterMemo *memo, guint32 size)
+{
+	guint32 i;
+
+	memo->entries = g_new (FilterEntry, size);
+	memo->n_entries = 0;
+	memo->size = size;
+	for (i = 0; i < size; i++)
+		{
+			memo->entries[i].key = ZAK_AUTHO_FILTER_FREE;
+		}
+}
+
+static FilterEntry
+*_zak_autho_filter_slot (FilterMemo *memo, guint64 key)
+{
+	guint32 slot;
+
+	slot = (guint32)((key * G_GUINT64_CONSTANT (0x9e3779b97f4a7c15)) >> 32) & (memo->size - 1);
+	while (memo->entries[slot].key != key
+	       && memo->entries[slot].key != ZAK_AUTHO_FILTER_FREE)
+		{
+			slot = (slot + 1) & (memo->size - 1);
+		}
+
+	return &memo->entries[slot];
+}
+
+/* valid until the next call */
+static FilterEntry
+*_zak_autho_filter_get_entry (FilterMemo *memo, guint32 role_idx, guint32 resource_idx)
+{
+	FilterEntry *entry;
+	FilterEntry *old_entries;
+	guint32 old_size;
+	guint64 key;
+	guint32 i;
+
+	key = ZAK_AUTHO_RULE_KEY (role_idx, resource_idx);
+
+	entry = _zak_autho_filter_slot (memo, key);
+	if (entry->key == key)
+		{
+			return entry;
+		}
+
+	/* kept at most half full */
+	if ((memo->n_entries + 1) * 2 > memo->size)
+		{
+			old_entries = memo->entries;
+			old_size = memo->size;
+			_zak_autho_filter_memo_init (memo, old_size * 2);
+			for (i = 0; i < old_size; i++)
+				{
+					if (old_entries[i].key != ZAK_AUTHO_FILTER_FREE)
+						{
+							*_zak_autho_filter_slot (memo, old_entries[i].key) = old_entries[i];
+							memo->n_entries++;
+						}
+				}
+			g_free (old_entries);
+
+			entry = _zak_autho_filter_slot (memo, key);
+		}
+
+	entry->key = key;
+	entry->resources = ZAK_AUTHO_FILTER_UNKNOWN;
+	entry->roles = ZAK_AUTHO_FILTER_UNKNOWN;
+	memo->n_entries++;
+
+	return entry;
+}
+
+/* _zak_autho_is_allowed_resource with the results kept in @memo, without
+ * recursion */
+static ZakAuthoIsAllowed
+_zak_autho_filter_resource (Snapshot *snap, FilterMemo *memo, guint32 role_idx, guint32 resource_idx)
+{
+	ZakAuthoIsAllowed ret;
+	Hierarchy *h;
+	FilterEntry *entry;
+	FilterFrame *frame;
+	guint32 sp;
+	guint32 parent;
+
+	/* nothing to find */
+	if (snap->rules_offset[role_idx] == snap->rules_offset[role_idx + 1])
+		{
+			return ZAK_AUTHO_NOT_FOUND;
+		}
+
+	h = &snap->resources_hierarchy;
+
+	entry = _zak_autho_filter_get_entry (memo, role_idx, resource_idx);
+	if (entry->resources != ZAK_AUTHO_FILTER_UNKNOWN)
+		{
+			return (ZakAuthoIsAllowed)entry->resources;
+		}
+
+	ret = _zak_autho_get_rule (snap, role_idx, resource_idx);
+	if (ret != ZAK_AUTHO_NOT_FOUND)
+		{
+			entry->resources = ret;
+			return ret;
+		}
+
+	sp = 0;
+	memo->resources_stack[sp].node = resource_idx;
+	memo->resources_stack[sp].pos = h->parents_offset[resource_idx];
+	sp++;
+
+	while (sp > 0)
+		{
+			frame = &memo->resources_stack[sp - 1];
+			if (ret == ZAK_AUTHO_NOT_FOUND
+			    && frame->pos < h->parents_offset[frame->node + 1])
+				{
+					parent = h->parents[frame->pos++];
+
+					entry = _zak_autho_filter_get_entry (memo, role_idx, parent);
+					if (entry->resources != ZAK_AUTHO_FILTER_UNKNOWN)
+						{
+							ret = (ZakAuthoIsAllowed)entry->resources;
+							continue;
+						}
+
+					ret = _zak_autho_get_rule (snap, role_idx, parent);
+					if (ret != ZAK_AUTHO_NOT_FOUND)
+						{
+							entry->resources = ret;
+							continue;
+						}
+
+					if (sp == memo->resources_stack_size)
+						{
+							memo->resources_stack_size *= 2;
+							memo->resources_stack = g_renew (FilterFrame, memo->resources_stack, memo->resources_stack_size);
+						}
+					memo->resources_stack[sp].node = parent;
+					memo->resources_stack[sp].pos = h->parents_offset[parent];
+					sp++;
+					continue;
+				}
+
+			/* a parent answered or there are no more */
+			_zak_autho_filter_get_entry (memo, role_idx, frame->node)->resources = ret;
+			sp--;
+		}
+
+	return ret;
+}
+
+/* the decision of the role itself, before its parents */
+static ZakAuthoIsAllowed
+_zak_autho_filter_role_own (Snapshot *snap, FilterMemo *memo, guint32 role_idx, guint32 resource_idx, gboolean exclude_null)
+{
+	ZakAuthoIsAllowed ret;
+
+	ret = ZAK_AUTHO_NOT_FOUND;
+	if (!exclude_null)
+		{
+			ret = (ZakAuthoIsAllowed)snap->rules_null[role_idx];
+		}
+	if (ret == ZAK_AUTHO_NOT_FOUND)
+		{
+			ret = _zak_autho_filter_resource (snap, memo, role_idx, resource_idx);
+		}
+
+	return ret;
+}
+
+/* _zak_autho_is_allowed_role with the results kept in @memo, without
+ * recursion */
+static ZakAuthoIsAllowed
+_zak_autho_filter_role (Snapshot *snap, FilterMemo *memo, guint32 role_idx, guint32 resource_idx, gboolean exclude_null)
+{
+	ZakAuthoIsAllowed ret;
+	Hierarchy *h;
+	FilterEntry *entry;
+	FilterFrame *frame;
+	guint32 sp;
+	guint32 parent;
+
+	h = &snap->roles_hierarchy;
+
+	entry = _zak_autho_filter_get_entry (memo, role_idx, resource_idx);
+	if (entry->roles != ZAK_AUTHO_FILTER_UNKNOWN)
+		{
+			return (ZakAuthoIsAllowed)entry->roles;
+		}
+
+	ret = _zak_autho_filter_role_own (snap, memo, role_idx, resource_idx, exclude_null);
+	if (ret != ZAK_AUTHO_NOT_FOUND)
+		{
+			_zak_autho_filter_get_entry (memo, role_idx, resource_idx)->roles = ret;
+			return ret;
+		}
+
+	sp = 0;
+	memo->roles_stack[sp].node = role_idx;
+	memo->roles_stack[sp].pos = h->parents_offset[role_idx];
+	sp++;
+
+	while (sp > 0)
+		{
+			frame = &memo->roles_stack[sp - 1];
+			if (ret == ZAK_AUTHO_NOT_FOUND
+			    && frame->pos < h->parents_offset[frame->node + 1])
+				{
+					parent = h->parents[frame->pos++];
+
+					entry = _zak_autho_filter_get_entry (memo, parent, resource_idx);
+					if (entry->roles != ZAK_AUTHO_FILTER_UNKNOWN)
+						{
+							ret = (ZakAuthoIsAllowed)entry->roles;
+							continue;
+						}
+
+					ret = _zak_autho_filter_role_own (snap, memo, parent, resource_idx, exclude_null);
+					if (ret != ZAK_AUTHO_NOT_FOUND)
+						{
+							_zak_autho_filter_get_entry (memo, parent, resource_idx)->roles = ret;
+							continue;
+						}
+
+					if (sp == memo->roles_stack_size)
+						{
+							memo->roles_stack_size *= 2;
+							memo->roles_stack = g_renew (FilterFrame, memo->roles_stack, memo->roles_stack_size);
+						}
+					memo->roles_stack[sp].node = parent;
+					memo->roles_stack[sp].pos = h->parents_offset[parent];
+					sp++;
+					continue;
+				}
+
+			/* a parent answered or there are no more */
+			_zak_autho_filter_get_entry (memo, frame->node, resource_idx)->roles = ret;
+			sp--;
+		}
+
+	return ret;
+}
+
+/**
+ * zak_autho_filter_allowed:
+ * @zak_autho: an #ZakAutho object.
+ * @irole: an #ZakAuthoIRole object.
+ * @resource_ids: (array length=n): ids of the resources to check.
+ * @n: the number of @resource_ids.
+ * @out_mask: at least (@n + 7) / 8 bytes; bit i % 8 of byte i / 8 is set
+ * if @irole is allowed to @resource_ids[i].
+ * @exclude_null: whether or not to exclude roles allowed to every resource.
+ *
+ * Same as calling zak_autho_is_allowed() for every resource, but the role
+ * is resolved once and the decisions on common ancestors are shared.
+ *
+ * Returns: #FALSE if @irole isn't found.
+ */
+gboolean
+zak_autho_filter_allowed (ZakAutho *zak_autho, ZakAuthoIRole *irole, const gchar **resource_ids, guint n, guint8 *out_mask, gboolean exclude_null)
+{
+	gboolean ret;
+	ZakAuthoIsAllowed isAllowed;
+
+	Snapshot *snap;
+	guint phase;
+	guint32 role_idx;
+	guint32 resource_idx;
+	guint32 *matrix;
+	FilterMemo memo;
+	guint i;
+
+	ZakAuthoPrivate *priv;
+
+	g_return_val_if_fail (IS_ZAK_AUTHO (zak_autho), FALSE);
+	g_return_val_if_fail (ZAK_AUTHO_IS_IROLE (irole), FALSE);
+	g_return_val_if_fail (n == 0 || (resource_ids != NULL && out_mask != NULL), FALSE);
+
+	_zak_autho_check_updated (zak_autho);
+
+	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
+
+	memset (out_mask, 0, (n + 7) / 8);
+
+	snap = _zak_autho_snapshot_enter (zak_autho, &phase);
+
+	ret = TRUE;
+	isAllowed = ZAK_AUTHO_NOT_FOUND;
+
+	role_idx = _zak_autho_snapshot_lookup (snap, TRUE, zak_autho_irole_peek_role_id (irole));
+	if (role_idx == G_MAXUINT32)
+		{
+			g_warning ("Role «%s» not found.", zak_autho_irole_peek_role_id (irole));
+			ret = FALSE;
+		}
+	else if (!exclude_null)
+		{
+			/* a rule for every resource answers for all of them */
+			isAllowed = _zak_autho_get_rule (snap, role_idx, ZAK_AUTHO_RESOURCE_IDX_NULL);
+			if (isAllowed == ZAK_AUTHO_ALLOWED)
+				{
+					memset (out_mask, 0xff, n / 8);
+					for (i = n & ~7u; i < n; i++)
+						{
+							out_mask[i >> 3] |= 1u << (i & 7);
+						}
+				}
+		}
+
+	if (ret && isAllowed == ZAK_AUTHO_NOT_FOUND)
+		{
+			matrix = NULL;
+			memo.entries = NULL;
+			if (g_atomic_int_get (&priv->compiled))
+				{
+					matrix = _zak_autho_snapshot_get_matrix (snap);
+				}
+			else
+				{
+					_zak_autho_filter_memo_init (&memo, 256);
+					memo.resources_stack_size = 64;
+					memo.resources_stack = g_new (FilterFrame, memo.resources_stack_size);
+					memo.roles_stack_size = 64;
+					memo.roles_stack = g_new (FilterFrame, memo.roles_stack_size);
+				}
+
+			for (i = 0; i < n; i++)
+				{
+					resource_idx = _zak_autho_snapshot_lookup (snap, FALSE, resource_ids[i]);
+					if (resource_idx == G_MAXUINT32)
+						{
+							g_warning ("Resource «%s» not found.", resource_ids[i]);
+							continue;
+						}
+
+					if (matrix != NULL)
+						{
+							/* the deny plane doesn't matter here */
+							if (ZAK_AUTHO_MATRIX_ROW (matrix, snap->matrix_stride, role_idx, exclude_null, 0)[resource_idx >> 5] & (1u << (resource_idx & 31)))
+								{
+									out_mask[i >> 3] |= 1u << (i & 7);
+								}
+						}
+					else if (_zak_autho_filter_role (snap, &memo, role_idx, resource_idx, exclude_null) == ZAK_AUTHO_ALLOWED)
+						{
+							out_mask[i >> 3] |= 1u << (i & 7);
+						}
+				}
+
+			if (memo.entries != NULL)
+				{
+					g_free (memo.entries);
+					g_free (memo.resources_stack);
+					g_free (memo.roles_stack);
+				}
+		}
+
+	_zak_autho_snapshot_leave (zak_autho, phase);
+
+	return ret;
+}
+
+/* the decision of a role on every resource: the roles are taken in the
+ * order _zak_autho_is_allowed_role visits them, and for each one with
+ * rules the decisions are pushed from the resources to their children */
+static void
+_zak_autho_role_decisions (Snapshot *snap, guint32 role_idx, gboolean exclude_null, guint8 *decisions)
+{
+	Hierarchy *roles_h;
+	Hierarchy *resources_h;
+	ZakAuthoIsAllowed rule_null;
+	guint8 *visited;
+	guint8 *memo;
+	guint32 *stack;
+	guint32 sp;
+	guint32 node;
+	guint32 resource_idx;
+	guint32 i;
+	guint32 k;
+
+	roles_h = &snap->roles_hierarchy;
+	resources_h = &snap->resources_hierarchy;
+
+	memset (decisions, ZAK_AUTHO_NOT_FOUND, resources_h->n);
+
+	memo = g_new (guint8, resources_h->n + 1);
+	visited = g_new0 (guint8, roles_h->n + 1);
+	stack = g_new (guint32, roles_h->parents_offset[roles_h->n] + 1);
+
+	rule_null = ZAK_AUTHO_NOT_FOUND;
+	sp = 0;
+	stack[sp++] = role_idx;
+	while (sp > 0 && rule_null == ZAK_AUTHO_NOT_FOUND)
+		{
+			node = stack[--sp];
+			if (visited[node])
+				{
+					continue;
+				}
+			visited[node] = 1;
+
+			if (!exclude_null)
+				{
+					rule_null = (ZakAuthoIsAllowed)snap->rules_null[node];
+				}
+
+			if (rule_null == ZAK_AUTHO_NOT_FOUND
+			    && snap->rules_offset[node] < snap->rules_offset[node + 1])
+				{
+					memset (memo, ZAK_AUTHO_NOT_FOUND, resources_h->n);
+					for (i = snap->rules_offset[node]; i < snap->rules_offset[node + 1]; i++)
+						{
+							memo[snap->rules_resource[i]] = snap->rules_decision[i];
+						}
+
+					/* parents first: a resource without a rule takes the
+					 * decision of its first parent that has one */
+					for (i = 0; i < resources_h->n; i++)
+						{
+							resource_idx = resources_h->order[i];
+							for (k = resources_h->parents_offset[resource_idx];
+							     memo[resource_idx] == ZAK_AUTHO_NOT_FOUND && k < resources_h->parents_offset[resource_idx + 1];
+							     k++)
+								{
+									memo[resource_idx] = memo[resources_h->parents[k]];
+								}
+
+							if (decisions[resource_idx] == ZAK_AUTHO_NOT_FOUND)
+								{
+									decisions[resource_idx] = memo[resource_idx];
+								}
+						}
+				}
+
+			/* parents pushed backwards to be visited in order */
+			for (k = roles_h->parents_offset[node + 1]; k > roles_h->parents_offset[node]; k--)
+				{
+					stack[sp++] = roles_h->parents[k - 1];
+				}
+		}
+
+	if (rule_null != ZAK_AUTHO_NOT_FOUND)
+		{
+			for (i = 0; i < resources_h->n; i++)
+				{
+					if (decisions[i] == ZAK_AUTHO_NOT_FOUND)
+						{
+							decisions[i] = rule_null;
+						}
+				}
+		}
+
+	g_free (stack);
+	g_free (visited);
+	g_free (memo);
+}
+
+/**
+ * zak_autho_get_allowed_resources:
+ * @zak_autho: an #ZakAutho object.
+ * @irole: an #ZakAuthoIRole object.
+ * @subtree_root: (allow-none): if not #NULL, only this resource and its
+ * descendants are returned.
+ * @exclude_null: whether or not to exclude roles allowed to every resource.
+ *
+ * Returns: (transfer full): a #GArray of the #ZakAuthoResourceHandle of
+ * every resource @irole is allowed to, sorted; #NULL if @irole or
+ * @subtree_root isn't found.
+ */
+GArray
+*zak_autho_get_allowed_resources (ZakAutho *zak_autho, ZakAuthoIRole *irole, ZakAuthoIResource *subtree_root, gboolean exclude_null)
+{
+	return zak_autho_get_allowed_resources_page (zak_autho, irole, subtree_root, exclude_null, 0, 0);
+}
+
+/**
+ * zak_autho_get_allowed_resources_page:
+ * @zak_autho: an #ZakAutho object.
+ * @irole: an #ZakAuthoIRole object.
+ * @subtree_root: (allow-none): if not #NULL, only this resource and its
+ * descendants are returned.
+ * @exclude_null: whether or not to exclude roles allowed to every resource.
+ * @offset: how many of the allowed resources to skip.
+ * @limit: the maximum number of handles to return; 0 for no limit.
+ *
+ * Same as zak_autho_get_allowed_resources(), a page at a time.
+ *
+ * Returns: (transfer full): a #GArray of #ZakAuthoResourceHandle.
+ */
+GArray
+*zak_autho_get_allowed_resources_page (ZakAutho *zak_autho, ZakAuthoIRole *irole, ZakAuthoIResource *subtree_root, gboolean exclude_null, guint offset, guint limit)
+{
+	GArray *ret;
+
+	Snapshot *snap;
+	guint phase;
+	Hierarchy *h;
+	ZakAuthoResourceHandle handle;
+	guint32 role_idx;
+	guint32 root_idx;
+	guint32 *matrix;
+	guint8 *decisions;
+	gboolean allowed;
+	guint32 i;
+
+	ZakAuthoPrivate *priv;
+
+	g_return_val_if_fail (IS_ZAK_AUTHO (zak_autho), NULL);
+	g_return_val_if_fail (ZAK_AUTHO_IS_IROLE (irole), NULL);
+	g_return_val_if_fail (subtree_root == NULL || ZAK_AUTHO_IS_IRESOURCE (subtree_root), NULL);
+
+	_zak_autho_check_updated (zak_autho);
+
+	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
+
+	snap = _zak_autho_snapshot_enter (zak_autho, &phase);
+
+	root_idx = G_MAXUINT32;
+	role_idx = _zak_autho_snapshot_lookup (snap, TRUE, zak_autho_irole_peek_role_id (irole));
+	if (role_idx == G_MAXUINT32)
+		{
+			g_warning ("Role «%s» not found.", zak_autho_irole_peek_role_id (irole));
+			_zak_autho_snapshot_leave (zak_autho, phase);
+			return NULL;
+		}
+	if (subtree_root != NULL)
+		{
+			root_idx = _zak_autho_snapshot_lookup (snap, FALSE, zak_autho_iresource_peek_resource_id (subtree_root));
+			if (root_idx == G_MAXUINT32)
+				{
+					g_warning ("Resource «%s» not found.", zak_autho_iresource_peek_resource_id (subtree_root));
+					_zak_autho_snapshot_leave (zak_autho, phase);
+					return NULL;
+				}
+		}
+
+	ret = g_array_new (FALSE, FALSE, sizeof (ZakAuthoResourceHandle));
+
+	matrix = NULL;
+	decisions = NULL;
+	if (g_atomic_int_get (&priv->compiled))
+		{
+			matrix = _zak_autho_snapshot_get_matrix (snap);
+		}
+	else
+		{
+			decisions = g_new (guint8, snap->resources_hierarchy.n + 1);
+			_zak_autho_role_decisions (snap, role_idx, exclude_null, decisions);
+		}
+
+	h = NULL;
+	if (root_idx != G_MAXUINT32)
+		{
+			h = _zak_autho_snapshot_get_hierarchy (snap, FALSE);
+		}
+
+	for (i = 0; i < snap->resources_hierarchy.n && (limit == 0 || ret->len < limit); i++)
+		{
+			if (matrix != NULL)
+				{
+					/* the deny plane doesn't matter here */
+					allowed = (ZAK_AUTHO_MATRIX_ROW (matrix, snap->matrix_stride, role_idx, exclude_null, 0)[i >> 5] & (1u << (i & 31))) != 0;
+				}
+			else
+				{
+					allowed = (decisions[i] == ZAK_AUTHO_ALLOWED);
+				}
+
+			if (!allowed
+			    || (h != NULL && i != root_idx && !_zak_autho_hierarchy_is_ancestor (h, i, root_idx)))
+				{
+					continue;
+				}
+
+			if (offset > 0)
+				{
+					offset--;
+					continue;
+				}
+
+			handle = ZAK_AUTHO_HANDLE (snap->epoch, i);
+			g_array_append_val (ret, handle);
+		}
+
+	g_free (decisions);
+
+	_zak_autho_snapshot_leave (zak_autho, phase);
+
+	return ret;
+}
+
+static gint
+_zak_autho_rank_compare (gconstpointer a, gconstpointer b, gpointer user_data)
+{
+	guint32 *rank = (guint32 *)user_data;
+	guint32 rank_a = rank[*(guint32 *)a];
+	guint32 rank_b = rank[*(guint32 *)b];
+
+	return rank_a < rank_b ? -1 : (rank_a > rank_b ? 1 : 0);
+}
+
+static gint
+_zak_autho_idx_compare (gconstpointer a, gconstpointer b)
+{
+	guint32 idx_a = *(guint32 *)a;
+	guint32 idx_b = *(guint32 *)b;
+
+	return idx_a < idx_b ? -1 : (idx_a > idx_b ? 1 : 0);
+}
+
+/**
+ * zak_autho_get_roles_allowed_on:
+ * @zak_autho: an #ZakAutho object.
+ * @iresource: an #ZakAuthoIResource object.
+ * @exclude_null: whether or not to exclude roles allowed to every resource.
+ *
+ * Only the roles with a rule on @iresource, on one of its ancestors or
+ * on every resource, and the roles descending from them, are evaluated.
+ *
+ * Returns: (transfer container): a #GList of every #ZakAuthoIRole allowed
+ * to @iresource, in the order they were added; free it with g_list_free().
+ */
+GList
+*zak_autho_get_roles_allowed_on (ZakAutho *zak_autho, ZakAuthoIResource *iresource, gboolean exclude_null)
+{
+	GList *ret;
+
+	Snapshot *snap;
+	guint phase;
+	Hierarchy *roles_h;
+	Hierarchy *resources_h;
+	guint32 resource_idx;
+
+	GHashTable *visited; /* resources: idx + 1 */
+	GHashTable *decisions; /* roles: idx + 1 to ZakAuthoIsAllowed + 1 */
+	GArray *stack;
+	GArray *affected;
+	GArray *allowed;
+	GHashTableIter iter;
+	gpointer key;
+	ZakAuthoIsAllowed isAllowed;
+	guint32 node;
+	guint32 i;
+	guint32 k;
+
+	g_return_val_if_fail (IS_ZAK_AUTHO (zak_autho), NULL);
+	g_return_val_if_fail (ZAK_AUTHO_IS_IRESOURCE (iresource), NULL);
+
+	_zak_autho_check_updated (zak_autho);
+
+	ret = NULL;
+
+	snap = _zak_autho_snapshot_enter (zak_autho, &phase);
+
+	resource_idx = _zak_autho_snapshot_lookup (snap, FALSE, zak_autho_iresource_peek_resource_id (iresource));
+	if (resource_idx == G_MAXUINT32)
+		{
+			g_warning ("Resource «%s» not found.", zak_autho_iresource_peek_resource_id (iresource));
+			_zak_autho_snapshot_leave (zak_autho, phase);
+			return ret;
+		}
+
+	roles_h = &snap->roles_hierarchy;
+	resources_h = &snap->resources_hierarchy;
+
+	visited = g_hash_table_new (g_direct_hash, g_direct_equal);
+	decisions = g_hash_table_new (g_direct_hash, g_direct_equal);
+	stack = g_array_new (FALSE, FALSE, sizeof (guint32));
+
+	/* the roles with a rule on the resource or on its ancestors, from
+	 * the inverted index */
+	g_array_append_val (stack, resource_idx);
+	g_hash_table_add (visited, GUINT_TO_POINTER (resource_idx + 1));
+	while (stack->len > 0)
+		{
+			node = g_array_index (stack, guint32, stack->len - 1);
+			g_array_set_size (stack, stack->len - 1);
+
+			for (i = snap->roles_offset[node]; i < snap->roles_offset[node + 1]; i++)
+				{
+					g_hash_table_insert (decisions, GUINT_TO_POINTER (snap->roles_role[i] + 1), GUINT_TO_POINTER (ZAK_AUTHO_NOT_FOUND + 1));
+				}
+
+			for (i = resources_h->parents_offset[node]; i < resources_h->parents_offset[node + 1]; i++)
+				{
+					if (!g_hash_table_contains (visited, GUINT_TO_POINTER (resources_h->parents[i] + 1)))
+						{
+							g_hash_table_add (visited, GUINT_TO_POINTER (resources_h->parents[i] + 1));
+							g_array_append_val (stack, resources_h->parents[i]);
+						}
+				}
+		}
+	if (!exclude_null)
+		{
+			for (i = 0; i < snap->n_roles_null; i++)
+				{
+					g_hash_table_insert (decisions, GUINT_TO_POINTER (snap->roles_null[i] + 1), GUINT_TO_POINTER (ZAK_AUTHO_NOT_FOUND + 1));
+				}
+		}
+
+	/* their own decision, as the first step of _zak_autho_is_allowed_role */
+	g_hash_table_iter_init (&iter, decisions);
+	while (g_hash_table_iter_next (&iter, &key, NULL))
+		{
+			node = GPOINTER_TO_UINT (key) - 1;
+
+			isAllowed = ZAK_AUTHO_NOT_FOUND;
+			if (!exclude_null)
+				{
+					isAllowed = (ZakAuthoIsAllowed)snap->rules_null[node];
+				}
+			if (isAllowed == ZAK_AUTHO_NOT_FOUND)
+				{
+					isAllowed = _zak_autho_is_allowed_resource (snap, node, resource_idx);
+				}
+
+			g_hash_table_iter_replace (&iter, GUINT_TO_POINTER (isAllowed + 1));
+		}
+
+	/* only their descendants can inherit a decision */
+	affected = g_array_new (FALSE, FALSE, sizeof (guint32));
+	g_hash_table_iter_init (&iter, decisions);
+	while (g_hash_table_iter_next (&iter, &key, NULL))
+		{
+			node = GPOINTER_TO_UINT (key) - 1;
+			g_array_append_val (affected, node);
+		}
+	for (k = 0; k < affected->len; k++)
+		{
+			node = g_array_index (affected, guint32, k);
+			for (i = roles_h->children_offset[node]; i < roles_h->children_offset[node + 1]; i++)
+				{
+					if (!g_hash_table_contains (decisions, GUINT_TO_POINTER (roles_h->children[i] + 1)))
+						{
+							g_hash_table_insert (decisions, GUINT_TO_POINTER (roles_h->children[i] + 1), GUINT_TO_POINTER (ZAK_AUTHO_NOT_FOUND + 1));
+							g_array_append_val (affected, roles_h->children[i]);
+						}
+				}
+		}
+
+	/* parents first: a role without its own decision takes the one of
+	 * its first parent that has one */
+	g_array_sort_with_data (affected, _zak_autho_rank_compare, roles_h->rank);
+
+	allowed = g_array_new (FALSE, FALSE, sizeof (guint32));
+	for (k = 0; k < affected->len; k++)
+		{
+			node = g_array_index (affected, guint32, k);
+
+			isAllowed = (ZakAuthoIsAllowed)(GPOINTER_TO_UINT (g_hash_table_lookup (decisions, GUINT_TO_POINTER (node + 1))) - 1);
+			for (i = roles_h->parents_offset[node];
+			     isAllowed == ZAK_AUTHO_NOT_FOUND && i < roles_h->parents_offset[node + 1];
+			     i++)
+				{
+					/* a parent outside the affected roles has no decision */
+					isAllowed = (ZakAuthoIsAllowed)(GPOINTER_TO_UINT (g_hash_table_lookup (decisions, GUINT_TO_POINTER (roles_h->parents[i] + 1))));
+					isAllowed = isAllowed == 0 ? ZAK_AUTHO_NOT_FOUND : isAllowed - 1;
+				}
+			g_hash_table_insert (decisions, GUINT_TO_POINTER (node + 1), GUINT_TO_POINTER (isAllowed + 1));
+
+			if (isAllowed == ZAK_AUTHO_ALLOWED)
+				{
+					g_array_append_val (allowed, node);
+				}
+		}
+
+	g_array_sort (allowed, _zak_autho_idx_compare);
+	for (k = allowed->len; k > 0; k--)
+		{
+			ret = g_list_prepend (ret, _zak_autho_snapshot_get_irole (snap, g_array_index (allowed, guint32, k - 1)));
+		}
+
+	g_array_free (allowed, TRUE);
+	g_array_free (affected, TRUE);
+	g_array_free (stack, TRUE);
+	g_hash_table_destroy (decisions);
+	g_hash_table_destroy (visited);
+
+	_zak_autho_snapshot_leave (zak_autho, phase);
+
+	return ret;
+}
+
+static void
+_zak_autho_role_free (Role *role)
+{
+	g_list_free (role->parents);
+	g_free (role);
+}
+
+static void
+_zak_autho_resource_free (Resource *resource)
+{
+	g_list_free (resource->parents);
+	g_free (resource);
+}
+
+/**
+ * zak_autho_clear:
+ * @zak_autho:
+ *
+ */
+gboolean
+zak_autho_clear (ZakAutho *zak_autho)
+{
+	gboolean ret;
+
+	ZakAuthoPrivate *priv;
+
+	g_return_val_if_fail (IS_ZAK_AUTHO (zak_autho), FALSE);
+
+	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
+
+	g_rec_mutex_lock (&priv->mutex);
+
+	ret = TRUE;
+
+	if (priv->mapped_snapshot != NULL)
+		{
+			_zak_autho_snapshot_unref (priv->mapped_snapshot);
+			priv->mapped_snapshot = NULL;
+		}
+
+	g_hash_table_destroy (priv->rules);
+	g_hash_table_destroy (priv->roles);
+	g_hash_table_destroy (priv->resources);
+	g_ptr_array_free (priv->roles_idx, TRUE);
+	g_ptr_array_free (priv->resources_idx, TRUE);
+
+	priv->roles = g_hash_table_new (g_str_hash, g_str_equal);
+	priv->resources = g_hash_table_new (g_str_hash, g_str_equal);
+	priv->roles_idx = g_ptr_array_new_with_free_func ((GDestroyNotify)_zak_autho_role_free);
+	priv->resources_idx = g_ptr_array_new_with_free_func ((GDestroyNotify)_zak_autho_resource_free);
+	priv->rules = g_hash_table_new_full (g_int64_hash, g_int64_equal, NULL, g_free);
+
+	/* the indexes in the journal are gone */
+	_zak_autho_journal_reset (zak_autho, NULL, NULL);
+
+	priv->epoch++;
+	_zak_autho_policy_changed (zak_autho);
+
+	g_rec_mutex_unlock (&priv->mutex);
+
+	return ret;
+}
+
+/**
+ * zak_autho_get_xml:
+ * @zak_autho: an #ZakAutho object.
+ *
+ */
+xmlNodePtr
+zak_autho_get_xml (ZakAutho *zak_autho)
+{
+	ZakAuthoPrivate *priv;
+	xmlNodePtr ret;
+	xmlNodePtr xnode_parent;
+	xmlNodePtr xnode;
+
+	GHashTableIter iter;
+	gpointer key, value;
+
+	Role *role;
+	Resource *resource;
+	Rule *rule;
+
+	GList *parent;
+
+	g_return_val_if_fail (IS_ZAK_AUTHO (zak_autho), FALSE);
+
+	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
+
+	g_rec_mutex_lock (&priv->mutex);
+	_zak_autho_materialize (zak_autho);
+
+	ret = xmlNewNode (NULL, "zak_autho");
+
+	/* roles */
+	g_hash_table_iter_init (&iter, priv->roles);
+	while (g_hash_table_iter_next (&iter, &key, &value))
+		{
+			xnode_parent = xmlNewNode (NULL, "role");
+
+			role = (Role *)value;
+			xmlSetProp (xnode_parent, "id", zak_autho_irole_get_role_id (ZAK_AUTHO_IROLE (role->irole)));
+
+			xmlAddChild (ret, xnode_parent);
+
+			parent = role->parents;
+			while (parent != NULL)
+				{
+					xnode = xmlNewNode (NULL, "parent");
+
+					role = (Role *)parent->data;
+					xmlSetProp (xnode, "id", zak_autho_irole_get_role_id (ZAK_AUTHO_IROLE (role->irole)));
+
+					xmlAddChild (xnode_parent, xnode);
+
+					parent = g_list_next (parent);
+				}
+		}
+
+	/* resources */
+	g_hash_table_iter_init (&iter, priv->resources);
+	while (g_hash_table_iter_next (&iter, &key, &value))
+		{
+			xnode_parent = xmlNewNode (NULL, "resource");
+
+			resource = (Resource *)value;
+			xmlSetProp (xnode_parent, "id", zak_autho_iresource_get_resource_id (ZAK_AUTHO_IRESOURCE (resource->iresource)));
+
+			xmlAddChild (ret, xnode_parent);
+
+			parent = resource->parents;
+			while (parent != NULL)
+				{
+					xnode = xmlNewNode (NULL, "parent");
+
+					resource = (Resource *)parent->data;
+					xmlSetProp (xnode, "id", zak_autho_iresource_get_resource_id (ZAK_AUTHO_IRESOURCE (resource->iresource)));
+
+					xmlAddChild (xnode_parent, xnode);
+
+					parent = g_list_next (parent);
+				}
+		}
+
+	/* rules allow */
+	g_hash_table_iter_init (&iter, priv->rules);
+	while (g_hash_table_iter_next (&iter, &key, &value))
+		{
+			rule = (Rule *)value;
+			if (!(rule->type & ZAK_AUTHO_RULE_ALLOW))
+				{
+					continue;
+				}
+
+			xnode = xmlNewNode (NULL, "rule");
+
+			xmlSetProp (xnode, "allow", "yes");
+
+			xmlSetProp (xnode, "role", zak_autho_irole_get_role_id (ZAK_AUTHO_IROLE (rule->role->irole)));
+			if (rule->resource != NULL)
+				{
+					xmlSetProp (xnode, "resource", zak_autho_iresource_get_resource_id (ZAK_AUTHO_IRESOURCE (rule->resource->iresource)));
+				}
+			else
+				{
+					xmlSetProp (xnode, "resource", "");
+				}
+
+			xmlAddChild (ret, xnode);
+		}
+
+	/* rules deny */
+	g_hash_table_iter_init (&iter, priv->rules);
+	while (g_hash_table_iter_next (&iter, &key, &value))
+		{
+			rule = (Rule *)value;
+			if (!(rule->type & ZAK_AUTHO_RULE_DENY))
+				{
+					continue;
+				}
+
+			xnode = xmlNewNode (NULL, "rule");
+
+			xmlSetProp (xnode, "allow", "no");
+
+			xmlSetProp (xnode, "role", zak_autho_irole_get_role_id (ZAK_AUTHO_IROLE (rule->role->irole)));
+			if (rule->resource != NULL)
+				{
+					xmlSetProp (xnode, "resource", zak_autho_iresource_get_resource_id (ZAK_AUTHO_IRESOURCE (rule->resource->iresource)));
+				}
+			else
+				{
+					xmlSetProp (xnode, "resource", "all");
+				}
+
+			xmlAddChild (ret, xnode);
+		}
+
+	g_rec_mutex_unlock (&priv->mutex);
+
+	return ret;
+}
+
+typedef struct
+	{
+		GOutputStream *stream;
+		GError *error;
+	} XmlOutputStream;
+
+static int
+_zak_autho_xml_output_stream_write (void *context, const char *buffer, int len)
+{
+	XmlOutputStream *xml_stream;
+
+	xml_stream = (XmlOutputStream *)context;
+
+	if (!g_output_stream_write_all (xml_stream->stream, buffer, len, NULL, NULL,
+	                                xml_stream->error == NULL ? &xml_stream->error : NULL))
+		{
+			return -1;
+		}
+
+	return len;
+}
+
+static int
+_zak_autho_xml_output_stream_close (void *context)
+{
+	/* the stream belongs to the caller */
+	return 0;
+}
+
+static gboolean
+_zak_autho_write_xml_hierarchy (xmlTextWriterPtr writer, Snapshot *snap, gboolean roles)
+{
+	gboolean ret;
+	Hierarchy *h;
+	guint32 i;
+	guint32 j;
+	guint32 node;
+
+	h = roles ? &snap->roles_hierarchy : &snap->resources_hierarchy;
+
+	ret = TRUE;
+
+	/* parents first, so that every parent is known when it's read */
+	for (i = 0; ret && i < h->n; i++)
+		{
+			node = h->order[i];
+			ret = xmlTextWriterStartElement (writer, roles ? "role" : "resource") >= 0
+			      && xmlTextWriterWriteAttribute (writer, "id",
+			                                      roles ? _zak_autho_snapshot_peek_role_id (snap, node) : _zak_autho_snapshot_peek_resource_id (snap, node)) >= 0;
+			for (j = h->parents_offset[node]; ret && j < h->parents_offset[node + 1]; j++)
+				{
+					ret = xmlTextWriterStartElement (writer, "parent") >= 0
+					      && xmlTextWriterWriteAttribute (writer, "id",
+					                                      roles ? _zak_autho_snapshot_peek_role_id (snap, h->parents[j]) : _zak_autho_snapshot_peek_resource_id (snap, h->parents[j])) >= 0
+					      && xmlTextWriterEndElement (writer) >= 0;
+				}
+			ret = ret && xmlTextWriterEndElement (writer) >= 0;
+		}
+
+	return ret;
+}
+
+static gboolean
+_zak_autho_write_xml_rule (xmlTextWriterPtr writer, Snapshot *snap, ZakAuthoRuleType type, guint32 role_idx, const gchar *resource_id)
+{
+	return xmlTextWriterStartElement (writer, "rule") >= 0
+	       && xmlTextWriterWriteAttribute (writer, "allow", type == ZAK_AUTHO_RULE_ALLOW ? "yes" : "no") >= 0
+	       && xmlTextWriterWriteAttribute (writer, "role", _zak_autho_snapshot_peek_role_id (snap, role_idx)) >= 0
+	       && xmlTextWriterWriteAttribute (writer, "resource", resource_id) >= 0
+	       && xmlTextWriterEndElement (writer) >= 0;
+}
+
+static gboolean
+_zak_autho_write_xml_rules (xmlTextWriterPtr writer, Snapshot *snap, ZakAuthoRuleType type)
+{
+	gboolean ret;
+	guint32 i;
+	guint32 j;
+
+	ret = TRUE;
+	for (i = 0; ret && i < snap->roles_hierarchy.n; i++)
+		{
+			if (snap->rules_null_type[i] & type)
+				{
+					/* as zak_autho_get_xml() writes them */
+					ret = _zak_autho_write_xml_rule (writer, snap, type, i, type == ZAK_AUTHO_RULE_ALLOW ? "" : "all");
+				}
+			for (j = snap->rules_offset[i]; ret && j < snap->rules_offset[i + 1]; j++)
+				{
+					if (snap->rules_type[j] & type)
+						{
+							ret = _zak_autho_write_xml_rule (writer, snap, type, i,
+							                                 _zak_autho_snapshot_peek_resource_id (snap, snap->rules_resource[j]));
+						}
+				}
+		}
+
+	return ret;
+}
+
+/**
+ * zak_autho_write_xml:
+ * @zak_autho: an #ZakAutho object.
+ * @stream: the #GOutputStream to write to.
+ * @error: return location for a #GError, or NULL.
+ *
+ * Writes the same document of zak_autho_get_xml() to @stream, without
+ * building it in memory; roles and resources come before their children.
+ * The stream isn't closed.
+ *
+ * Returns: #TRUE on success.
+ */
+gboolean
+zak_autho_write_xml (ZakAutho *zak_autho, GOutputStream *stream, GError **error)
+{
+	gboolean ret;
+
+	ZakAuthoPrivate *priv;
+	Snapshot *snap;
+
+	XmlOutputStream xml_stream;
+	xmlOutputBufferPtr buffer;
+	xmlTextWriterPtr writer;
+
+	g_return_val_if_fail (IS_ZAK_AUTHO (zak_autho), FALSE);
+	g_return_val_if_fail (G_IS_OUTPUT_STREAM (stream), FALSE);
+
+	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
+
+	xml_stream.stream = stream;
+	xml_stream.error = NULL;
+
+	buffer = xmlOutputBufferCreateIO (_zak_autho_xml_output_stream_write, _zak_autho_xml_output_stream_close, &xml_stream, NULL);
+	writer = buffer == NULL ? NULL : xmlNewTextWriter (buffer);
+	if (writer == NULL)
+		{
+			if (buffer != NULL)
+				{
+					xmlOutputBufferClose (buffer);
+				}
+			g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED, "Unable to create the xml writer.");
+			return FALSE;
+		}
+
+	/* written from the snapshot, so the policy isn't locked meanwhile */
+	g_rec_mutex_lock (&priv->mutex);
+
+	_zak_autho_snapshot_publish (zak_autho);
+	snap = priv->snapshot;
+	g_atomic_int_inc (&snap->ref_count);
+
+	g_rec_mutex_unlock (&priv->mutex);
+
+	ret = xmlTextWriterStartDocument (writer, NULL, NULL, NULL) >= 0
+	      && xmlTextWriterStartElement (writer, "zak_autho") >= 0
+	      && _zak_autho_write_xml_hierarchy (writer, snap, TRUE)
+	      && _zak_autho_write_xml_hierarchy (writer, snap, FALSE)
+	      && _zak_autho_write_xml_rules (writer, snap, ZAK_AUTHO_RULE_ALLOW)
+	      && _zak_autho_write_xml_rules (writer, snap, ZAK_AUTHO_RULE_DENY)
+	      && xmlTextWriterEndDocument (writer) >= 0;
+
+	/* flushes what's left */
+	xmlFreeTextWriter (writer);
+
+	_zak_autho_snapshot_unref (snap);
+
+	if (xml_stream.error != NULL)
+		{
+			g_propagate_error (error, xml_stream.error);
+			ret = FALSE;
+		}
+	else if (!ret)
+		{
+			g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED, "Error on writing the xml.");
+		}
+
+	return ret;
+}
+
+/* the attribute @name of @xnode, stripped */
+static gchar
+*_zak_autho_xml_get_prop (xmlNodePtr xnode, const gchar *name)
+{
+	gchar *ret;
+	xmlChar *value;
+
+	value = xmlGetProp (xnode, (const xmlChar *)name);
+	ret = g_strstrip (g_strdup ((gchar *)value));
+	xmlFree (value);
+
+	return ret;
+}
+
+/**
+ * zak_autho_load_from_xml:
+ * @zak_autho: an #ZakAutho object.
+ * @xnode:
+ * @replace:
+ *
+ */
+gboolean
+zak_autho_load_from_xml (ZakAutho *zak_autho, xmlNodePtr xnode, gboolean replace)
+{
+	gboolean ret;
+
+	ZakAuthoPrivate *priv;
+
+	xmlNodePtr current;
+	xmlNodePtr current_parent;
+
+	ZakAuthoIRole *irole;
+	ZakAuthoIResource *iresource;
+	gchar *prop;
+
+	gboolean on_loading;
+
+	g_return_val_if_fail (IS_ZAK_AUTHO (zak_autho), FALSE);
+	g_return_val_if_fail (xnode != NULL, FALSE);
+
+	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
+
+	g_rec_mutex_lock (&priv->mutex);
+
+	ret = TRUE;
+
+	on_loading = priv->on_loading;
+	priv->on_loading = TRUE;
+
+	if (replace)
+		{
+			/* clearing current authorizations */
+			zak_autho_clear (zak_autho);
+		}
+	else
+		{
+			_zak_autho_materialize (zak_autho);
+		}
+
+	if (xmlStrcmp (xnode->name, "zak_autho") != 0)
+		{
+			g_warning ("Invalid xml structure.");
+			ret = FALSE;
+		}
+	else
+		{
+			current = xnode->children;
+			while (current != NULL)
+				{
+					if (!xmlNodeIsText (current))
+						{
+							if (xmlStrcmp (current->name, "role") == 0)
+								{
+									prop = _zak_autho_xml_get_prop (current, "id");
+									if (g_strcmp0 (prop, "") != 0)
+										{
+											irole = ZAK_AUTHO_IROLE (zak_autho_role_new (prop));
+											g_free (prop);
+											zak_autho_add_role (zak_autho, irole);
+
+											current_parent = current->children;
+											while (current_parent != NULL)
+												{
+													if (!xmlNodeIsText (current_parent) &&
+													    xmlStrcmp (current_parent->name, "parent") == 0)
+														{
+															prop = _zak_autho_xml_get_prop (current_parent, "id");
+															if (g_strcmp0 (prop, "") != 0)
+																{
+																	zak_autho_add_parent_to_role (zak_autho, irole,  zak_autho_get_role_from_id (zak_autho, prop));
+																}
+															g_free (prop);
+														}
+													current_parent = current_parent->next;
+												}
+										}
+								}
+							else if (xmlStrcmp (current->name, "resource") == 0)
+								{
+									prop = _zak_autho_xml_get_prop (current, "id");
+									if (g_strcmp0 (prop, "") != 0)
+										{
+											iresource = ZAK_AUTHO_IRESOURCE (zak_autho_resource_new (prop));
+											zak_autho_add_resource (zak_autho, iresource);
+											g_free (prop);
+
+											current_parent = current->children;
+											while (current_parent != NULL)
+												{
+													if (!xmlNodeIsText (current_parent) &&
+													    xmlStrcmp (current_parent->name, "parent") == 0)
+														{
+															prop = _zak_autho_xml_get_prop (current_parent, "id");
+															if (g_strcmp0 (prop, "") != 0)
+																{
+																	zak_autho_add_parent_to_resource (zak_autho, iresource, zak_autho_get_resource_from_id (zak_autho, prop));
+																}
+															g_free (prop);
+														}
+													current_parent = current_parent->next;
+												}
+										}
+								}
+							else if (xmlStrcmp (current->name, "rule") == 0)
+								{
+									prop = _zak_autho_xml_get_prop (current, "role");
+									irole = zak_autho_get_role_from_id (zak_autho, prop);
+									g_free (prop);
+									if (irole != NULL)
+										{
+											prop = _zak_autho_xml_get_prop (current, "resource");
+											if (g_strcmp0 (prop, "") == 0)
+												{
+													iresource = NULL;
+												}
+											else
+												{
+													iresource = zak_autho_get_resource_from_id (zak_autho, prop);
+												}
+											g_free (prop);
+
+											prop = _zak_autho_xml_get_prop (current, "allow");
+											if (g_strcmp0 (prop, "yes") == 0)
+												{
+													zak_autho_allow (zak_autho, irole, iresource);
+												}
+											else
+												{
+													zak_autho_deny (zak_autho, irole, iresource);
+												}
+											g_free (prop);
+										}
+								}
+						}
+
+					current = current->next;
+				}
+		}
+
+	_zak_autho_break_cycles (zak_autho, TRUE);
+	_zak_autho_break_cycles (zak_autho, FALSE);
+
+	priv->on_loading = on_loading;
+
+	_zak_autho_policy_changed (zak_autho);
+	if (!priv->on_loading)
+		{
+			_zak_autho_snapshot_publish (zak_autho);
+		}
+
+	g_rec_mutex_unlock (&priv->mutex);
+
+	return ret;
+}
+
+/* what of the stream loader waits for an entity defined later */
+typedef enum
+	{
+		ZAK_AUTHO_XML_PENDING_ROLE_PARENT,
+		ZAK_AUTHO_XML_PENDING_RESOURCE_PARENT,
+		ZAK_AUTHO_XML_PENDING_RULE
+	} ZakAuthoXmlPendingType;
+
+typedef struct
+	{
+		ZakAuthoXmlPendingType type;
+		gpointer child; /* ZakAuthoIRole or ZakAuthoIResource, for parents */
+		gchar *id; /* of the parent, or of the role of the rule */
+		gchar *resource_id; /* of the rule, NULL for every resource */
+		gboolean allow;
+	} XmlPending;
+
+typedef struct
+	{
+		GInputStream *stream;
+		GError *error;
+	} XmlStream;
+
+static int
+_zak_autho_xml_stream_read (void *context, char *buffer, int len)
+{
+	XmlStream *xml_stream;
+	gssize ret;
+
+	xml_stream = (XmlStream *)context;
+
+	ret = g_input_stream_read (xml_stream->stream, buffer, len, NULL,
+	                           xml_stream->error == NULL ? &xml_stream->error : NULL);
+
+	return ret < 0 ? -1 : (int)ret;
+}
+
+static int
+_zak_autho_xml_stream_close (void *context)
+{
+	/* the stream belongs to the caller */
+	return 0;
+}
+
+static void
+_zak_autho_xml_stream_error (void *arg, const char *msg, xmlParserSeverities severity, xmlTextReaderLocatorPtr locator)
+{
+	XmlStream *xml_stream;
+
+	xml_stream = (XmlStream *)arg;
+
+	if ((severity == XML_PARSER_SEVERITY_ERROR || severity == XML_PARSER_SEVERITY_VALIDITY_ERROR)
+	    && xml_stream->error == NULL)
+		{
+			xml_stream->error = g_error_new (G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+			                                 "Line %d: %s",
+			                                 xmlTextReaderLocatorLineNumber (locator),
+			                                 g_strstrip ((gchar *)msg));
+		}
+}
+
+/* the attribute @name of the current element, stripped; NULL if it's
+ * missing or empty */
+static gchar
+*_zak_autho_xml_reader_get_attribute (xmlTextReaderPtr reader, const gchar *name)
+{
+	gchar *ret;
+	xmlChar *value;
+
+	value = xmlTextReaderGetAttribute (reader, (const xmlChar *)name);
+	if (value == NULL)
+		{
+			return NULL;
+		}
+
+	ret = g_strstrip (g_strdup ((gchar *)value));
+	xmlFree (value);
+
+	if (ret[0] == '\0')
+		{
+			g_free (ret);
+			ret = NULL;
+		}
+
+	return ret;
+}
+
+/* applies @pending if what it refers to is known; with @last, what's
+ * still unknown is dropped */
+static gboolean
+_zak_autho_xml_pending_apply (ZakAutho *zak_autho, XmlPending *pending, gboolean last)
+{
+	ZakAuthoIRole *irole;
+	ZakAuthoIResource *iresource;
+
+	switch (pending->type)
+		{
+			case ZAK_AUTHO_XML_PENDING_ROLE_PARENT:
+				irole = zak_autho_get_role_from_id (zak_autho, pending->id);
+				if (irole != NULL)
+					{
+						zak_autho_add_parent_to_role (zak_autho, (ZakAuthoIRole *)pending->child, irole);
+						return TRUE;
+					}
+				if (last)
+					{
+						g_warning ("Parent role «%s» of «%s» not found.", pending->id,
+						           zak_autho_irole_get_role_id ((ZakAuthoIRole *)pending->child));
+					}
+				break;
+
+			case ZAK_AUTHO_XML_PENDING_RESOURCE_PARENT:
+				iresource = zak_autho_get_resource_from_id (zak_autho, pending->id);
+				if (iresource != NULL)
+					{
+						zak_autho_add_parent_to_resource (zak_autho, (ZakAuthoIResource *)pending->child, iresource);
+						return TRUE;
+					}
+				if (last)
+					{
+						g_warning ("Parent resource «%s» of «%s» not found.", pending->id,
+						           zak_autho_iresource_get_resource_id ((ZakAuthoIResource *)pending->child));
+					}
+				break;
+
+			case ZAK_AUTHO_XML_PENDING_RULE:
+				irole = zak_autho_get_role_from_id (zak_autho, pending->id);
+				iresource = pending->resource_id == NULL ? NULL : zak_autho_get_resource_from_id (zak_autho, pending->resource_id);
+				if (irole != NULL
+				    && (pending->resource_id == NULL || iresource != NULL
+				        /* as written by zak_autho_get_xml() */
+				        || g_strcmp0 (pending->resource_id, "all") == 0))
+					{
+						if (pending->allow)
+							{
+								zak_autho_allow (zak_autho, irole, iresource);
+							}
+						else
+							{
+								zak_autho_deny (zak_autho, irole, iresource);
+							}
+						return TRUE;
+					}
+				if (last)
+					{
+						g_warning ("Rule of role «%s» on resource «%s» refers to an unknown %s.",
+						           pending->id,
+						           pending->resource_id == NULL ? "all" : pending->resource_id,
+						           irole == NULL ? "role" : "resource");
+					}
+				break;
+		}
+
+	return FALSE;
+}
+
+static void
+_zak_autho_xml_pending_clear (XmlPending *pending)
+{
+	g_free (pending->id);
+	g_free (pending->resource_id);
+}
+
+/* a role, resource or parent element at the current position of @reader */
+static void
+_zak_autho_xml_reader_element (ZakAutho *zak_autho, xmlTextReaderPtr reader, gpointer *current, gboolean *current_is_role, gboolean *current_pending, GArray *pendings)
+{
+	const xmlChar *name;
+	gint depth;
+	XmlPending pending;
+	gchar *id;
+	gchar *allow;
+
+	name = xmlTextReaderConstLocalName (reader);
+	depth = xmlTextReaderDepth (reader);
+
+	if (depth == 1)
+		{
+			*current = NULL;
+			*current_pending = FALSE;
+			if (xmlStrcmp (name, (const xmlChar *)"role") == 0)
+				{
+					id = _zak_autho_xml_reader_get_attribute (reader, "id");
+					if (id != NULL)
+						{
+							*current = zak_autho_role_new (id);
+							*current_is_role = TRUE;
+							zak_autho_add_role (zak_autho, ZAK_AUTHO_IROLE (*current));
+							g_free (id);
+						}
+				}
+			else if (xmlStrcmp (name, (const xmlChar *)"resource") == 0)
+				{
+					id = _zak_autho_xml_reader_get_attribute (reader, "id");
+					if (id != NULL)
+						{
+							*current = zak_autho_resource_new (id);
+							*current_is_role = FALSE;
+							zak_autho_add_resource (zak_autho, ZAK_AUTHO_IRESOURCE (*current));
+							g_free (id);
+						}
+				}
+			else if (xmlStrcmp (name, (const xmlChar *)"rule") == 0)
+				{
+					pending.type = ZAK_AUTHO_XML_PENDING_RULE;
+					pending.child = NULL;
+					pending.id = _zak_autho_xml_reader_get_attribute (reader, "role");
+					pending.resource_id = _zak_autho_xml_reader_get_attribute (reader, "resource");
+					allow = _zak_autho_xml_reader_get_attribute (reader, "allow");
+					pending.allow = g_strcmp0 (allow, "yes") == 0;
+					g_free (allow);
+
+					if (pending.id == NULL
+					    || _zak_autho_xml_pending_apply (zak_autho, &pending, FALSE))
+						{
+							_zak_autho_xml_pending_clear (&pending);
+						}
+					else
+						{
+							g_array_append_val (pendings, pending);
+						}
+				}
+		}
+	else if (depth == 2
+	         && *current != NULL
+	         && xmlStrcmp (name, (const xmlChar *)"parent") == 0)
+		{
+			pending.type = *current_is_role ? ZAK_AUTHO_XML_PENDING_ROLE_PARENT : ZAK_AUTHO_XML_PENDING_RESOURCE_PARENT;
+			pending.child = *current;
+			pending.id = _zak_autho_xml_reader_get_attribute (reader, "id");
+			pending.resource_id = NULL;
+
+			/* once one waits, the following ones wait too: the order
+			 * of the parents counts */
+			if (pending.id == NULL
+			    || (!*current_pending && _zak_autho_xml_pending_apply (zak_autho, &pending, FALSE)))
+				{
+					_zak_autho_xml_pending_clear (&pending);
+				}
+			else
+				{
+					*current_pending = TRUE;
+					g_array_append_val (pendings, pending);
+				}
+		}
+}
+
+/**
+ * zak_autho_load_from_xml_stream:
+ * @zak_autho: an #ZakAutho object.
+ * @stream: a #GInputStream with the xml of zak_autho_get_xml().
+ * @replace:
+ * @error: return location for a #GError, or NULL.
+ *
+ * Like zak_autho_load_from_xml(), but reads @stream element by element
+ * without building the document tree. Parents and rules may refer to
+ * roles and resources defined later in the stream; the ones still
+ * unknown at the end are skipped with a warning. On error what was read
+ * up to that point stays loaded.
+ *
+ * Returns: #TRUE on success.
+ */
+gboolean
+zak_autho_load_from_xml_stream (ZakAutho *zak_autho, GInputStream *stream, gboolean replace, GError **error)
+{
+	gboolean ret;
+
+	ZakAuthoPrivate *priv;
+
+	XmlStream xml_stream;
+	xmlTextReaderPtr reader;
+	gint read;
+	gboolean root;
+
+	gpointer current;
+	gboolean current_is_role;
+	gboolean current_pending;
+	GArray *pendings;
+	XmlPending *pending;
+	guint i;
+
+	gboolean on_loading;
+
+	g_return_val_if_fail (IS_ZAK_AUTHO (zak_autho), FALSE);
+	g_return_val_if_fail (G_IS_INPUT_STREAM (stream), FALSE);
+
+	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
+
+	xml_stream.stream = stream;
+	xml_stream.error = NULL;
+
+	reader = xmlReaderForIO (_zak_autho_xml_stream_read, _zak_autho_xml_stream_close, &xml_stream,
+	                         NULL, NULL, XML_PARSE_NONET | XML_PARSE_NOBLANKS);
+	if (reader == NULL)
+		{
+			g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED, "Unable to create the xml reader.");
+			return FALSE;
+		}
+	xmlTextReaderSetErrorHandler (reader, _zak_autho_xml_stream_error, &xml_stream);
+
+	g_rec_mutex_lock (&priv->mutex);
+
+	on_loading = priv->on_loading;
+	priv->on_loading = TRUE;
+
+	if (replace)
+		{
+			/* clearing current authorizations */
+			zak_autho_clear (zak_autho);
+		}
+	else
+		{
+			_zak_autho_materialize (zak_autho);
+		}
+
+	pendings = g_array_new (FALSE, FALSE, sizeof (XmlPending));
+	current = NULL;
+	current_is_role = FALSE;
+	current_pending = FALSE;
+	root = FALSE;
+
+	while ((read = xmlTextReaderRead (reader)) == 1)
+		{
+			if (xmlTextReaderNodeType (reader) != XML_READER_TYPE_ELEMENT)
+				{
+					continue;
+				}
+
+			if (!root)
+				{
+					if (xmlStrcmp (xmlTextReaderConstLocalName (reader), (const xmlChar *)"zak_autho") != 0)
+						{
+							break;
+						}
+					root = TRUE;
+				}
+			else
+				{
+					_zak_autho_xml_reader_element (zak_autho, reader, &current, &current_is_role, &current_pending, pendings);
+				}
+		}
+
+	ret = read == 0 && root && xml_stream.error == NULL;
+	if (xml_stream.error != NULL)
+		{
+			g_propagate_error (error, xml_stream.error);
+		}
+	else if (!root)
+		{
+			g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Invalid xml structure.");
+		}
+	else if (read != 0)
+		{
+			g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Invalid xml.");
+		}
+
+	xmlFreeTextReader (reader);
+
+	/* the forward references, in document order */
+	for (i = 0; i < pendings->len; i++)
+		{
+			pending = &g_array_index (pendings, XmlPending, i);
+			_zak_autho_xml_pending_apply (zak_autho, pending, TRUE);
+			_zak_autho_xml_pending_clear (pending);
+		}
+	g_array_free (pendings, TRUE);
+
+	_zak_autho_break_cycles (zak_autho, TRUE);
+	_zak_autho_break_cycles (zak_autho, FALSE);
+
+	priv->on_loading = on_loading;
+
+	_zak_autho_policy_changed (zak_autho);
+	if (!priv->on_loading)
+		{
+			_zak_autho_snapshot_publish (zak_autho);
+		}
+
+	g_rec_mutex_unlock (&priv->mutex);
+
+	return ret;
+}
+
+/* snapshot files: a header, then the arrays of a Snapshot as they are in
+ * memory, every one starting on a multiple of 8 bytes from the start of
+ * the file; the byte order is the one of the machine that wrote it */
+#define ZAK_AUTHO_SNAPSHOT_MAGIC "ZAKAUTHO"
+#define ZAK_AUTHO_SNAPSHOT_VERSION 1
+#define ZAK_AUTHO_SNAPSHOT_BYTE_ORDER 0x01020304
+#define ZAK_AUTHO_SNAPSHOT_NO_STRING G_MAXUINT32
+
+/* FNV-1a over 64 bit words */
+#define ZAK_AUTHO_SNAPSHOT_CHECKSUM_INIT G_GUINT64_CONSTANT (0xcbf29ce484222325)
+#define ZAK_AUTHO_SNAPSHOT_CHECKSUM_PRIME G_GUINT64_CONSTANT (0x100000001b3)
+
+/* the arrays of a Hierarchy, in this order */
+enum
+	{
+		ZAK_AUTHO_SECTION_PARENTS_OFFSET,
+		ZAK_AUTHO_SECTION_PARENTS,
+		ZAK_AUTHO_SECTION_ORDER,
+		ZAK_AUTHO_SECTION_RANK,
+		ZAK_AUTHO_SECTION_CHILDREN_OFFSET,
+		ZAK_AUTHO_SECTION_CHILDREN,
+		ZAK_AUTHO_SECTION_PRE,
+		ZAK_AUTHO_SECTION_POST,
+		ZAK_AUTHO_SECTION_MULTI,
+		ZAK_AUTHO_HIERARCHY_SECTIONS
+	};
+
+enum
+	{
+		ZAK_AUTHO_SECTION_STRINGS,
+		ZAK_AUTHO_SECTION_ROLE_IDS,
+		ZAK_AUTHO_SECTION_ROLES_SORTED,
+		ZAK_AUTHO_SECTION_RESOURCE_IDS,
+		ZAK_AUTHO_SECTION_RESOURCES_SORTED,
+		ZAK_AUTHO_SECTION_ROLES_HIERARCHY,
+		ZAK_AUTHO_SECTION_RESOURCES_HIERARCHY = ZAK_AUTHO_SECTION_ROLES_HIERARCHY + ZAK_AUTHO_HIERARCHY_SECTIONS,
+		ZAK_AUTHO_SECTION_RULES_OFFSET = ZAK_AUTHO_SECTION_RESOURCES_HIERARCHY + ZAK_AUTHO_HIERARCHY_SECTIONS,
+		ZAK_AUTHO_SECTION_RULES_RESOURCE,
+		ZAK_AUTHO_SECTION_RULES_DECISION,
+		ZAK_AUTHO_SECTION_RULES_TYPE,
+		ZAK_AUTHO_SECTION_RULES_NULL,
+		ZAK_AUTHO_SECTION_RULES_NULL_TYPE,
+		ZAK_AUTHO_SECTION_ROLES_OFFSET,
+		ZAK_AUTHO_SECTION_ROLES_ROLE,
+		ZAK_AUTHO_SECTION_ROLES_NULL,
+		ZAK_AUTHO_SECTIONS
+	};
+
+typedef struct _SnapshotHeader SnapshotHeader;
+struct _SnapshotHeader
+	{
+		gchar magic[8];
+		guint32 byte_order;
+		guint32 version;
+		guint64 size; /* of the whole file */
+		guint64 checksum; /* of everything after the header */
+		guint32 n_roles;
+		guint32 n_resources;
+		guint32 n_rules; /* on specific resources */
+		guint32 role_name_prefix; /* offset in the strings, or ZAK_AUTHO_SNAPSHOT_NO_STRING */
+		guint32 resource_name_prefix;
+		guint32 reserved;
+		guint64 offset[ZAK_AUTHO_SECTIONS];
+		guint64 length[ZAK_AUTHO_SECTIONS]; /* in bytes, without the padding */
+	};
+
+/* @size bytes of @data, as if followed by zeros up to a multiple of 8 */
+static guint64
+_zak_autho_snapshot_checksum (guint64 checksum, const guint8 *data, gsize size)
+{
+	guint64 word;
+	gsize i;
+
+	for (i = 0; i + 8 <= size; i += 8)
+		{
+			memcpy (&word, data + i, 8);
+			checksum = (checksum ^ word) * ZAK_AUTHO_SNAPSHOT_CHECKSUM_PRIME;
+		}
+	if (i < size)
+		{
+			word = 0;
+			memcpy (&word, data + i, size - i);
+			checksum = (checksum ^ word) * ZAK_AUTHO_SNAPSHOT_CHECKSUM_PRIME;
+		}
+
+	return checksum;
+}
+
+static void
+_zak_autho_snapshot_hierarchy_sections (Hierarchy *h, gconstpointer *data, guint64 *length)
+{
+	guint32 n_parents;
+
+	n_parents = h->parents_offset[h->n];
+
+	data[ZAK_AUTHO_SECTION_PARENTS_OFFSET] = h->parents_offset;
+	length[ZAK_AUTHO_SECTION_PARENTS_OFFSET] = sizeof (guint32) * (h->n + 1);
+	data[ZAK_AUTHO_SECTION_PARENTS] = h->parents;
+	length[ZAK_AUTHO_SECTION_PARENTS] = sizeof (guint32) * n_parents;
+	data[ZAK_AUTHO_SECTION_ORDER] = h->order;
+	length[ZAK_AUTHO_SECTION_ORDER] = sizeof (guint32) * h->n;
+	data[ZAK_AUTHO_SECTION_RANK] = h->rank;
+	length[ZAK_AUTHO_SECTION_RANK] = sizeof (guint32) * h->n;
+	data[ZAK_AUTHO_SECTION_CHILDREN_OFFSET] = h->children_offset;
+	length[ZAK_AUTHO_SECTION_CHILDREN_OFFSET] = sizeof (guint32) * (h->n + 1);
+	data[ZAK_AUTHO_SECTION_CHILDREN] = h->children;
+	length[ZAK_AUTHO_SECTION_CHILDREN] = sizeof (guint32) * n_parents;
+	data[ZAK_AUTHO_SECTION_PRE] = h->pre;
+	length[ZAK_AUTHO_SECTION_PRE] = sizeof (guint32) * h->n;
+	data[ZAK_AUTHO_SECTION_POST] = h->post;
+	length[ZAK_AUTHO_SECTION_POST] = sizeof (guint32) * h->n;
+	data[ZAK_AUTHO_SECTION_MULTI] = h->multi;
+	length[ZAK_AUTHO_SECTION_MULTI] = h->n;
+}
+
+typedef struct
+	{
+		const gchar *strings;
+		const guint32 *ids;
+	} SnapshotIds;
+
+static gint
+_zak_autho_snapshot_id_compare (gconstpointer a, gconstpointer b, gpointer user_data)
+{
+	SnapshotIds *ids = (SnapshotIds *)user_data;
+
+	return strcmp (ids->strings + ids->ids[*(const guint32 *)a],
+	               ids->strings + ids->ids[*(const guint32 *)b]);
+}
+
+static gboolean
+_zak_autho_snapshot_write (Snapshot *snap, const gchar *filename)
+{
+	gboolean ret;
+
+	SnapshotHeader header;
+	gconstpointer data[ZAK_AUTHO_SECTIONS];
+	guint64 length[ZAK_AUTHO_SECTIONS];
+	guint64 offset;
+	guint64 checksum;
+	static const guint8 zeros[8] = { 0 };
+	gsize pad;
+
+	GString *strings;
+	guint32 *role_ids;
+	guint32 *roles_sorted;
+	guint32 *resource_ids;
+	guint32 *resources_sorted;
+	SnapshotIds ids;
+	const gchar *id;
+	guint32 n_roles;
+	guint32 n_resources;
+	guint32 i;
+
+	gchar *tmp_filename;
+	FILE *f;
+
+	n_roles = snap->roles_hierarchy.n;
+	n_resources = snap->resources_hierarchy.n;
+
+	memset (&header, 0, sizeof (SnapshotHeader));
+	memcpy (header.magic, ZAK_AUTHO_SNAPSHOT_MAGIC, 8);
+	header.byte_order = ZAK_AUTHO_SNAPSHOT_BYTE_ORDER;
+	header.version = ZAK_AUTHO_SNAPSHOT_VERSION;
+	header.n_roles = n_roles;
+	header.n_resources = n_resources;
+	header.n_rules = snap->rules_offset[n_roles];
+
+	/* every id, and the prefixes, in one string table */
+	strings = g_string_new (NULL);
+	role_ids = g_new (guint32, n_roles + 1);
+	for (i = 0; i < n_roles; i++)
+		{
+			id = _zak_autho_snapshot_peek_role_id (snap, i);
+			role_ids[i] = strings->len;
+			g_string_append_len (strings, id, strlen (id) + 1);
+		}
+	resource_ids = g_new (guint32, n_resources + 1);
+	for (i = 0; i < n_resources; i++)
+		{
+			id = _zak_autho_snapshot_peek_resource_id (snap, i);
+			resource_ids[i] = strings->len;
+			g_string_append_len (strings, id, strlen (id) + 1);
+		}
+	header.role_name_prefix = ZAK_AUTHO_SNAPSHOT_NO_STRING;
+	if (snap->role_name_prefix != NULL)
+		{
+			header.role_name_prefix = strings->len;
+			g_string_append_len (strings, snap->role_name_prefix, snap->role_name_prefix_len + 1);
+		}
+	header.resource_name_prefix = ZAK_AUTHO_SNAPSHOT_NO_STRING;
+	if (snap->resource_name_prefix != NULL)
+		{
+			header.resource_name_prefix = strings->len;
+			g_string_append_len (strings, snap->resource_name_prefix, snap->resource_name_prefix_len + 1);
+		}
+	if (strings->len == 0)
+		{
+			g_string_append_len (strings, "", 1);
+		}
+
+	/* the indexes by id, for the lookups */
+	ids.strings = strings->str;
+	ids.ids = role_ids;
+	roles_sorted = g_new (guint32, n_roles + 1);
+	for (i = 0; i < n_roles; i++)
+		{
+			roles_sorted[i] = i;
+		}
+	g_qsort_with_data (roles_sorted, n_roles, sizeof (guint32), _zak_autho_snapshot_id_compare, &ids);
+	ids.ids = resource_ids;
+	resources_sorted = g_new (guint32, n_resources + 1);
+	for (i = 0; i < n_resources; i++)
+		{
+			resources_sorted[i] = i;
+		}
+	g_qsort_with_data (resources_sorted, n_resources, sizeof (guint32), _zak_autho_snapshot_id_compare, &ids);
+
+	data[ZAK_AUTHO_SECTION_STRINGS] = strings->str;
+	length[ZAK_AUTHO_SECTION_STRINGS] = strings->len;
+	data[ZAK_AUTHO_SECTION_ROLE_IDS] = role_ids;
+	length[ZAK_AUTHO_SECTION_ROLE_IDS] = sizeof (guint32) * n_roles;
+	data[ZAK_AUTHO_SECTION_ROLES_SORTED] = roles_sorted;
+	length[ZAK_AUTHO_SECTION_ROLES_SORTED] = sizeof (guint32) * n_roles;
+	data[ZAK_AUTHO_SECTION_RESOURCE_IDS] = resource_ids;
+	length[ZAK_AUTHO_SECTION_RESOURCE_IDS] = sizeof (guint32) * n_resources;
+	data[ZAK_AUTHO_SECTION_RESOURCES_SORTED] = resources_sorted;
+	length[ZAK_AUTHO_SECTION_RESOURCES_SORTED] = sizeof (guint32) * n_resources;
+
+	_zak_autho_snapshot_hierarchy_sections (&snap->roles_hierarchy,
+	                                        data + ZAK_AUTHO_SECTION_ROLES_HIERARCHY,
+	                                        length + ZAK_AUTHO_SECTION_ROLES_HIERARCHY);
+	_zak_autho_snapshot_hierarchy_sections (&snap->resources_hierarchy,
+	                                        data + ZAK_AUTHO_SECTION_RESOURCES_HIERARCHY,
+	                                        length + ZAK_AUTHO_SECTION_RESOURCES_HIERARCHY);
+
+	data[ZAK_AUTHO_SECTION_RULES_OFFSET] = snap->rules_offset;
+	length[ZAK_AUTHO_SECTION_RULES_OFFSET] = sizeof (guint32) * (n_roles + 1);
+	data[ZAK_AUTHO_SECTION_RULES_RESOURCE] = snap->rules_resource;
+	length[ZAK_AUTHO_SECTION_RULES_RESOURCE] = sizeof (guint32) * header.n_rules;
+	data[ZAK_AUTHO_SECTION_RULES_DECISION] = snap->rules_decision;
+	length[ZAK_AUTHO_SECTION_RULES_DECISION] = header.n_rules;
+	data[ZAK_AUTHO_SECTION_RULES_TYPE] = snap->rules_type;
+	length[ZAK_AUTHO_SECTION_RULES_TYPE] = header.n_rules;
+	data[ZAK_AUTHO_SECTION_RULES_NULL] = snap->rules_null;
+	length[ZAK_AUTHO_SECTION_RULES_NULL] = n_roles;
+	data[ZAK_AUTHO_SECTION_RULES_NULL_TYPE] = snap->rules_null_type;
+	length[ZAK_AUTHO_SECTION_RULES_NULL_TYPE] = n_roles;
+	data[ZAK_AUTHO_SECTION_ROLES_OFFSET] = snap->roles_offset;
+	length[ZAK_AUTHO_SECTION_ROLES_OFFSET] = sizeof (guint32) * (n_resources + 1);
+	data[ZAK_AUTHO_SECTION_ROLES_ROLE] = snap->roles_role;
+	length[ZAK_AUTHO_SECTION_ROLES_ROLE] = sizeof (guint32) * header.n_rules;
+	data[ZAK_AUTHO_SECTION_ROLES_NULL] = snap->roles_null;
+	length[ZAK_AUTHO_SECTION_ROLES_NULL] = sizeof (guint32) * snap->n_roles_null;
+
+	/* written aside and renamed, so that who has the old file mapped
+	 * keeps reading it */
+	tmp_filename = g_strdup_printf ("%s.tmp", filename);
+	f = g_fopen (tmp_filename, "wb");
+	if (f == NULL)
+		{
+			g_warning ("Unable to create «%s»: %s", tmp_filename, g_strerror (errno));
+			ret = FALSE;
+		}
+	else
+		{
+			ret = fwrite (&header, sizeof (SnapshotHeader), 1, f) == 1;
+
+			offset = sizeof (SnapshotHeader);
+			checksum = ZAK_AUTHO_SNAPSHOT_CHECKSUM_INIT;
+			for (i = 0; ret && i < ZAK_AUTHO_SECTIONS; i++)
+				{
+					pad = (8 - length[i] % 8) % 8;
+
+					header.offset[i] = offset;
+					header.length[i] = length[i];
+					ret = (length[i] == 0 || fwrite (data[i], length[i], 1, f) == 1)
+					      && (pad == 0 || fwrite (zeros, pad, 1, f) == 1);
+
+					checksum = _zak_autho_snapshot_checksum (checksum, data[i], length[i]);
+					offset += length[i] + pad;
+				}
+
+			header.size = offset;
+			header.checksum = checksum;
+			ret = ret
+			      && fseek (f, 0, SEEK_SET) == 0
+			      && fwrite (&header, sizeof (SnapshotHeader), 1, f) == 1;
+			ret = fclose (f) == 0 && ret;
+
+			if (!ret)
+				{
+					g_warning ("Error on writing «%s»: %s", tmp_filename, g_strerror (errno));
+				}
+			else if (g_rename (tmp_filename, filename) != 0)
+				{
+					g_warning ("Unable to rename «%s» to «%s»: %s", tmp_filename, filename, g_strerror (errno));
+					ret = FALSE;
+				}
+			if (!ret)
+				{
+					g_remove (tmp_filename);
+				}
+		}
+
+	g_free (tmp_filename);
+	g_string_free (strings, TRUE);
+	g_free (role_ids);
+	g_free (roles_sorted);
+	g_free (resource_ids);
+	g_free (resources_sorted);
+
+	return ret;
+}
+
+/* @offset goes from 0 to @total without ever decreasing */
+static gboolean
+_zak_autho_snapshot_check_offsets (const guint32 *offset, guint32 n, guint32 total)
+{
+	guint32 i;
+
+	if (offset[0] != 0 || offset[n] != total)
+		{
+			return FALSE;
+		}
+	for (i = 0; i < n; i++)
+		{
+			if (offset[i] > offset[i + 1])
+				{
+					return FALSE;
+				}
+		}
+
+	return TRUE;
+}
+
+/* every one of the @n @values is less than @limit */
+static gboolean
+_zak_autho_snapshot_check_range (const guint32 *values, guint64 n, guint64 limit)
+{
+	guint64 i;
+
+	for (i = 0; i < n; i++)
+		{
+			if (values[i] >= limit)
+				{
+					return FALSE;
+				}
+		}
+
+	return TRUE;
+}
+
+/* the arrays of a hierarchy point inside it, and the parents come before
+ * their children in the topological order, so there are no cycles to
+ * walk forever; pre and post are only compared to each other */
+static gboolean
+_zak_autho_snapshot_check_hierarchy (const SnapshotHeader *header, const gchar *contents, guint32 first, guint32 n)
+{
+	const guint32 *parents_offset;
+	const guint32 *parents;
+	const guint32 *order;
+	const guint32 *rank;
+	const guint32 *children_offset;
+	const guint32 *children;
+	guint32 n_edges;
+	guint32 i;
+	guint32 j;
+
+	parents_offset = (const guint32 *)(contents + header->offset[first + ZAK_AUTHO_SECTION_PARENTS_OFFSET]);
+	parents = (const guint32 *)(contents + header->offset[first + ZAK_AUTHO_SECTION_PARENTS]);
+	order = (const guint32 *)(contents + header->offset[first + ZAK_AUTHO_SECTION_ORDER]);
+	rank = (const guint32 *)(contents + header->offset[first + ZAK_AUTHO_SECTION_RANK]);
+	children_offset = (const guint32 *)(contents + header->offset[first + ZAK_AUTHO_SECTION_CHILDREN_OFFSET]);
+	children = (const guint32 *)(contents + header->offset[first + ZAK_AUTHO_SECTION_CHILDREN]);
+	n_edges = header->length[first + ZAK_AUTHO_SECTION_PARENTS] / sizeof (guint32);
+
+	if (!_zak_autho_snapshot_check_offsets (parents_offset, n, n_edges)
+	    || !_zak_autho_snapshot_check_offsets (children_offset, n, n_edges)
+	    || !_zak_autho_snapshot_check_range (parents, n_edges, n)
+	    || !_zak_autho_snapshot_check_range (children, n_edges, n)
+	    || !_zak_autho_snapshot_check_range (order, n, n)
+	    || !_zak_autho_snapshot_check_range (rank, n, n))
+		{
+			return FALSE;
+		}
+
+	for (i = 0; i < n; i++)
+		{
+			/* so order is a permutation */
+			if (rank[order[i]] != i)
+				{
+					return FALSE;
+				}
+			for (j = parents_offset[i]; j < parents_offset[i + 1]; j++)
+				{
+					if (rank[parents[j]] >= rank[i])
+						{
+							return FALSE;
+						}
+				}
+			for (j = children_offset[i]; j < children_offset[i + 1]; j++)
+				{
+					if (rank[children[j]] <= rank[i])
+						{
+							return FALSE;
+						}
+				}
+		}
+
+	return TRUE;
+}
+
+/* every value read as an index is in range */
+static gboolean
+_zak_autho_snapshot_check_values (const SnapshotHeader *header, const gchar *contents)
+{
+	const guint32 *rules_offset;
+	const guint32 *rules_resource;
+	const guint8 *decisions;
+	guint64 n_strings;
+	guint32 i;
+	guint32 j;
+
+	n_strings = header->length[ZAK_AUTHO_SECTION_STRINGS];
+	if (!_zak_autho_snapshot_check_range ((const guint32 *)(contents + header->offset[ZAK_AUTHO_SECTION_ROLE_IDS]), header->n_roles, n_strings)
+	    || !_zak_autho_snapshot_check_range ((const guint32 *)(contents + header->offset[ZAK_AUTHO_SECTION_RESOURCE_IDS]), header->n_resources, n_strings)
+	    || !_zak_autho_snapshot_check_range ((const guint32 *)(contents + header->offset[ZAK_AUTHO_SECTION_ROLES_SORTED]), header->n_roles, header->n_roles)
+	    || !_zak_autho_snapshot_check_range ((const guint32 *)(contents + header->offset[ZAK_AUTHO_SECTION_RESOURCES_SORTED]), header->n_resources, header->n_resources))
+		{
+			return FALSE;
+		}
+
+	if (!_zak_autho_snapshot_check_hierarchy (header, contents, ZAK_AUTHO_SECTION_ROLES_HIERARCHY, header->n_roles)
+	    || !_zak_autho_snapshot_check_hierarchy (header, contents, ZAK_AUTHO_SECTION_RESOURCES_HIERARCHY, header->n_resources))
+		{
+			return FALSE;
+		}
+
+	/* the rules of every role, by resource as the lookups expect */
+	rules_offset = (const guint32 *)(contents + header->offset[ZAK_AUTHO_SECTION_RULES_OFFSET]);
+	rules_resource = (const guint32 *)(contents + header->offset[ZAK_AUTHO_SECTION_RULES_RESOURCE]);
+	if (!_zak_autho_snapshot_check_offsets (rules_offset, header->n_roles, header->n_rules)
+	    || !_zak_autho_snapshot_check_range (rules_resource, header->n_rules, header->n_resources))
+		{
+			return FALSE;
+		}
+	for (i = 0; i < header->n_roles; i++)
+		{
+			for (j = rules_offset[i] + 1; j < rules_offset[i + 1]; j++)
+				{
+					if (rules_resource[j - 1] >= rules_resource[j])
+						{
+							return FALSE;
+						}
+				}
+		}
+
+	decisions = (const guint8 *)(contents + header->offset[ZAK_AUTHO_SECTION_RULES_DECISION]);
+	for (i = 0; i < header->n_rules; i++)
+		{
+			if (decisions[i] > ZAK_AUTHO_NOT_FOUND)
+				{
+					return FALSE;
+				}
+		}
+	decisions = (const guint8 *)(contents + header->offset[ZAK_AUTHO_SECTION_RULES_NULL]);
+	for (i = 0; i < header->n_roles; i++)
+		{
+			if (decisions[i] > ZAK_AUTHO_NOT_FOUND)
+				{
+					return FALSE;
+				}
+		}
+
+	/* and the roles with rules on every resource */
+	if (!_zak_autho_snapshot_check_offsets ((const guint32 *)(contents + header->offset[ZAK_AUTHO_SECTION_ROLES_OFFSET]), header->n_resources, header->n_rules)
+	    || !_zak_autho_snapshot_check_range ((const guint32 *)(contents + header->offset[ZAK_AUTHO_SECTION_ROLES_ROLE]), header->n_rules, header->n_roles)
+	    || !_zak_autho_snapshot_check_range ((const guint32 *)(contents + header->offset[ZAK_AUTHO_SECTION_ROLES_NULL]),
+	                                         header->length[ZAK_AUTHO_SECTION_ROLES_NULL] / sizeof (guint32), header->n_roles))
+		{
+			return FALSE;
+		}
+
+	return TRUE;
+}
+
+/* whether every section is where and as long as it must be, and every
+ * value used as an index is in range; the checksum is only for
+ * accidental damage, this makes every lookup safe */
+static gboolean
+_zak_autho_snapshot_check (const SnapshotHeader *header, const gchar *contents)
+{
+	guint64 expected[ZAK_AUTHO_SECTIONS];
+	guint32 n;
+	guint32 i;
+	guint32 h;
+
+	for (i = 0; i < ZAK_AUTHO_SECTIONS; i++)
+		{
+			/* any length, of guint32 but for the strings */
+			expected[i] = G_MAXUINT64;
+		}
+
+	expected[ZAK_AUTHO_SECTION_ROLE_IDS] = sizeof (guint32) * (guint64)header->n_roles;
+	expected[ZAK_AUTHO_SECTION_ROLES_SORTED] = sizeof (guint32) * (guint64)header->n_roles;
+	expected[ZAK_AUTHO_SECTION_RESOURCE_IDS] = sizeof (guint32) * (guint64)header->n_resources;
+	expected[ZAK_AUTHO_SECTION_RESOURCES_SORTED] = sizeof (guint32) * (guint64)header->n_resources;
+	for (h = ZAK_AUTHO_SECTION_ROLES_HIERARCHY;
+	     h <= ZAK_AUTHO_SECTION_RESOURCES_HIERARCHY;
+	     h += ZAK_AUTHO_HIERARCHY_SECTIONS)
+		{
+			n = h == ZAK_AUTHO_SECTION_ROLES_HIERARCHY ? header->n_roles : header->n_resources;
+			expected[h + ZAK_AUTHO_SECTION_PARENTS_OFFSET] = sizeof (guint32) * ((guint64)n + 1);
+			expected[h + ZAK_AUTHO_SECTION_ORDER] = sizeof (guint32) * (guint64)n;
+			expected[h + ZAK_AUTHO_SECTION_RANK] = sizeof (guint32) * (guint64)n;
+			expected[h + ZAK_AUTHO_SECTION_CHILDREN_OFFSET] = sizeof (guint32) * ((guint64)n + 1);
+			expected[h + ZAK_AUTHO_SECTION_PRE] = sizeof (guint32) * (guint64)n;
+			expected[h + ZAK_AUTHO_SECTION_POST] = sizeof (guint32) * (guint64)n;
+			expected[h + ZAK_AUTHO_SECTION_MULTI] = n;
+		}
+	expected[ZAK_AUTHO_SECTION_RULES_OFFSET] = sizeof (guint32) * ((guint64)header->n_roles + 1);
+	expected[ZAK_AUTHO_SECTION_RULES_RESOURCE] = sizeof (guint32) * (guint64)header->n_rules;
+	expected[ZAK_AUTHO_SECTION_RULES_DECISION] = header->n_rules;
+	expected[ZAK_AUTHO_SECTION_RULES_TYPE] = header->n_rules;
+	expected[ZAK_AUTHO_SECTION_RULES_NULL] = header->n_roles;
+	expected[ZAK_AUTHO_SECTION_RULES_NULL_TYPE] = header->n_roles;
+	expected[ZAK_AUTHO_SECTION_ROLES_OFFSET] = sizeof (guint32) * ((guint64)header->n_resources + 1);
+	expected[ZAK_AUTHO_SECTION_ROLES_ROLE] = sizeof (guint32) * (guint64)header->n_rules;
+
+	for (i = 0; i < ZAK_AUTHO_SECTIONS; i++)
+		{
+			if (header->offset[i] % 8 != 0
+			    || header->offset[i] < sizeof (SnapshotHeader)
+			    || header->length[i] > header->size
+			    || header->offset[i] > header->size - header->length[i])
+				{
+					return FALSE;
+				}
+			if (expected[i] == G_MAXUINT64
+			    ? i != ZAK_AUTHO_SECTION_STRINGS && header->length[i] % sizeof (guint32) != 0
+			    : header->length[i] != expected[i])
+				{
+					return FALSE;
+				}
+		}
+
+	/* the string table ends with a nul, so every id does */
+	if (header->length[ZAK_AUTHO_SECTION_STRINGS] == 0
+	    || contents[header->offset[ZAK_AUTHO_SECTION_STRINGS] + header->length[ZAK_AUTHO_SECTION_STRINGS] - 1] != '\0'
+	    || (header->role_name_prefix != ZAK_AUTHO_SNAPSHOT_NO_STRING
+	        && header->role_name_prefix >= header->length[ZAK_AUTHO_SECTION_STRINGS])
+	    || (header->resource_name_prefix != ZAK_AUTHO_SNAPSHOT_NO_STRING
+	        && header->resource_name_prefix >= header->length[ZAK_AUTHO_SECTION_STRINGS]))
+		{
+			return FALSE;
+		}
+
+	for (h = ZAK_AUTHO_SECTION_ROLES_HIERARCHY;
+	     h <= ZAK_AUTHO_SECTION_RESOURCES_HIERARCHY;
+	     h += ZAK_AUTHO_HIERARCHY_SECTIONS)
+		{
+			if (header->length[h + ZAK_AUTHO_SECTION_PARENTS] != header->length[h + ZAK_AUTHO_SECTION_CHILDREN])
+				{
+					return FALSE;
+				}
+		}
+
+	return _zak_autho_snapshot_check_values (header, contents);
+}
+
+static void
+_zak_autho_snapshot_map_hierarchy (Hierarchy *h, guint32 n, const SnapshotHeader *header, const gchar *contents, guint32 first)
+{
+	const guint64 *offset;
+
+	offset = header->offset + first;
+
+	h->n = n;
+	h->parents_offset = (guint32 *)(contents + offset[ZAK_AUTHO_SECTION_PARENTS_OFFSET]);
+	h->parents = (guint32 *)(contents + offset[ZAK_AUTHO_SECTION_PARENTS]);
+	h->order = (guint32 *)(contents + offset[ZAK_AUTHO_SECTION_ORDER]);
+	h->rank = (guint32 *)(contents + offset[ZAK_AUTHO_SECTION_RANK]);
+	h->children_offset = (guint32 *)(contents + offset[ZAK_AUTHO_SECTION_CHILDREN_OFFSET]);
+	h->children = (guint32 *)(contents + offset[ZAK_AUTHO_SECTION_CHILDREN]);
+	h->pre = (guint32 *)(contents + offset[ZAK_AUTHO_SECTION_PRE]);
+	h->post = (guint32 *)(contents + offset[ZAK_AUTHO_SECTION_POST]);
+	h->multi = (guint8 *)(contents + offset[ZAK_AUTHO_SECTION_MULTI]);
+}
+
+/* a snapshot reading @filename in place; NULL if it can't be used */
+static Snapshot
+*_zak_autho_snapshot_map (const gchar *filename)
+{
+	Snapshot *snap;
+	GMappedFile *mapped;
+	GError *error;
+	const gchar *contents;
+	gsize length;
+	const SnapshotHeader *header;
+
+	error = NULL;
+	mapped = g_mapped_file_new (filename, FALSE, &error);
+	if (mapped == NULL)
+		{
+			g_warning ("Unable to open «%s»: %s", filename,
+			           error != NULL && error->message != NULL ? error->message : "no details");
+			return NULL;
+		}
+
+	contents = g_mapped_file_get_contents (mapped);
+	length = g_mapped_file_get_length (mapped);
+	header = (const SnapshotHeader *)contents;
+
+	if (length < sizeof (SnapshotHeader)
+	    || memcmp (header->magic, ZAK_AUTHO_SNAPSHOT_MAGIC, 8) != 0)
+		{
+			g_warning ("«%s» isn't a policy snapshot.", filename);
+			g_mapped_file_unref (mapped);
+			return NULL;
+		}
+	if (header->byte_order != ZAK_AUTHO_SNAPSHOT_BYTE_ORDER
+	    || header->version != ZAK_AUTHO_SNAPSHOT_VERSION)
+		{
+			g_warning ("«%s» was written by another version or on another architecture.", filename);
+			g_mapped_file_unref (mapped);
+			return NULL;
+		}
+	if (header->size != length
+	    || length % 8 != 0
+	    || _zak_autho_snapshot_checksum (ZAK_AUTHO_SNAPSHOT_CHECKSUM_INIT,
+	                                     (const guint8 *)contents + sizeof (SnapshotHeader),
+	                                     length - sizeof (SnapshotHeader)) != header->checksum
+	    || !_zak_autho_snapshot_check (header, contents))
+		{
+			g_warning ("«%s» is corrupted.", filename);
+			g_mapped_file_unref (mapped);
+			return NULL;
+		}
+
+	snap = g_new0 (Snapshot, 1);
+	snap->ref_count = 1;
+	g_mutex_init (&snap->lazy_mutex);
+	snap->mapped = mapped;
+
+	snap->strings = contents + header->offset[ZAK_AUTHO_SECTION_STRINGS];
+	snap->role_ids = (guint32 *)(contents + header->offset[ZAK_AUTHO_SECTION_ROLE_IDS]);
+	snap->roles_sorted = (guint32 *)(contents + header->offset[ZAK_AUTHO_SECTION_ROLES_SORTED]);
+	snap->resource_ids = (guint32 *)(contents + header->offset[ZAK_AUTHO_SECTION_RESOURCE_IDS]);
+	snap->resources_sorted = (guint32 *)(contents + header->offset[ZAK_AUTHO_SECTION_RESOURCES_SORTED]);
+
+	if (header->role_name_prefix != ZAK_AUTHO_SNAPSHOT_NO_STRING)
+		{
+			snap->role_name_prefix = g_strdup (snap->strings + header->role_name_prefix);
+			snap->role_name_prefix_len = strlen (snap->role_name_prefix);
+		}
+	if (header->resource_name_prefix != ZAK_AUTHO_SNAPSHOT_NO_STRING)
+		{
+			snap->resource_name_prefix = g_strdup (snap->strings + header->resource_name_prefix);
+			snap->resource_name_prefix_len = strlen (snap->resource_name_prefix);
+		}
+
+	snap->iroles = g_new0 (ZakAuthoIRole *, header->n_roles + 1);
+	snap->iresources = g_new0 (ZakAuthoIResource *, header->n_resources + 1);
+
+	_zak_autho_snapshot_map_hierarchy (&snap->roles_hierarchy, header->n_roles, header, contents, ZAK_AUTHO_SECTION_ROLES_HIERARCHY);
+	_zak_autho_snapshot_map_hierarchy (&snap->resources_hierarchy, header->n_resources, header, contents, ZAK_AUTHO_SECTION_RESOURCES_HIERARCHY);
+
+	snap->rules_offset = (guint32 *)(contents + header->offset[ZAK_AUTHO_SECTION_RULES_OFFSET]);
+	snap->rules_resource = (guint32 *)(contents + header->offset[ZAK_AUTHO_SECTION_RULES_RESOURCE]);
+	snap->rules_decision = (guint8 *)(contents + header->offset[ZAK_AUTHO_SECTION_RULES_DECISION]);
+	snap->rules_type = (guint8 *)(contents + header->offset[ZAK_AUTHO_SECTION_RULES_TYPE]);
+	snap->rules_null = (guint8 *)(contents + header->offset[ZAK_AUTHO_SECTION_RULES_NULL]);
+	snap->rules_null_type = (guint8 *)(contents + header->offset[ZAK_AUTHO_SECTION_RULES_NULL_TYPE]);
+	snap->roles_offset = (guint32 *)(contents + header->offset[ZAK_AUTHO_SECTION_ROLES_OFFSET]);
+	snap->roles_role = (guint32 *)(contents + header->offset[ZAK_AUTHO_SECTION_ROLES_ROLE]);
+	snap->roles_null = (guint32 *)(contents + header->offset[ZAK_AUTHO_SECTION_ROLES_NULL]);
+	snap->n_roles_null = header->length[ZAK_AUTHO_SECTION_ROLES_NULL] / sizeof (guint32);
+
+	return snap;
+}
+
+/**
+ * zak_autho_save_snapshot:
+ * @zak_autho: an #ZakAutho object.
+ * @path: the file to write.
+ *
+ * Writes the policy in the binary form that zak_autho_load_snapshot()
+ * reads in place. The file can only be loaded by the same version of
+ * the library on a machine with the same byte order.
+ *
+ * Returns: #TRUE on success.
+ */
+gboolean
+zak_autho_save_snapshot (ZakAutho *zak_autho, const gchar *path)
+{
+	gboolean ret;
+
+	ZakAuthoPrivate *priv;
+	Snapshot *snap;
+
+	g_return_val_if_fail (IS_ZAK_AUTHO (zak_autho), FALSE);
+	g_return_val_if_fail (path != NULL, FALSE);
+
+	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
+
+	g_rec_mutex_lock (&priv->mutex);
+
+	_zak_autho_snapshot_publish (zak_autho);
+	snap = priv->snapshot;
+	g_atomic_int_inc (&snap->ref_count);
+
+	g_rec_mutex_unlock (&priv->mutex);
+
+	ret = _zak_autho_snapshot_write (snap, path);
+
+	_zak_autho_snapshot_unref (snap);
+
+	return ret;
+}
+
+/**
+ * zak_autho_load_snapshot:
+ * @zak_autho: an #ZakAutho object.
+ * @path: a file written by zak_autho_save_snapshot().
+ *
+ * Replaces the policy, and the prefixes, with the ones in @path. The
+ * file is mapped in memory and the checks read it in place: roles,
+ * resources and rules are turned into objects only when the policy is
+ * changed or read as a whole. Don't modify the file while it's loaded;
+ * zak_autho_save_snapshot() writes a new file and renames it over the
+ * old one. Every index in the file is checked before use, so a damaged
+ * or forged file is refused rather than read out of bounds.
+ *
+ * Returns: #TRUE on success; on failure the policy is left as it was.
+ */
+gboolean
+zak_autho_load_snapshot (ZakAutho *zak_autho, const gchar *path)
+{
+	ZakAuthoPrivate *priv;
+	Snapshot *snap;
+
+	g_return_val_if_fail (IS_ZAK_AUTHO (zak_autho), FALSE);
+	g_return_val_if_fail (path != NULL, FALSE);
+
+	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
+
+	snap = _zak_autho_snapshot_map (path);
+	if (snap == NULL)
+		{
+			return FALSE;
+		}
+
+	g_rec_mutex_lock (&priv->mutex);
+
+	zak_autho_clear (zak_autho);
+
+	g_free (priv->role_name_prefix);
+	priv->role_name_prefix = g_strdup (snap->role_name_prefix);
+	g_free (priv->resource_name_prefix);
+	priv->resource_name_prefix = g_strdup (snap->resource_name_prefix);
+
+	snap->generation = (guint)g_atomic_int_get (&priv->generation);
+	snap->epoch = priv->epoch;
+
+	/* one reference for the checks, one until the tables are filled */
+	g_atomic_int_inc (&snap->ref_count);
+	priv->mapped_snapshot = snap;
+	_zak_autho_snapshot_replace (zak_autho, snap);
+
+	g_rec_mutex_unlock (&priv->mutex);
+
+	return TRUE;
+}
+
+static gboolean
+_zak_autho_delete_table_content (GdaConnection *gdacon, const gchar *table_prefix)
+{
+	gboolean ret;
+
+	gchar *sql;
+	GError *error;
+
+	ret = TRUE;
+
+	error = NULL;
+	sql = g_strdup_printf ("DELETE FROM %sroles", table_prefix);
+	gda_connection_execute_non_select_command (gdacon, sql, &error);
+	g_free (sql);
+	if (error != NULL)
+		{
+			g_warning ("Error on deleting roles table content: %s",
+			           error->message != NULL ? error->message : "No details");
+		}
+	error = NULL;
+	sql = g_strdup_printf ("DELETE FROM %sroles_parents", table_prefix);
+	gda_connection_execute_non_select_command (gdacon, sql, &error);
+	g_free (sql);
+	if (error != NULL)
+		{
+			g_warning ("Error on deleting roles_parents table content: %s",
+			           error->message != NULL ? error->message : "No details");
+		}
+	error = NULL;
+	sql = g_strdup_printf ("DELETE FROM %sresources", table_prefix);
+	gda_connection_execute_non_select_command (gdacon, sql, &error);
+	g_free (sql);
+	if (error != NULL)
+		{
+			g_warning ("Error on deleting resources table content: %s",
+			           error->message != NULL ? error->message : "No details");
+		}
+	error = NULL;
+	sql = g_strdup_printf ("DELETE FROM %sresources_parents", table_prefix);
+	gda_connection_execute_non_select_command (gdacon, sql, &error);
+	g_free (sql);
+	if (error != NULL)
+		{
+			g_warning ("Error on deleting resources_parents table content: %s",
+			           error->message != NULL ? error->message : "No details");
+		}
+	error = NULL;
+	sql = g_strdup_printf ("DELETE FROM %srules", table_prefix);
+	gda_connection_execute_non_select_command (gdacon, sql, &error);
+	g_free (sql);
+	if (error != NULL)
+		{
+			g_warning ("Error on deleting rules table content: %s",
+			           error->message != NULL ? error->message : "No details");
+		}
+
+	return ret;
+}
+
+/* rows inserted or deleted by one statement: few enough to stay under
+ * the limit of parameters of every provider (999 for older sqlite) */
+#define ZAK_AUTHO_DB_BATCH_ROWS 100
+
+/* multi-row inserts into, or deletes from, one table through prepared
+ * statements */
+typedef struct
+	{
+		GdaConnection *gdacon;
+		GdaSqlParser *parser;
+		gboolean delete; /* the rows matching every column */
+		gchar *table_name;
+		const gchar *columns; /* comma separated */
+		const GType *types; /* G_TYPE_INT or G_TYPE_STRING, by column */
+		guint n_columns;
+
+		GdaStatement *stmt; /* of ZAK_AUTHO_DB_BATCH_ROWS rows, on first use */
+		GdaSet *params;
+
+		GValue *values; /* of the rows not written yet */
+		guint n_rows;
+	} DbBatch;
+
+static void
+_zak_autho_db_batch_init (DbBatch *batch, GdaConnection *gdacon, GdaSqlParser *parser, gboolean delete,
+                          const gchar *table_name, const gchar *columns, const GType *types, guint n_columns)
+{
+	batch->gdacon = gdacon;
+	batch->parser = parser;
+	batch->delete = delete;
+	batch->table_name = g_strdup (table_name);
+	batch->columns = columns;
+	batch->types = types;
+	batch->n_columns = n_columns;
+	batch->stmt = NULL;
+	batch->params = NULL;
+	batch->values = g_new0 (GValue, ZAK_AUTHO_DB_BATCH_ROWS * n_columns);
+	batch->n_rows = 0;
+}
+
+static void
+_zak_autho_db_batch_clear (DbBatch *batch)
+{
+	guint i;
+
+	for (i = 0; i < batch->n_rows * batch->n_columns; i++)
+		{
+			g_value_unset (&batch->values[i]);
+		}
+	g_free (batch->values);
+	g_free (batch->table_name);
+	if (batch->stmt != NULL)
+		{
+			g_object_unref (batch->stmt);
+		}
+	if (batch->params != NULL)
+		{
+			g_object_unref (batch->params);
+		}
+}
+
+/* INSERT INTO table (columns) VALUES (##p0::gint, ##p1::string), ...
+ * or DELETE FROM table WHERE (column0 = ##p0::gint AND ...) OR ... */
+static GdaStatement
+*_zak_autho_db_batch_prepare (DbBatch *batch, guint n_rows, GdaSet **params, GError **error)
+{
+	GdaStatement *stmt;
+	GString *sql;
+	gchar **names;
+	guint row;
+	guint column;
+
+	sql = g_string_new (NULL);
+	names = g_strsplit (batch->columns, ", ", -1);
+	if (batch->delete)
+		{
+			g_string_append_printf (sql, "DELETE FROM %s WHERE", batch->table_name);
+		}
+	else
+		{
+			g_string_append_printf (sql, "INSERT INTO %s (%s) VALUES", batch->table_name, batch->columns);
+		}
+	for (row = 0; row < n_rows; row++)
+		{
+			if (batch->delete)
+				{
+					g_string_append (sql, row == 0 ? " (" : " OR (");
+				}
+			else
+				{
+					g_string_append (sql, row == 0 ? " (" : ", (");
+				}
+			for (column = 0; column < batch->n_columns; column++)
+				{
+					if (batch->delete)
+						{
+							g_string_append_printf (sql, "%s%s = ", column == 0 ? "" : " AND ", names[column]);
+						}
+					else if (column > 0)
+						{
+							g_string_append (sql, ", ");
+						}
+					g_string_append_printf (sql, "##p%u::%s",
+					                        row * batch->n_columns + column,
+					                        batch->types[column] == G_TYPE_INT ? "gint" : "string");
+				}
+			g_string_append_c (sql, ')');
+		}
+	g_strfreev (names);
+
+	stmt = gda_sql_parser_parse_string (batch->parser, sql->str, NULL, error);
+	g_string_free (sql, TRUE);
+
+	if (stmt != NULL
+	    && !gda_statement_get_parameters (stmt, params, error))
+		{
+			g_object_unref (stmt);
+			stmt = NULL;
+		}
+
+	return stmt;
+}
+
+static gboolean
+_zak_autho_db_batch_flush (DbBatch *batch, GError **error)
+{
+	gboolean ret;
+
+	GdaStatement *stmt;
+	GdaSet *params;
+	GdaHolder *holder;
+	gchar name[16];
+	guint i;
+
+	if (batch->n_rows == 0)
+		{
+			return TRUE;
+		}
+
+	/* the full batch is prepared once; the last, shorter one on its own */
+	if (batch->n_rows == ZAK_AUTHO_DB_BATCH_ROWS)
+		{
+			if (batch->stmt == NULL)
+				{
+					batch->stmt = _zak_autho_db_batch_prepare (batch, ZAK_AUTHO_DB_BATCH_ROWS, &batch->params, error);
+				}
+			stmt = batch->stmt;
+			params = batch->params;
+		}
+	else
+		{
+			params = NULL;
+			stmt = _zak_autho_db_batch_prepare (batch, batch->n_rows, &params, error);
+		}
+
+	ret = stmt != NULL;
+	for (i = 0; ret && i < batch->n_rows * batch->n_columns; i++)
+		{
+			g_snprintf (name, sizeof (name), "p%u", i);
+			holder = gda_set_get_holder (params, name);
+			ret = holder != NULL
+			      && gda_holder_set_value (holder, &batch->values[i], error);
+		}
+	ret = ret
+	      && gda_connection_statement_execute_non_select (batch->gdacon, stmt, params, NULL, error) >= 0;
+
+	if (stmt != batch->stmt)
+		{
+			if (stmt != NULL)
+				{
+					g_object_unref (stmt);
+				}
+			if (params != NULL)
+				{
+					g_object_unref (params);
+				}
+		}
+
+	for (i = 0; i < batch->n_rows * batch->n_columns; i++)
+		{
+			g_value_unset (&batch->values[i]);
+		}
+	batch->n_rows = 0;
+
+	return ret;
+}
+
+/* one row, with a gint or a const gchar * for every column; the strings
+ * must live until the next flush */
+static gboolean
+_zak_autho_db_batch_add (DbBatch *batch, GError **error, ...)
+{
+	va_list ap;
+	GValue *value;
+	guint column;
+
+	va_start (ap, error);
+	for (column = 0; column < batch->n_columns; column++)
+		{
+			value = &batch->values[batch->n_rows * batch->n_columns + column];
+			g_value_init (value, batch->types[column]);
+			if (batch->types[column] == G_TYPE_INT)
+				{
+					g_value_set_int (value, va_arg (ap, gint));
+				}
+			else
+				{
+					g_value_set_static_string (value, va_arg (ap, const gchar *));
+				}
+		}
+	va_end (ap);
+
+	batch->n_rows++;
+
+	return batch->n_rows < ZAK_AUTHO_DB_BATCH_ROWS
+	       || _zak_autho_db_batch_flush (batch, error);
+}
+
+/* the id of every row of @table_name by @column, and the highest one */
+static gboolean
+_zak_autho_db_load_ids (GdaConnection *gdacon, const gchar *table_name, const gchar *column,
+                        GHashTable *ids, guint *max_id, GError **error)
+{
+	gchar *sql;
+	GdaDataModel *dm;
+	gint rows;
+	gint row;
+	guint id;
+
+	sql = g_strdup_printf ("SELECT id, %s FROM %s", column, table_name);
+	dm = gda_connection_execute_select_command (gdacon, sql, error);
+	g_free (sql);
+	if (dm == NULL)
+		{
+			return FALSE;
+		}
+
+	*max_id = 0;
+	rows = gda_data_model_get_n_rows (dm);
+	for (row = 0; row < rows; row++)
+		{
+			id = g_value_get_int (gda_data_model_get_value_at (dm, 0, row, NULL));
+			*max_id = MAX (*max_id, id);
+			if (ids != NULL)
+				{
+					g_hash_table_insert (ids,
+					                     gda_value_stringify (gda_data_model_get_value_at (dm, 1, row, NULL)),
+					                     GUINT_TO_POINTER (id));
+				}
+		}
+	g_object_unref (dm);
+
+	return TRUE;
+}
+
+/* the highest id of @table_name */
+static gboolean
+_zak_autho_db_max_id (GdaConnection *gdacon, const gchar *table_name, guint *max_id, GError **error)
+{
+	gchar *sql;
+	GdaDataModel *dm;
+
+	sql = g_strdup_printf ("SELECT COALESCE (MAX (id), 0) FROM %s", table_name);
+	dm = gda_connection_execute_select_command (gdacon, sql, error);
+	g_free (sql);
+	if (dm == NULL)
+		{
+			return FALSE;
+		}
+
+	*max_id = gda_data_model_get_n_rows (dm) == 1 ? g_value_get_int (gda_data_model_get_value_at (dm, 0, 0, NULL)) : 0;
+	g_object_unref (dm);
+
+	return TRUE;
+}
+
+/* an integer column, whatever its size; 0 if NULL */
+static gint64
+_zak_autho_db_value_get_int64 (const GValue *gval)
+{
+	GValue gval_int64 = G_VALUE_INIT;
+	gint64 ret;
+
+	if (gval == NULL || gda_value_is_null (gval))
+		{
+			return 0;
+		}
+	if (G_VALUE_HOLDS_INT (gval))
+		{
+			return g_value_get_int (gval);
+		}
+
+	g_value_init (&gval_int64, G_TYPE_INT64);
+	ret = g_value_transform (gval, &gval_int64) ? g_value_get_int64 (&gval_int64) : 0;
+	g_value_unset (&gval_int64);
+
+	return ret;
+}
+
+/* the rows of @sql, on what the tables may lack (it's optional); NULL
+ * if it can't be read. In a transaction an error would abort it, with
+ * everything after (on postgresql), so it's tried after a savepoint and
+ * not at all without one */
+static GdaDataModel
+*_zak_autho_db_select_optional (GdaConnection *gdacon, const gchar *sql)
+{
+	GdaDataModel *dm;
+
+	if (gda_connection_get_transaction_status (gdacon) == NULL)
+		{
+			return gda_connection_execute_select_command (gdacon, sql, NULL);
+		}
+
+	if (!gda_connection_add_savepoint (gdacon, "zak_autho_optional", NULL))
+		{
+			return NULL;
+		}
+
+	dm = gda_connection_execute_select_command (gdacon, sql, NULL);
+	if (dm == NULL)
+		{
+			gda_connection_rollback_savepoint (gdacon, "zak_autho_optional", NULL);
+		}
+	else
+		{
+			gda_connection_delete_savepoint (gdacon, "zak_autho_optional", NULL);
+		}
+
+	return dm;
+}
+
+/* the last row of the changelog table; 0 if it's empty or there's no
+ * such table (it's optional) */
+static gint64
+_zak_autho_db_changelog_seq (GdaConnection *gdacon, const gchar *table_prefix)
+{
+	gchar *sql;
+	GdaDataModel *dm;
+	gint64 ret;
+
+	sql = g_strdup_printf ("SELECT MAX (seq) FROM %schangelog", table_prefix);
+	dm = _zak_autho_db_select_optional (gdacon, sql);
+	g_free (sql);
+	if (dm == NULL)
+		{
+			return 0;
+		}
+
+	ret = gda_data_model_get_n_rows (dm) == 1 ? _zak_autho_db_value_get_int64 (gda_data_model_get_value_at (dm, 0, 0, NULL)) : 0;
+	g_object_unref (dm);
+
+	return ret;
+}
+
+/* the oldest transaction still running, as the changelog table records
+ * them; -1 if the database can't tell */
+static gint64
+_zak_autho_db_txid_xmin (GdaConnection *gdacon)
+{
+	GdaDataModel *dm;
+	gint64 ret;
+
+	dm = _zak_autho_db_select_optional (gdacon, "SELECT txid_snapshot_xmin (txid_current_snapshot ())");
+	if (dm == NULL)
+		{
+			return -1;
+		}
+
+	ret = gda_data_model_get_n_rows (dm) == 1 ? _zak_autho_db_value_get_int64 (gda_data_model_get_value_at (dm, 0, 0, NULL)) : -1;
+	g_object_unref (dm);
+
+	return ret;
+}
+
+/* a string column, without copying it; NULL as "" */
+static const gchar
+*_zak_autho_db_value_get_string (const GValue *gval)
+{
+	if (gval == NULL || gda_value_is_null (gval) || !G_VALUE_HOLDS_STRING (gval))
+		{
+			return "";
+		}
+
+	return g_value_get_string (gval);
+}
+
+/* the rows of @sql; on a forward only cursor if @forward, read as they
+ * come and not all kept in memory, but that needs a transaction */
+static GdaDataModel
+*_zak_autho_db_select (GdaConnection *gdacon, GdaSqlParser *parser, const gchar *sql, gboolean forward, GError **error)
+{
+	GdaStatement *stmt;
+	GdaDataModel *dm;
+
+	stmt = gda_sql_parser_parse_string (parser, sql, NULL, error);
+	if (stmt == NULL)
+		{
+			return NULL;
+		}
+
+	dm = gda_connection_statement_execute_select_full (gdacon, stmt, NULL,
+	                                                   forward ? GDA_STATEMENT_MODEL_CURSOR_FORWARD : GDA_STATEMENT_MODEL_RANDOM_ACCESS,
+	                                                   NULL, error);
+	g_object_unref (stmt);
+
+	return dm;
+}
+
+/* the version of the policy in the tables; -1 if it can't be read */
+static gint64
+_zak_autho_db_policy_version (GdaConnection *gdacon, const gchar *table_prefix)
+{
+	gchar *sql;
+	GdaDataModel *dm;
+	gint64 ret;
+
+	sql = g_strdup_printf ("SELECT policy_version FROM %stimestamp_update", table_prefix);
+	dm = _zak_autho_db_select_optional (gdacon, sql);
+	g_free (sql);
+	if (dm == NULL)
+		{
+			return -1;
+		}
+
+	ret = gda_data_model_get_n_rows (dm) > 0 ? _zak_autho_db_value_get_int64 (gda_data_model_get_value_at (dm, 0, 0, NULL)) : -1;
+	g_object_unref (dm);
+
+	return ret;
+}
+
+/* the rows of @sql, all integers, as "column0:column1:..." */
+static gboolean
+_zak_autho_db_load_keys (GdaConnection *gdacon, const gchar *sql, GHashTable *keys, GError **error)
+{
+	GdaDataModel *dm;
+	GString *key;
+	gint rows;
+	gint row;
+	gint columns;
+	gint column;
+
+	dm = gda_connection_execute_select_command (gdacon, sql, error);
+	if (dm == NULL)
+		{
+			return FALSE;
+		}
+
+	key = g_string_new (NULL);
+	rows = gda_data_model_get_n_rows (dm);
+	columns = gda_data_model_get_n_columns (dm);
+	for (row = 0; row < rows; row++)
+		{
+			g_string_truncate (key, 0);
+			for (column = 0; column < columns; column++)
+				{
+					g_string_append_printf (key, column == 0 ? "%d" : ":%d",
+					                        g_value_get_int (gda_data_model_get_value_at (dm, column, row, NULL)));
+				}
+			g_hash_table_add (keys, g_strdup (key->str));
+		}
+	g_string_free (key, TRUE);
+	g_object_unref (dm);
+
+	return TRUE;
+}
+
+/* gives every node its db id: the one already in the table, with @ids,
+ * or a new one after @max_id; the new nodes are added to @batch */
+static gboolean
+_zak_autho_db_save_nodes (GPtrArray *nodes, gboolean roles, GHashTable *ids, guint max_id,
+                          DbBatch *batch, GError **error)
+{
+	gboolean ret;
+	guint i;
+	const gchar *id;
+	guint *db_id;
+	gpointer value;
+
+	ret = TRUE;
+	for (i = 0; ret && i < nodes->len; i++)
+		{
+			if (roles)
+				{
+					id = zak_autho_irole_peek_role_id (((Role *)g_ptr_array_index (nodes, i))->irole);
+					db_id = &((Role *)g_ptr_array_index (nodes, i))->db_id;
+				}
+			else
+				{
+					id = zak_autho_iresource_peek_resource_id (((Resource *)g_ptr_array_index (nodes, i))->iresource);
+					db_id = &((Resource *)g_ptr_array_index (nodes, i))->db_id;
+				}
+
+			if (ids != NULL
+			    && g_hash_table_lookup_extended (ids, id, NULL, &value))
+				{
+					*db_id = GPOINTER_TO_UINT (value);
+				}
+			else
+				{
+					*db_id = ++max_id;
+					ret = _zak_autho_db_batch_add (batch, error, (gint)*db_id, id);
+				}
+		}
+
+	return ret && _zak_autho_db_batch_flush (batch, error);
+}
+
+static gboolean
+_zak_autho_db_save_parents (GPtrArray *nodes, gboolean roles, GHashTable *pairs,
+                            DbBatch *batch, GError **error)
+{
+	gboolean ret;
+	guint i;
+	GList *parents;
+	guint db_id;
+	guint parent_db_id;
+	gchar *pair;
+	gboolean exists;
+
+	ret = TRUE;
+	for (i = 0; ret && i < nodes->len; i++)
+		{
+			if (roles)
+				{
+					parents = ((Role *)g_ptr_array_index (nodes, i))->parents;
+					db_id = ((Role *)g_ptr_array_index (nodes, i))->db_id;
+				}
+			else
+				{
+					parents = ((Resource *)g_ptr_array_index (nodes, i))->parents;
+					db_id = ((Resource *)g_ptr_array_index (nodes, i))->db_id;
+				}
+			for (; ret && parents != NULL; parents = g_list_next (parents))
+				{
+					parent_db_id = roles ? ((Role *)parents->data)->db_id : ((Resource *)parents->data)->db_id;
+
+					exists = FALSE;
+					if (pairs != NULL)
+						{
+							pair = g_strdup_printf ("%u:%u", db_id, parent_db_id);
+							exists = g_hash_table_contains (pairs, pair);
+							g_free (pair);
+						}
+					if (!exists)
+						{
+							ret = _zak_autho_db_batch_add (batch, error, (gint)db_id, (gint)parent_db_id);
+						}
+				}
+		}
+
+	return ret && _zak_autho_db_batch_flush (batch, error);
+}
+
+static const GType db_node_types[] = { G_TYPE_INT, G_TYPE_STRING };
+static const GType db_parent_types[] = { G_TYPE_INT, G_TYPE_INT };
+static const GType db_rule_types[] = { G_TYPE_INT, G_TYPE_INT, G_TYPE_INT, G_TYPE_INT };
+
+/* the whole policy; without @replace, what is already in the tables is
+ * kept and not written again */
+static gboolean
+_zak_autho_db_save_all (ZakAutho *zak_autho, GdaConnection *gdacon, GdaSqlParser *parser,
+                        const gchar *prefix, gboolean replace, GError **error)
+{
+	gboolean ret;
+
+	GHashTableIter iter;
+	gpointer key, value;
+	Rule *rule;
+
+	DbBatch batch;
+	gchar *table_name;
+	gchar *sql;
+	GHashTable *ids;
+	GHashTable *keys;
+	guint max_id;
+	guint type;
+	gchar *rule_key;
+	gboolean exists;
+
+	ZakAuthoPrivate *priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
+
+	ret = TRUE;
+	if (replace)
+		{
+			/* deleting table's content */
+			ret = _zak_autho_delete_table_content (gdacon, prefix);
+		}
+
+	ids = replace ? NULL : g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	keys = replace ? NULL : g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	/* roles */
+	table_name = g_strdup_printf ("%sroles", prefix);
+	max_id = 0;
+	ret = ret && (replace || _zak_autho_db_load_ids (gdacon, table_name, "role_id", ids, &max_id, error));
+	_zak_autho_db_batch_init (&batch, gdacon, parser, FALSE, table_name, "id, role_id", db_node_types, 2);
+	ret = ret && _zak_autho_db_save_nodes (priv->roles_idx, TRUE, ids, max_id, &batch, error);
+	_zak_autho_db_batch_clear (&batch);
+	g_free (table_name);
+
+	/* resources */
+	if (ids != NULL)
+		{
+			g_hash_table_remove_all (ids);
+		}
+	table_name = g_strdup_printf ("%sresources", prefix);
+	max_id = 0;
+	ret = ret && (replace || _zak_autho_db_load_ids (gdacon, table_name, "resource_id", ids, &max_id, error));
+	_zak_autho_db_batch_init (&batch, gdacon, parser, FALSE, table_name, "id, resource_id", db_node_types, 2);
+	ret = ret && _zak_autho_db_save_nodes (priv->resources_idx, FALSE, ids, max_id, &batch, error);
+	_zak_autho_db_batch_clear (&batch);
+	g_free (table_name);
+
+	/* parents */
+	table_name = g_strdup_printf ("%sroles_parents", prefix);
+	sql = g_strdup_printf ("SELECT id_roles, id_roles_parent FROM %s", table_name);
+	ret = ret && (replace || _zak_autho_db_load_keys (gdacon, sql, keys, error));
 	g_free (sql);
-	if (error != NULL)
+	_zak_autho_db_batch_init (&batch, gdacon, parser, FALSE, table_name, "id_roles, id_roles_parent", db_parent_types, 2);
+	ret = ret && _zak_autho_db_save_parents (priv->roles_idx, TRUE, keys, &batch, error);
+	_zak_autho_db_batch_clear (&batch);
+	g_free (table_name);
+
+	if (keys != NULL)
+		{
+			g_hash_table_remove_all (keys);
+		}
+	table_name = g_strdup_printf ("%sresources_parents", prefix);
+	sql = g_strdup_printf ("SELECT id_resources, id_resources_parent FROM %s", table_name);
+	ret = ret && (replace || _zak_autho_db_load_keys (gdacon, sql, keys, error));
+	g_free (sql);
+	_zak_autho_db_batch_init (&batch, gdacon, parser, FALSE, table_name, "id_resources, id_resources_parent", db_parent_types, 2);
+	ret = ret && _zak_autho_db_save_parents (priv->resources_idx, FALSE, keys, &batch, error);
+	_zak_autho_db_batch_clear (&batch);
+	g_free (table_name);
+
+	/* rules: allow ones first, then deny ones */
+	if (keys != NULL)
+		{
+			g_hash_table_remove_all (keys);
+		}
+	table_name = g_strdup_printf ("%srules", prefix);
+	sql = g_strdup_printf ("SELECT type, id_roles, COALESCE (id_resources, 0) FROM %s", table_name);
+	max_id = 0;
+	ret = ret && (replace
+	              || (_zak_autho_db_load_keys (gdacon, sql, keys, error)
+	                  && _zak_autho_db_max_id (gdacon, table_name, &max_id, error)));
+	g_free (sql);
+	_zak_autho_db_batch_init (&batch, gdacon, parser, FALSE, table_name, "id, type, id_roles, id_resources", db_rule_types, 4);
+	for (type = ZAK_AUTHO_RULE_ALLOW; ret && type <= ZAK_AUTHO_RULE_DENY; type <<= 1)
+		{
+			g_hash_table_iter_init (&iter, priv->rules);
+			while (ret && g_hash_table_iter_next (&iter, &key, &value))
+				{
+					rule = (Rule *)value;
+					if (!(rule->type & type))
+						{
+							continue;
+						}
+
+					exists = FALSE;
+					if (keys != NULL)
+						{
+							rule_key = g_strdup_printf ("%u:%u:%u", type, rule->role->db_id,
+							                            rule->resource == NULL ? 0 : rule->resource->db_id);
+							exists = g_hash_table_contains (keys, rule_key);
+							g_free (rule_key);
+						}
+					if (!exists)
+						{
+							ret = _zak_autho_db_batch_add (&batch, error,
+							                               (gint)++max_id,
+							                               (gint)type,
+							                               (gint)rule->role->db_id,
+							                               rule->resource == NULL ? 0 : (gint)rule->resource->db_id);
+						}
+				}
+		}
+	ret = ret && _zak_autho_db_batch_flush (&batch, error);
+	_zak_autho_db_batch_clear (&batch);
+	g_free (table_name);
+
+	if (ids != NULL)
+		{
+			g_hash_table_destroy (ids);
+		}
+	if (keys != NULL)
+		{
+			g_hash_table_destroy (keys);
+		}
+
+	return ret;
+}
+
+static gint
+_zak_autho_journal_entry_compare (gconstpointer a, gconstpointer b)
+{
+	const JournalEntry *entry_a = *(const JournalEntry **)a;
+	const JournalEntry *entry_b = *(const JournalEntry **)b;
+
+	if (entry_a->kind != entry_b->kind)
+		{
+			return entry_a->kind < entry_b->kind ? -1 : 1;
+		}
+	if (entry_a->idx != entry_b->idx)
+		{
+			return entry_a->idx < entry_b->idx ? -1 : 1;
+		}
+	if (entry_a->other_idx != entry_b->other_idx)
+		{
+			return entry_a->other_idx < entry_b->other_idx ? -1 : 1;
+		}
+	return entry_a->type - entry_b->type;
+}
+
+/* only the entries of the journal that differ from the tables: roles,
+ * resources and rules are only ever added, parents can be dropped too */
+static gboolean
+_zak_autho_db_save_journal (ZakAutho *zak_autho, GdaConnection *gdacon, GdaSqlParser *parser,
+                            const gchar *prefix, GError **error)
+{
+	gboolean ret;
+
+	GHashTableIter iter;
+	gpointer key;
+	GPtrArray *entries;
+	JournalEntry *entry;
+	guint i;
+	guint kind;
+
+	Role *role;
+	Resource *resource;
+	Rule *rule;
+	GList *parents;
+	guint db_id;
+	guint parent_db_id;
+	gboolean present;
+	gint64 rule_key;
+
+	DbBatch batch;
+	DbBatch delete_batch;
+	gchar *table_name;
+	guint max_id;
+	gboolean has_max_id;
+
+	ZakAuthoPrivate *priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
+
+	entries = g_ptr_array_sized_new (g_hash_table_size (priv->journal));
+	g_hash_table_iter_init (&iter, priv->journal);
+	while (g_hash_table_iter_next (&iter, &key, NULL))
+		{
+			g_ptr_array_add (entries, key);
+		}
+	g_ptr_array_sort (entries, _zak_autho_journal_entry_compare);
+
+	ret = TRUE;
+	i = 0;
+
+	/* roles and resources, before what refers to them */
+	for (kind = ZAK_AUTHO_JOURNAL_ROLE; kind <= ZAK_AUTHO_JOURNAL_RESOURCE; kind++)
+		{
+			table_name = g_strdup_printf (kind == ZAK_AUTHO_JOURNAL_ROLE ? "%sroles" : "%sresources", prefix);
+			_zak_autho_db_batch_init (&batch, gdacon, parser, FALSE, table_name,
+			                          kind == ZAK_AUTHO_JOURNAL_ROLE ? "id, role_id" : "id, resource_id",
+			                          db_node_types, 2);
+			has_max_id = FALSE;
+			for (; ret && i < entries->len && ((JournalEntry *)g_ptr_array_index (entries, i))->kind == kind; i++)
+				{
+					entry = (JournalEntry *)g_ptr_array_index (entries, i);
+					if (entry->in_db)
+						{
+							continue;
+						}
+					if (!has_max_id)
+						{
+							ret = _zak_autho_db_max_id (gdacon, table_name, &max_id, error);
+							has_max_id = TRUE;
+						}
+					if (!ret)
+						{
+							break;
+						}
+
+					if (kind == ZAK_AUTHO_JOURNAL_ROLE)
+						{
+							role = (Role *)g_ptr_array_index (priv->roles_idx, entry->idx);
+							role->db_id = ++max_id;
+							ret = _zak_autho_db_batch_add (&batch, error, (gint)role->db_id, zak_autho_irole_peek_role_id (role->irole));
+						}
+					else
+						{
+							resource = (Resource *)g_ptr_array_index (priv->resources_idx, entry->idx);
+							resource->db_id = ++max_id;
+							ret = _zak_autho_db_batch_add (&batch, error, (gint)resource->db_id, zak_autho_iresource_peek_resource_id (resource->iresource));
+						}
+				}
+			ret = ret && _zak_autho_db_batch_flush (&batch, error);
+			_zak_autho_db_batch_clear (&batch);
+			g_free (table_name);
+		}
+
+	/* parents */
+	for (kind = ZAK_AUTHO_JOURNAL_ROLE_PARENT; kind <= ZAK_AUTHO_JOURNAL_RESOURCE_PARENT; kind++)
+		{
+			table_name = g_strdup_printf (kind == ZAK_AUTHO_JOURNAL_ROLE_PARENT ? "%sroles_parents" : "%sresources_parents", prefix);
+			_zak_autho_db_batch_init (&batch, gdacon, parser, FALSE, table_name,
+			                          kind == ZAK_AUTHO_JOURNAL_ROLE_PARENT ? "id_roles, id_roles_parent" : "id_resources, id_resources_parent",
+			                          db_parent_types, 2);
+			_zak_autho_db_batch_init (&delete_batch, gdacon, parser, TRUE, table_name,
+			                          kind == ZAK_AUTHO_JOURNAL_ROLE_PARENT ? "id_roles, id_roles_parent" : "id_resources, id_resources_parent",
+			                          db_parent_types, 2);
+			for (; ret && i < entries->len && ((JournalEntry *)g_ptr_array_index (entries, i))->kind == kind; i++)
+				{
+					entry = (JournalEntry *)g_ptr_array_index (entries, i);
+					if (kind == ZAK_AUTHO_JOURNAL_ROLE_PARENT)
+						{
+							role = (Role *)g_ptr_array_index (priv->roles_idx, entry->other_idx);
+							parent_db_id = role->db_id;
+							role = (Role *)g_ptr_array_index (priv->roles_idx, entry->idx);
+							db_id = role->db_id;
+							parents = g_list_find (role->parents, g_ptr_array_index (priv->roles_idx, entry->other_idx));
+						}
+					else
+						{
+							resource = (Resource *)g_ptr_array_index (priv->resources_idx, entry->other_idx);
+							parent_db_id = resource->db_id;
+							resource = (Resource *)g_ptr_array_index (priv->resources_idx, entry->idx);
+							db_id = resource->db_id;
+							parents = g_list_find (resource->parents, g_ptr_array_index (priv->resources_idx, entry->other_idx));
+						}
+
+					present = parents != NULL;
+					if (present != entry->in_db)
+						{
+							ret = _zak_autho_db_batch_add (present ? &batch : &delete_batch, error, (gint)db_id, (gint)parent_db_id);
+						}
+				}
+			ret = ret
+			      && _zak_autho_db_batch_flush (&delete_batch, error)
+			      && _zak_autho_db_batch_flush (&batch, error);
+			_zak_autho_db_batch_clear (&batch);
+			_zak_autho_db_batch_clear (&delete_batch);
+			g_free (table_name);
+		}
+
+	/* rules */
+	table_name = g_strdup_printf ("%srules", prefix);
+	_zak_autho_db_batch_init (&batch, gdacon, parser, FALSE, table_name, "id, type, id_roles, id_resources", db_rule_types, 4);
+	_zak_autho_db_batch_init (&delete_batch, gdacon, parser, TRUE, table_name, "type, id_roles, id_resources", db_rule_types, 3);
+	has_max_id = FALSE;
+	for (; ret && i < entries->len; i++)
+		{
+			entry = (JournalEntry *)g_ptr_array_index (entries, i);
+
+			rule_key = (gint64)ZAK_AUTHO_RULE_KEY (entry->idx, entry->other_idx);
+			rule = (Rule *)g_hash_table_lookup (priv->rules, &rule_key);
+			present = rule != NULL && (rule->type & entry->type);
+			if (present == entry->in_db)
+				{
+					continue;
+				}
+
+			db_id = ((Role *)g_ptr_array_index (priv->roles_idx, entry->idx))->db_id;
+			parent_db_id = entry->other_idx == ZAK_AUTHO_RESOURCE_IDX_NULL ? 0 : ((Resource *)g_ptr_array_index (priv->resources_idx, entry->other_idx))->db_id;
+			if (!present)
+				{
+					ret = _zak_autho_db_batch_add (&delete_batch, error, (gint)entry->type, (gint)db_id, (gint)parent_db_id);
+					continue;
+				}
+
+			if (!has_max_id)
+				{
+					ret = _zak_autho_db_max_id (gdacon, table_name, &max_id, error);
+					has_max_id = TRUE;
+				}
+			ret = ret
+			      && _zak_autho_db_batch_add (&batch, error, (gint)++max_id, (gint)entry->type, (gint)db_id, (gint)parent_db_id);
+		}
+	ret = ret
+	      && _zak_autho_db_batch_flush (&delete_batch, error)
+	      && _zak_autho_db_batch_flush (&batch, error);
+	_zak_autho_db_batch_clear (&batch);
+	_zak_autho_db_batch_clear (&delete_batch);
+	g_free (table_name);
+
+	g_ptr_array_free (entries, TRUE);
+
+	return ret;
+}
+
+/**
+ * zak_autho_save_to_db:
+ * @zak_autho: an #ZakAutho object.
+ * @gdacon:
+ * @table_prefix:
+ * @replace:
+ *
+ * Saves the policy in one transaction: if something fails nothing is
+ * written. Without @replace, roles and resources already in the tables
+ * keep their id, as do the parents and the rules.
+ *
+ * When the policy was loaded from, or saved with @replace to, the same
+ * tables, only what changed since then is written, whatever @replace.
+ *
+ * Returns: #TRUE on success.
+ */
+gboolean
+zak_autho_save_to_db (ZakAutho *zak_autho, GdaConnection *gdacon,
+                  const gchar *table_prefix, gboolean replace)
+{
+	ZakAuthoPrivate *priv;
+
+	gboolean ret;
+
+	gboolean in_trans;
+
+	gchar *prefix;
+
+	GError *error;
+
+	GdaSqlParser *parser;
+	gboolean incremental;
+
+	g_return_val_if_fail (IS_ZAK_AUTHO (zak_autho), FALSE);
+	g_return_val_if_fail (GDA_IS_CONNECTION (gdacon), FALSE);
+
+	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
+
+	g_rec_mutex_lock (&priv->mutex);
+	_zak_autho_materialize (zak_autho);
+
+	if (table_prefix == NULL)
+		{
+			prefix = g_strdup ("");
+		}
+	else
+		{
+			prefix = g_strstrip (g_strdup (table_prefix));
+		}
+
+	incremental = priv->journal != NULL
+	              && priv->journal_gdacon == gdacon
+	              && g_strcmp0 (priv->journal_table_prefix, prefix) == 0;
+	if (incremental && g_hash_table_size (priv->journal) == 0)
+		{
+			/* nothing changed */
+			g_free (prefix);
+			g_rec_mutex_unlock (&priv->mutex);
+			return TRUE;
+		}
+	if (!incremental)
+		{
+			/* the db ids of the nodes are going to be the ones of these tables */
+			_zak_autho_journal_reset (zak_autho, NULL, NULL);
+		}
+
+	error = NULL;
+	in_trans = gda_connection_begin_transaction (gdacon, "zak_autho-save-to-db", 0, &error);
+	if (!in_trans)
+		{
+			g_warning ("Error on starting transaction: %s",
+			           error != NULL && error->message != NULL ? error->message : "No details");
+			g_clear_error (&error);
+		}
+
+	parser = gda_connection_create_parser (gdacon);
+	if (parser == NULL)
+		{
+			parser = gda_sql_parser_new ();
+		}
+
+	if (incremental)
 		{
-			g_warning ("Error on deleting roles_parents table content: %s",
-			           error->message != NULL ? error->message : "No details");
+			ret = _zak_autho_db_save_journal (zak_autho, gdacon, parser, prefix, &error);
 		}
-	error = NULL;
-	sql = g_strdup_printf ("DELETE FROM %sresources", table_prefix);
-	gda_connection_execute_non_select_command (gdacon, sql, &error);
-	g_free (sql);
-	if (error != NULL)
+	else
 		{
-			g_warning ("Error on deleting resources table content: %s",
-			           error->message != NULL ? error->message : "No details");
+			ret = _zak_autho_db_save_all (zak_autho, gdacon, parser, prefix, replace, &error);
 		}
-	error = NULL;
-	sql = g_strdup_printf ("DELETE FROM %sresources_parents", table_prefix);
-	gda_connection_execute_non_select_command (gdacon, sql, &error);
-	g_free (sql);
-	if (error != NULL)
+
+	if (!ret)
 		{
-			g_warning ("Error on deleting resources_parents table content: %s",
-			           error->message != NULL ? error->message : "No details");
+			g_warning ("Error on saving to the database: %s",
+			           error != NULL && error->message != NULL ? error->message : "no details");
+			g_clear_error (&error);
 		}
-	error = NULL;
-	sql = g_strdup_printf ("DELETE FROM %srules", table_prefix);
-	gda_connection_execute_non_select_command (gdacon, sql, &error);
-	g_free (sql);
-	if (error != NULL)
+
+	if (in_trans)
 		{
-			g_warning ("Error on deleting rules table content: %s",
-			           error->message != NULL ? error->message : "No details");
+			if (ret && !gda_connection_commit_transaction (gdacon, "zak_autho-save-to-db", &error))
+				{
+					g_warning ("Error on committing transaction: %s",
+					           error != NULL && error->message != NULL ? error->message : "No details");
+					g_clear_error (&error);
+					ret = FALSE;
+				}
+			if (!ret)
+				{
+					gda_connection_rollback_transaction (gdacon, "zak_autho-save-to-db", NULL);
+				}
 		}
 
+	if (ret && incremental)
+		{
+			g_hash_table_remove_all (priv->journal);
+		}
+	else if (ret && replace)
+		{
+			_zak_autho_journal_reset (zak_autho, gdacon, prefix);
+		}
+	else if (!ret && !in_trans)
+		{
+			/* part of it could have been written */
+			_zak_autho_journal_reset (zak_autho, NULL, NULL);
+		}
+
+	g_object_unref (parser);
+	g_free (prefix);
+
+	g_rec_mutex_unlock (&priv->mutex);
+
 	return ret;
 }
 
-static guint
-_zak_autho_find_new_table_id (GdaConnection *gdacon, const gchar *table_name)
+/* @own_transaction is FALSE on the reload thread: the connection is the
+ * application's, that may be using it meanwhile */
+static gboolean
+_zak_autho_load_from_db (ZakAutho *zak_autho, GdaConnection *gdacon, const gchar *table_prefix, gboolean replace, gboolean own_transaction)
 {
+	ZakAuthoPrivate *priv;
+
+	gboolean ret;
+
+	gchar *prefix;
+
 	gchar *sql;
 	GError *error;
+	GdaSqlParser *parser;
 	GdaDataModel *dm;
+	GdaDataModelIter *iter;
+	gboolean in_trans;
+	gboolean begun;
+
+	const GValue *gval;
+	const gchar *role_id;
+	const gchar *resource_id;
+	guint rule_type;
+
+	/* the tables refer to roles and resources by db id */
+	GHashTable *roles_by_db_id;
+	GHashTable *resources_by_db_id;
+
+	Role *role;
+	Role *role_parent;
+	Resource *resource;
+	Resource *resource_parent;
+	gboolean same_as_db;
+	gint64 policy_version;
+	gint64 changelog_seq;
+	gint64 changelog_xmin;
+
+	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
 
-	guint new_id;
+	g_rec_mutex_lock (&priv->mutex);
 
+	priv->on_loading = TRUE;
+
+	ret = TRUE;
+
+	priv->load_rows = 0;
+
+	if (replace)
+		{
+			/* clearing current authorizations */
+			zak_autho_clear (zak_autho);
+		}
+	else
+		{
+			_zak_autho_materialize (zak_autho);
+		}
+
+	/* only a policy made of just the tables is the same as them */
+	same_as_db = priv->roles_idx->len == 0
+	             && priv->resources_idx->len == 0
+	             && g_hash_table_size (priv->rules) == 0;
+	_zak_autho_journal_reset (zak_autho, NULL, NULL);
+
+	if (table_prefix == NULL)
+		{
+			prefix = g_strdup ("");
+		}
+	else
+		{
+			prefix = g_strstrip (g_strdup (table_prefix));
+		}
+
+	/* what changes from now on is seen by the next check */
+	policy_version = _zak_autho_db_policy_version (gdacon, prefix);
+	/* what is logged from now on, or by the transactions running now, is
+	 * applied by the next reload */
+	changelog_xmin = _zak_autho_db_txid_xmin (gdacon);
+	changelog_seq = changelog_xmin < 0 ? 0 : _zak_autho_db_changelog_seq (gdacon, prefix);
+
+	/* the tables all at the same point, in the caller's transaction or
+	 * in one of its own; without, they're just read one after the other,
+	 * each one whole */
+	in_trans = FALSE;
+	begun = FALSE;
+	if (own_transaction)
+		{
+			in_trans = gda_connection_get_transaction_status (gdacon) != NULL;
+			if (!in_trans)
+				{
+					begun = gda_connection_begin_transaction (gdacon, "zak_autho-load-from-db", GDA_TRANSACTION_ISOLATION_REPEATABLE_READ, NULL);
+					in_trans = begun;
+				}
+		}
+
+	parser = gda_connection_create_parser (gdacon);
+	if (parser == NULL)
+		{
+			parser = gda_sql_parser_new ();
+		}
+
+	roles_by_db_id = g_hash_table_new (g_direct_hash, g_direct_equal);
+	resources_by_db_id = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+	/* roles */
 	error = NULL;
-	sql = g_strdup_printf ("SELECT COALESCE (MAX (id), 0) FROM %s",
-	                       table_name);
-	dm = gda_connection_execute_select_command (gdacon, sql, &error);
+	sql = g_strdup_printf ("SELECT role_id, id FROM %sroles ORDER BY id",
+	                       prefix);
+	dm = _zak_autho_db_select (gdacon, parser, sql, in_trans, &error);
 	g_free (sql);
-	if (dm != NULL && gda_data_model_get_n_rows (dm) == 1)
+	if (dm != NULL)
 		{
-			new_id = g_value_get_int (gda_data_model_get_value_at (dm, 0, 0, &error));
-			new_id++;
+			iter = gda_data_model_create_iter (dm);
+			while (gda_data_model_iter_move_next (iter))
+				{
+					priv->load_rows++;
+
+					role_id = _zak_autho_db_value_get_string (gda_data_model_iter_get_value_at (iter, 0));
+					zak_autho_add_role (zak_autho, ZAK_AUTHO_IROLE (zak_autho_role_new (role_id)));
+
+					role = g_hash_table_lookup (priv->roles, role_id);
+					if (role != NULL)
+						{
+							role->db_id = g_value_get_int (gda_data_model_iter_get_value_at (iter, 1));
+							g_hash_table_insert (roles_by_db_id, GUINT_TO_POINTER (role->db_id), role);
+						}
+				}
+			g_object_unref (iter);
+			g_object_unref (dm);
 		}
-	else if (dm == NULL || error != NULL)
+	else
 		{
-			new_id = 0;
-			g_warning ("Problem on getting new id from table «%s»: %s",
-			           error->message != NULL ? error->message : "no details");
+			same_as_db = FALSE;
+			g_warning ("Error on reading table «%sroles»: %s",
+			           prefix,
+			           error != NULL && error->message != NULL ? error->message : "no details");
+			g_clear_error (&error);
+		}
+
+	/* roles parents */
+	sql = g_strdup_printf ("SELECT id_roles, id_roles_parent"
+	                       " FROM %sroles_parents"
+	                       " ORDER BY id_roles, id_roles_parent",
+	                       prefix);
+	dm = _zak_autho_db_select (gdacon, parser, sql, in_trans, &error);
+	g_free (sql);
+	if (dm != NULL)
+		{
+			iter = gda_data_model_create_iter (dm);
+			while (gda_data_model_iter_move_next (iter))
+				{
+					priv->load_rows++;
+
+					role = g_hash_table_lookup (roles_by_db_id,
+					                            GUINT_TO_POINTER (_zak_autho_db_value_get_int64 (gda_data_model_iter_get_value_at (iter, 0))));
+					role_parent = g_hash_table_lookup (roles_by_db_id,
+					                                   GUINT_TO_POINTER (_zak_autho_db_value_get_int64 (gda_data_model_iter_get_value_at (iter, 1))));
+					if (role == NULL || role_parent == NULL)
+						{
+							continue;
+						}
+					if (role == role_parent)
+						{
+							g_warning ("The parent cannot be himself (%s).", zak_autho_irole_peek_role_id (role->irole));
+						}
+					else
+						{
+							role->parents = g_list_append (role->parents, role_parent);
+						}
+				}
+			g_object_unref (iter);
+			g_object_unref (dm);
 		}
 	else
 		{
-			new_id = 1;
+			same_as_db = FALSE;
+			g_warning ("Error on reading table «%sroles_parents»: %s",
+			           prefix,
+			           error != NULL && error->message != NULL ? error->message : "no details");
+			g_clear_error (&error);
 		}
-	g_object_unref (dm);
 
-	return new_id;
+	/* resources */
+	sql = g_strdup_printf ("SELECT resource_id, id FROM %sresources ORDER BY id",
+	                       prefix);
+	dm = _zak_autho_db_select (gdacon, parser, sql, in_trans, &error);
+	g_free (sql);
+	if (dm != NULL)
+		{
+			iter = gda_data_model_create_iter (dm);
+			while (gda_data_model_iter_move_next (iter))
+				{
+					priv->load_rows++;
+
+					resource_id = _zak_autho_db_value_get_string (gda_data_model_iter_get_value_at (iter, 0));
+					zak_autho_add_resource (zak_autho, ZAK_AUTHO_IRESOURCE (zak_autho_resource_new (resource_id)));
+
+					resource = g_hash_table_lookup (priv->resources, resource_id);
+					if (resource != NULL)
+						{
+							resource->db_id = g_value_get_int (gda_data_model_iter_get_value_at (iter, 1));
+							g_hash_table_insert (resources_by_db_id, GUINT_TO_POINTER (resource->db_id), resource);
+						}
+				}
+			g_object_unref (iter);
+			g_object_unref (dm);
+		}
+	else
+		{
+			same_as_db = FALSE;
+			g_warning ("Error on reading table «%sresources»: %s",
+			           prefix,
+			           error != NULL && error->message != NULL ? error->message : "no details");
+			g_clear_error (&error);
+		}
+
+	/* resources parents */
+	sql = g_strdup_printf ("SELECT id_resources, id_resources_parent"
+	                       " FROM %sresources_parents"
+	                       " ORDER BY id_resources, id_resources_parent",
+	                       prefix);
+	dm = _zak_autho_db_select (gdacon, parser, sql, in_trans, &error);
+	g_free (sql);
+	if (dm != NULL)
+		{
+			iter = gda_data_model_create_iter (dm);
+			while (gda_data_model_iter_move_next (iter))
+				{
+					priv->load_rows++;
+
+					resource = g_hash_table_lookup (resources_by_db_id,
+					                                GUINT_TO_POINTER (_zak_autho_db_value_get_int64 (gda_data_model_iter_get_value_at (iter, 0))));
+					resource_parent = g_hash_table_lookup (resources_by_db_id,
+					                                       GUINT_TO_POINTER (_zak_autho_db_value_get_int64 (gda_data_model_iter_get_value_at (iter, 1))));
+					if (resource == NULL || resource_parent == NULL)
+						{
+							continue;
+						}
+					if (resource == resource_parent)
+						{
+							g_warning ("The parent cannot be himself (%s).", zak_autho_iresource_peek_resource_id (resource->iresource));
+						}
+					else
+						{
+							resource->parents = g_list_append (resource->parents, resource_parent);
+						}
+				}
+			g_object_unref (iter);
+			g_object_unref (dm);
+		}
+	else
+		{
+			same_as_db = FALSE;
+			g_warning ("Error on reading table «%sresources_parents»: %s",
+			           prefix,
+			           error != NULL && error->message != NULL ? error->message : "no details");
+			g_clear_error (&error);
+		}
+
+	/* rules */
+	sql = g_strdup_printf ("SELECT type, id_roles, id_resources"
+	                       " FROM %srules",
+	                       prefix);
+	dm = _zak_autho_db_select (gdacon, parser, sql, in_trans, &error);
+	g_free (sql);
+	if (dm != NULL)
+		{
+			iter = gda_data_model_create_iter (dm);
+			while (gda_data_model_iter_move_next (iter))
+				{
+					priv->load_rows++;
+
+					role = g_hash_table_lookup (roles_by_db_id,
+					                            GUINT_TO_POINTER (_zak_autho_db_value_get_int64 (gda_data_model_iter_get_value_at (iter, 1))));
+					if (role == NULL)
+						{
+							continue;
+						}
+					/* a resource not found (or NULL) is every resource */
+					resource = g_hash_table_lookup (resources_by_db_id,
+					                                GUINT_TO_POINTER (_zak_autho_db_value_get_int64 (gda_data_model_iter_get_value_at (iter, 2))));
+
+					gval = gda_data_model_iter_get_value_at (iter, 0);
+					if (!gda_value_is_null (gval))
+						{
+							rule_type = g_value_get_int (gval);
+							if (rule_type == ZAK_AUTHO_RULE_ALLOW
+							    || rule_type == ZAK_AUTHO_RULE_DENY)
+								{
+									_zak_autho_add_rule (zak_autho, role, resource, rule_type);
+								}
+							else
+								{
+									g_warning ("Rule type %d not admitted", rule_type);
+								}
+						}
+				}
+			g_object_unref (iter);
+			g_object_unref (dm);
+		}
+	else
+		{
+			same_as_db = FALSE;
+			g_warning ("Error on reading table «%srules»: %s",
+			           prefix,
+			           error != NULL && error->message != NULL ? error->message : "no details");
+			g_clear_error (&error);
+		}
+
+	if (begun)
+		{
+			/* nothing written: it just ends */
+			error = NULL;
+			if (!gda_connection_commit_transaction (gdacon, "zak_autho-load-from-db", &error))
+				{
+					g_warning ("Error on committing transaction: %s",
+					           error != NULL && error->message != NULL ? error->message : "no details");
+					g_clear_error (&error);
+					gda_connection_rollback_transaction (gdacon, "zak_autho-load-from-db", NULL);
+					ret = FALSE;
+				}
+		}
+	g_object_unref (parser);
+	g_hash_table_destroy (roles_by_db_id);
+	g_hash_table_destroy (resources_by_db_id);
+
+	if (same_as_db)
+		{
+			/* the parents dropped below are deleted by the next save */
+			_zak_autho_journal_reset (zak_autho, gdacon, prefix);
+		}
+
+	g_free (prefix);
+
+	priv->policy_version = policy_version;
+	priv->changelog_seq = changelog_seq;
+	priv->changelog_xmin = changelog_xmin;
+
+	_zak_autho_break_cycles (zak_autho, TRUE);
+	_zak_autho_break_cycles (zak_autho, FALSE);
+
+	_zak_autho_policy_changed (zak_autho);
+
+	priv->on_loading = FALSE;
+
+	/* readers switch to the new policy all at once */
+	_zak_autho_snapshot_publish (zak_autho);
+
+	g_rec_mutex_unlock (&priv->mutex);
+
+	return ret;
 }
 
-static guint
-_zak_autho_get_role_id_db (GdaConnection *gdacon, const gchar *table_name, const gchar *role_id)
+/**
+ * zak_autho_load_from_db:
+ * @zak_autho: an #ZakAutho object.
+ * @gdacon:
+ * @table_prefix:
+ * @replace:
+ *
+ */
+gboolean
+zak_autho_load_from_db (ZakAutho *zak_autho, GdaConnection *gdacon, const gchar *table_prefix, gboolean replace)
 {
-	gchar *sql;
-	GError *error;
-	GdaDataModel *dm;
+	g_return_val_if_fail (IS_ZAK_AUTHO (zak_autho), FALSE);
+	g_return_val_if_fail (GDA_IS_CONNECTION (gdacon), FALSE);
 
-	guint id;
+	return _zak_autho_load_from_db (zak_autho, gdacon, table_prefix, replace, TRUE);
+}
+
+gboolean
+zak_autho_load_from_db_with_monitor (ZakAutho *zak_autho, GdaConnection *gdacon, const gchar *table_prefix, gboolean replace)
+{
+	gboolean ret;
 
-	id = 0;
+	ZakAuthoPrivate *priv;
 
-	error = NULL;
-	sql = g_strdup_printf ("SELECT id FROM %s"
-	                       " WHERE role_id = '%s'",
-	                       table_name,
-	                       role_id);
-	dm = gda_connection_execute_select_command (gdacon, sql, &error);
-	g_free (sql);
-	if (dm != NULL && gda_data_model_get_n_rows (dm) == 1)
+	g_return_val_if_fail (IS_ZAK_AUTHO (zak_autho), FALSE);
+	g_return_val_if_fail (GDA_IS_CONNECTION (gdacon), FALSE);
+
+	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
+
+	g_rec_mutex_lock (&priv->mutex);
+
+	priv->gdacon = gdacon;
+	if (priv->version_stmt != NULL)
 		{
-			id = g_value_get_int (gda_data_model_get_value_at (dm, 0, 0, &error));
+			g_object_unref (priv->version_stmt);
+			priv->version_stmt = NULL;
 		}
-	else if (error != NULL)
+	if (priv->table_prefix != NULL)
 		{
-			g_warning ("Problem on getting role id from table «%s»: %s",
-			           error->message != NULL ? error->message : "no details");
+			g_free (priv->table_prefix);
 		}
-	g_object_unref (dm);
+	if (table_prefix == NULL)
+		{
+			priv->table_prefix = g_strdup ("");
+		}
+	else
+		{
+			priv->table_prefix = g_strdup (table_prefix);
+		}
+
+	ret = zak_autho_load_from_db (zak_autho, gdacon, table_prefix, replace);
+
+	g_rec_mutex_unlock (&priv->mutex);
 
-	return id;
+	return ret;
 }
 
-static guint
-_zak_autho_get_resource_id_db (GdaConnection *gdacon, const gchar *table_name, const gchar *resource_id)
+/* called with the policy locked: @zak_autho gets the policy of @loaded,
+ * @loaded the old one */
+static void
+_zak_autho_take_policy (ZakAutho *zak_autho, ZakAutho *loaded)
 {
-	gchar *sql;
-	GError *error;
-	GdaDataModel *dm;
-
-	guint id;
+	GHashTable *table;
+	GPtrArray *array;
+	GdaConnection *gdacon;
+	gchar *str;
 
-	id = 0;
+	ZakAuthoPrivate *priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
+	ZakAuthoPrivate *loaded_priv = ZAK_AUTHO_GET_PRIVATE (loaded);
 
-	error = NULL;
-	sql = g_strdup_printf ("SELECT id FROM %s"
-	                       " WHERE resource_id = '%s'",
-	                       table_name,
-	                       resource_id);
-	dm = gda_connection_execute_select_command (gdacon, sql, &error);
-	g_free (sql);
-	if (dm != NULL && gda_data_model_get_n_rows (dm) == 1)
-		{
-			id = g_value_get_int (gda_data_model_get_value_at (dm, 0, 0, &error));
-		}
-	else if (error != NULL)
+	if (priv->mapped_snapshot != NULL)
 		{
-			g_warning ("Problem on getting resource id from table «%s»: %s",
-			           error->message != NULL ? error->message : "no details");
+			_zak_autho_snapshot_unref (priv->mapped_snapshot);
+			priv->mapped_snapshot = NULL;
 		}
-	g_object_unref (dm);
 
-	return id;
+	table = priv->roles;
+	priv->roles = loaded_priv->roles;
+	loaded_priv->roles = table;
+
+	table = priv->resources;
+	priv->resources = loaded_priv->resources;
+	loaded_priv->resources = table;
+
+	array = priv->roles_idx;
+	priv->roles_idx = loaded_priv->roles_idx;
+	loaded_priv->roles_idx = array;
+
+	array = priv->resources_idx;
+	priv->resources_idx = loaded_priv->resources_idx;
+	loaded_priv->resources_idx = array;
+
+	table = priv->rules;
+	priv->rules = loaded_priv->rules;
+	loaded_priv->rules = table;
+
+	priv->policy_version = loaded_priv->policy_version;
+	priv->changelog_seq = loaded_priv->changelog_seq;
+	priv->changelog_xmin = loaded_priv->changelog_xmin;
+
+	table = priv->journal;
+	priv->journal = loaded_priv->journal;
+	loaded_priv->journal = table;
+	gdacon = priv->journal_gdacon;
+	priv->journal_gdacon = loaded_priv->journal_gdacon;
+	loaded_priv->journal_gdacon = gdacon;
+	str = priv->journal_table_prefix;
+	priv->journal_table_prefix = loaded_priv->journal_table_prefix;
+	loaded_priv->journal_table_prefix = str;
+
+	priv->epoch++;
+	_zak_autho_policy_changed (zak_autho);
+
+	/* readers switch to the new policy all at once */
+	_zak_autho_snapshot_publish (zak_autho);
 }
 
-/**
- * zak_autho_save_to_db:
- * @zak_autho: an #ZakAutho object.
- * @gdacon:
- * @table_prefix:
- * @replace:
- *
- */
-gboolean
-zak_autho_save_to_db (ZakAutho *zak_autho, GdaConnection *gdacon,
-                  const gchar *table_prefix, gboolean replace)
+/* applies the rows of the changelog table after @changelog_seq, the last
+ * one in the policy; FALSE if they can't make the policy the same as the
+ * tables (the log has been cut after it, or something has been removed
+ * that a policy can't lose), then it has to be loaded from scratch.
+ * The seqs are taken on insert, not on commit: a transaction running at
+ * the last read, so from @changelog_xmin on, can have committed rows
+ * before @changelog_seq since. Those are read again, with every row
+ * after them, and applied in order once more; a row gives the same
+ * result however many times it's applied */
+static gboolean
+_zak_autho_load_changes (ZakAutho *zak_autho, GdaConnection *gdacon, const gchar *table_prefix,
+                         gint64 changelog_seq, gint64 changelog_xmin, guint *rows)
 {
-	ZakAuthoPrivate *priv;
+	ZakAuthoPrivate *priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
 
 	gboolean ret;
 
-	gboolean in_trans;
-
 	gchar *prefix;
-
 	gchar *sql;
-	GError *error;
+	GdaDataModel *dm;
+	gint64 policy_version;
+	gint64 xmin;
+	gint64 seq;
+
+	GHashTable *roles_by_db_id;
+	GHashTable *resources_by_db_id;
+	GHashTable *journal;
+	gboolean keep_journal;
+	gboolean locked;
+
+	const gchar *table_name;
+	const gchar *node_id;
+	gboolean insert;
+	guint rule_type;
+	gint64 key;
 
-	GHashTableIter iter;
-	gpointer key, value;
+	guint row;
+	guint n_rows;
+	guint i;
 
 	Role *role;
+	Role *role_parent;
 	Resource *resource;
+	Resource *resource_parent;
 	Rule *rule;
 
-	GList *parent;
-
-	gchar *table_name;
-	gchar *table_name_parent;
-
-	guint new_id;
-	guint id_parent;
-	guint id_roles;
-	guint id_resources;
-
-	g_return_val_if_fail (IS_ZAK_AUTHO (zak_autho), FALSE);
-	g_return_val_if_fail (GDA_IS_CONNECTION (gdacon), FALSE);
-
-	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
-
-	ret = TRUE;
-
-	error = NULL;
-	in_trans = gda_connection_begin_transaction (gdacon, "zak_autho-save-to-db", 0, &error);
-	if (!in_trans)
+	if (changelog_seq <= 0)
 		{
-			g_warning ("Error on starting transaction: %s",
-			           error != NULL && error->message != NULL ? error->message : "No details");
+			return FALSE;
 		}
 
 	if (table_prefix == NULL)
@@ -1718,608 +7675,691 @@ zak_autho_save_to_db (ZakAutho *zak_autho, GdaConnection *gdacon,
 			prefix = g_strstrip (g_strdup (table_prefix));
 		}
 
-	if (replace)
+	/* what changes from now on is seen by the next check */
+	policy_version = _zak_autho_db_policy_version (gdacon, prefix);
+	xmin = _zak_autho_db_txid_xmin (gdacon);
+	if (xmin < 0)
 		{
-			/* deleting table's content */
-			_zak_autho_delete_table_content (gdacon, prefix);
+			g_free (prefix);
+			return FALSE;
 		}
 
-	/* roles */
-	table_name = g_strdup_printf ("%sroles", prefix);
-	table_name_parent = g_strdup_printf ("%s_parents", table_name);
-	g_hash_table_iter_init (&iter, priv->roles);
-	while (g_hash_table_iter_next (&iter, &key, &value))
+	/* the row already seen is there, if the log still has it */
+	sql = g_strdup_printf ("SELECT seq, table_name, operation, id, value, type, id_roles, id_resources, id_parent"
+	                       " FROM %schangelog"
+	                       " WHERE seq >= %" G_GINT64_FORMAT
+	                       " OR seq >= (SELECT MIN (seq) FROM %schangelog WHERE txid >= %" G_GINT64_FORMAT ")"
+	                       " ORDER BY seq",
+	                       prefix,
+	                       changelog_seq,
+	                       prefix,
+	                       changelog_xmin);
+	dm = _zak_autho_db_select_optional (gdacon, sql);
+	g_free (sql);
+	if (dm == NULL)
+		{
+			g_free (prefix);
+			return FALSE;
+		}
+
+	n_rows = gda_data_model_get_n_rows (dm);
+	ret = FALSE;
+	for (row = 0; row < n_rows; row++)
 		{
-			new_id = _zak_autho_find_new_table_id (gdacon, table_name);
-			if (new_id <= 0)
+			seq = _zak_autho_db_value_get_int64 (gda_data_model_get_value_at (dm, 0, row, NULL));
+			if (seq >= changelog_seq)
 				{
-					ret = FALSE;
+					ret = seq == changelog_seq;
 					break;
 				}
+		}
 
-			role = (Role *)value;
-
-			error = NULL;
-			sql = g_strdup_printf ("INSERT INTO %s"
-			                       " (id, role_id)"
-			                       " VALUES (%d, '%s')",
-			                       table_name,
-			                       new_id,
-			                       zak_autho_irole_get_role_id (ZAK_AUTHO_IROLE (role->irole)));
-			gda_connection_execute_non_select_command (gdacon, sql, &error);
-			g_free (sql);
-			if (error != NULL)
+	/* roles and resources can't be removed from a policy */
+	for (row = 0; ret && row < n_rows; row++)
+		{
+			table_name = g_value_get_string (gda_data_model_get_value_at (dm, 1, row, NULL));
+			if (g_strcmp0 (g_value_get_string (gda_data_model_get_value_at (dm, 2, row, NULL)), "I") != 0
+			    && (g_strcmp0 (table_name, "roles") == 0
+			        || g_strcmp0 (table_name, "resources") == 0))
 				{
-					g_warning ("Error on saving role «%s»: %s",
-					           zak_autho_irole_get_role_id (ZAK_AUTHO_IROLE (role->irole)),
-					           error->message != NULL ? error->message : "no details");
-					continue;
+					ret = FALSE;
 				}
+		}
 
-			parent = role->parents;
-			while (parent != NULL)
-				{
-					role = (Role *)parent->data;
-
-					id_parent = _zak_autho_get_role_id_db (gdacon, table_name, zak_autho_irole_get_role_id (ZAK_AUTHO_IROLE (role->irole)));
-					if (id_parent > 0)
-						{
-							error = NULL;
-							sql = g_strdup_printf ("INSERT INTO %s"
-							                       " (id_roles, id_roles_parent)"
-							                       " VALUES (%d, %d)",
-							                       table_name_parent,
-							                       new_id,
-							                       id_parent);
-							gda_connection_execute_non_select_command (gdacon, sql, &error);
-							g_free (sql);
-							if (error != NULL)
-								{
-									g_warning ("Error on saving role parent «%s»: %s",
-									           zak_autho_irole_get_role_id (ZAK_AUTHO_IROLE (role->irole)),
-									           error->message != NULL ? error->message : "no details");
-									continue;
-								}
-						}
-					else
-						{
-							g_warning ("Unable to find parent role «%s»",
-							           zak_autho_irole_get_role_id (ZAK_AUTHO_IROLE (role->irole)));
-						}
-
-					parent = g_list_next (parent);
-				}
+	locked = ret;
+	if (ret)
+		{
+			g_rec_mutex_lock (&priv->mutex);
 		}
 
-	if (!ret)
+	if (ret
+	    && (priv->changelog_seq != changelog_seq
+	        || priv->changelog_xmin != changelog_xmin))
 		{
-			g_warning ("Unable to save roles");
+			/* somebody loaded the policy meanwhile: it's up to date */
+			*rows = 0;
 		}
+	else if (ret)
+		{
+			_zak_autho_materialize (zak_autho);
 
-	ret = TRUE;
+			priv->on_loading = TRUE;
 
-	/* resources */
-	table_name = g_strdup_printf ("%sresources", prefix);
-	table_name_parent = g_strdup_printf ("%s_parents", table_name);
-	g_hash_table_iter_init (&iter, priv->resources);
-	while (g_hash_table_iter_next (&iter, &key, &value))
-		{
-			new_id = _zak_autho_find_new_table_id (gdacon, table_name);
-			if (new_id <= 0)
+			/* the changes are already in the database: not to be saved,
+			 * and they may be what was waiting to be saved to it */
+			journal = priv->journal;
+			priv->journal = NULL;
+			keep_journal = journal != NULL
+			               && priv->journal_gdacon == gdacon
+			               && g_strcmp0 (priv->journal_table_prefix, prefix) == 0;
+
+			roles_by_db_id = g_hash_table_new (g_direct_hash, g_direct_equal);
+			for (i = 0; i < priv->roles_idx->len; i++)
 				{
-					ret = FALSE;
-					break;
+					role = (Role *)g_ptr_array_index (priv->roles_idx, i);
+					if (role->db_id != 0)
+						{
+							g_hash_table_insert (roles_by_db_id, GUINT_TO_POINTER (role->db_id), role);
+						}
 				}
-
-			resource = (Resource *)value;
-
-			error = NULL;
-			sql = g_strdup_printf ("INSERT INTO %s"
-			                       " (id, resource_id)"
-			                       " VALUES (%d, '%s')",
-			                       table_name,
-			                       new_id,
-			                       zak_autho_iresource_get_resource_id (ZAK_AUTHO_IRESOURCE (resource->iresource)));
-			gda_connection_execute_non_select_command (gdacon, sql, &error);
-			g_free (sql);
-			if (error != NULL)
+			resources_by_db_id = g_hash_table_new (g_direct_hash, g_direct_equal);
+			for (i = 0; i < priv->resources_idx->len; i++)
 				{
-					g_warning ("Error on saving resource «%s»: %s",
-					           zak_autho_iresource_get_resource_id (ZAK_AUTHO_IRESOURCE (resource->iresource)),
-					           error->message != NULL ? error->message : "no details");
-					continue;
+					resource = (Resource *)g_ptr_array_index (priv->resources_idx, i);
+					if (resource->db_id != 0)
+						{
+							g_hash_table_insert (resources_by_db_id, GUINT_TO_POINTER (resource->db_id), resource);
+						}
 				}
 
-			parent = resource->parents;
-			while (parent != NULL)
+			for (row = 0; row < n_rows; row++)
 				{
-					resource = (Resource *)parent->data;
+					table_name = g_value_get_string (gda_data_model_get_value_at (dm, 1, row, NULL));
+					insert = g_strcmp0 (g_value_get_string (gda_data_model_get_value_at (dm, 2, row, NULL)), "I") == 0;
 
-					id_parent = _zak_autho_get_resource_id_db (gdacon, table_name, zak_autho_iresource_get_resource_id (ZAK_AUTHO_IRESOURCE (resource->iresource)));
-					if (id_parent > 0)
-						{
-							error = NULL;
-							sql = g_strdup_printf ("INSERT INTO %s"
-							                       " (id_resources, id_resources_parent)"
-							                       " VALUES (%d, %d)",
-							                       table_name_parent,
-							                       new_id,
-							                       id_parent);
-							gda_connection_execute_non_select_command (gdacon, sql, &error);
-							g_free (sql);
-							if (error != NULL)
+					if (g_strcmp0 (table_name, "roles") == 0)
+						{
+							node_id = g_value_get_string (gda_data_model_get_value_at (dm, 4, row, NULL));
+							role = g_hash_table_lookup (priv->roles, node_id);
+							if (role == NULL)
+								{
+									zak_autho_add_role (zak_autho, ZAK_AUTHO_IROLE (zak_autho_role_new (node_id)));
+									role = g_hash_table_lookup (priv->roles, node_id);
+								}
+							role->db_id = _zak_autho_db_value_get_int64 (gda_data_model_get_value_at (dm, 3, row, NULL));
+							g_hash_table_insert (roles_by_db_id, GUINT_TO_POINTER (role->db_id), role);
+							if (keep_journal)
 								{
-									g_warning ("Error on saving resource parent «%s»: %s",
-									           zak_autho_iresource_get_resource_id (ZAK_AUTHO_IRESOURCE (resource->iresource)),
-									           error->message != NULL ? error->message : "no details");
-									continue;
+									_zak_autho_journal_forget (journal, ZAK_AUTHO_JOURNAL_ROLE, role->idx, 0, 0);
 								}
 						}
-					else
+					else if (g_strcmp0 (table_name, "resources") == 0)
 						{
-							g_warning ("Unable to find parent resource «%s»",
-							           zak_autho_iresource_get_resource_id (ZAK_AUTHO_IRESOURCE (resource->iresource)));
+							node_id = g_value_get_string (gda_data_model_get_value_at (dm, 4, row, NULL));
+							resource = g_hash_table_lookup (priv->resources, node_id);
+							if (resource == NULL)
+								{
+									zak_autho_add_resource (zak_autho, ZAK_AUTHO_IRESOURCE (zak_autho_resource_new (node_id)));
+									resource = g_hash_table_lookup (priv->resources, node_id);
+								}
+							resource->db_id = _zak_autho_db_value_get_int64 (gda_data_model_get_value_at (dm, 3, row, NULL));
+							g_hash_table_insert (resources_by_db_id, GUINT_TO_POINTER (resource->db_id), resource);
+							if (keep_journal)
+								{
+									_zak_autho_journal_forget (journal, ZAK_AUTHO_JOURNAL_RESOURCE, resource->idx, 0, 0);
+								}
 						}
-
-					parent = g_list_next (parent);
-				}
-		}
-
-	if (!ret)
-		{
-			g_warning ("Unable to save resources");
-		}
-
-	/* rules allow */
-	table_name = g_strdup_printf ("%srules", prefix);
-	table_name_parent = g_strdup_printf ("%s_parents", table_name);
-	g_hash_table_iter_init (&iter, priv->rules_allow);
-	while (g_hash_table_iter_next (&iter, &key, &value))
-		{
-			new_id = _zak_autho_find_new_table_id (gdacon, table_name);
-			if (new_id <= 0)
-				{
-					ret = FALSE;
-					break;
-				}
-
-			rule = (Rule *)value;
-
-			id_roles = _zak_autho_get_role_id_db (gdacon, g_strdup_printf ("%sroles", prefix), zak_autho_irole_get_role_id (ZAK_AUTHO_IROLE (rule->role->irole)));
-			if (id_roles > 0)
-				{
-					if (rule->resource != NULL)
+					else if (g_strcmp0 (table_name, "roles_parents") == 0)
 						{
-							id_resources = _zak_autho_get_resource_id_db (gdacon, g_strdup_printf ("%sresources", prefix), zak_autho_iresource_get_resource_id (ZAK_AUTHO_IRESOURCE (rule->resource->iresource)));
+							role = g_hash_table_lookup (roles_by_db_id,
+							                            GUINT_TO_POINTER (_zak_autho_db_value_get_int64 (gda_data_model_get_value_at (dm, 6, row, NULL))));
+							role_parent = g_hash_table_lookup (roles_by_db_id,
+							                                   GUINT_TO_POINTER (_zak_autho_db_value_get_int64 (gda_data_model_get_value_at (dm, 8, row, NULL))));
+							if (role != NULL && role_parent != NULL && role != role_parent)
+								{
+									if (!insert)
+										{
+											role->parents = g_list_remove (role->parents, role_parent);
+										}
+									else if (g_list_find (role->parents, role_parent) == NULL)
+										{
+											role->parents = g_list_append (role->parents, role_parent);
+										}
+									if (keep_journal)
+										{
+											_zak_autho_journal_forget (journal, ZAK_AUTHO_JOURNAL_ROLE_PARENT, role->idx, role_parent->idx, 0);
+										}
+								}
 						}
-					else
+					else if (g_strcmp0 (table_name, "resources_parents") == 0)
 						{
-							id_resources = 0;
+							resource = g_hash_table_lookup (resources_by_db_id,
+							                                GUINT_TO_POINTER (_zak_autho_db_value_get_int64 (gda_data_model_get_value_at (dm, 7, row, NULL))));
+							resource_parent = g_hash_table_lookup (resources_by_db_id,
+							                                       GUINT_TO_POINTER (_zak_autho_db_value_get_int64 (gda_data_model_get_value_at (dm, 8, row, NULL))));
+							if (resource != NULL && resource_parent != NULL && resource != resource_parent)
+								{
+									if (!insert)
+										{
+											resource->parents = g_list_remove (resource->parents, resource_parent);
+										}
+									else if (g_list_find (resource->parents, resource_parent) == NULL)
+										{
+											resource->parents = g_list_append (resource->parents, resource_parent);
+										}
+									if (keep_journal)
+										{
+											_zak_autho_journal_forget (journal, ZAK_AUTHO_JOURNAL_RESOURCE_PARENT, resource->idx, resource_parent->idx, 0);
+										}
+								}
 						}
-
-					error = NULL;
-					sql = g_strdup_printf ("INSERT INTO %s"
-					                       " (id, type, id_roles, id_resources)"
-					                       " VALUES (%d, 1, %d, %d)",
-					                       table_name,
-					                       new_id,
-					                       id_roles,
-					                       id_resources);
-					gda_connection_execute_non_select_command (gdacon, sql, &error);
-					g_free (sql);
-					if (error != NULL)
+					else if (g_strcmp0 (table_name, "rules") == 0)
 						{
-							g_warning ("Error on saving rule: %s",
-							           error->message != NULL ? error->message : "no details");
+							rule_type = _zak_autho_db_value_get_int64 (gda_data_model_get_value_at (dm, 5, row, NULL));
+							role = g_hash_table_lookup (roles_by_db_id,
+							                            GUINT_TO_POINTER (_zak_autho_db_value_get_int64 (gda_data_model_get_value_at (dm, 6, row, NULL))));
+							/* like the full load: an unknown resource is every resource */
+							resource = g_hash_table_lookup (resources_by_db_id,
+							                                GUINT_TO_POINTER (_zak_autho_db_value_get_int64 (gda_data_model_get_value_at (dm, 7, row, NULL))));
+							if (rule_type != ZAK_AUTHO_RULE_ALLOW
+							    && rule_type != ZAK_AUTHO_RULE_DENY)
+								{
+									g_warning ("Rule type %d not admitted", rule_type);
+								}
+							else if (role != NULL)
+								{
+									if (insert)
+										{
+											_zak_autho_add_rule (zak_autho, role, resource, rule_type);
+										}
+									else
+										{
+											key = (gint64)ZAK_AUTHO_RULE_KEY (role->idx, resource == NULL ? ZAK_AUTHO_RESOURCE_IDX_NULL : resource->idx);
+											rule = (Rule *)g_hash_table_lookup (priv->rules, &key);
+											if (rule != NULL)
+												{
+													rule->type &= ~rule_type;
+													if (rule->type == 0)
+														{
+															g_hash_table_remove (priv->rules, &key);
+														}
+												}
+										}
+									if (keep_journal)
+										{
+											_zak_autho_journal_forget (journal, ZAK_AUTHO_JOURNAL_RULE,
+											                           role->idx, resource == NULL ? ZAK_AUTHO_RESOURCE_IDX_NULL : resource->idx,
+											                           rule_type);
+										}
+								}
 						}
 				}
-		}
 
-	/* rules deny */
-	g_hash_table_iter_init (&iter, priv->rules_deny);
-	while (g_hash_table_iter_next (&iter, &key, &value))
-		{
-			new_id = _zak_autho_find_new_table_id (gdacon, table_name);
-			if (new_id <= 0)
+			g_hash_table_destroy (roles_by_db_id);
+			g_hash_table_destroy (resources_by_db_id);
+
+			priv->journal = journal;
+			if (!keep_journal)
 				{
-					ret = FALSE;
-					break;
+					/* the policy isn't the same as those tables anymore */
+					_zak_autho_journal_reset (zak_autho, NULL, NULL);
 				}
 
-			rule = (Rule *)value;
+			priv->policy_version = policy_version;
+			priv->changelog_seq = _zak_autho_db_value_get_int64 (gda_data_model_get_value_at (dm, 0, n_rows - 1, NULL));
+			priv->changelog_xmin = xmin;
 
-			id_roles = _zak_autho_get_role_id_db (gdacon, g_strdup_printf ("%sroles", prefix), zak_autho_irole_get_role_id (ZAK_AUTHO_IROLE (rule->role->irole)));
-			if (id_roles > 0)
-				{
-					if (rule->resource != NULL)
-						{
-							id_resources = _zak_autho_get_resource_id_db (gdacon, g_strdup_printf ("%sresources", prefix), zak_autho_iresource_get_resource_id (ZAK_AUTHO_IRESOURCE (rule->resource->iresource)));
-						}
-					else
-						{
-							id_resources = 0;
-						}
+			_zak_autho_break_cycles (zak_autho, TRUE);
+			_zak_autho_break_cycles (zak_autho, FALSE);
 
-					error = NULL;
-					sql = g_strdup_printf ("INSERT INTO %s"
-					                       " (id, type, id_roles, id_resources)"
-					                       " VALUES (%d, 2, %d, %d)",
-					                       table_name,
-					                       new_id,
-					                       id_roles,
-					                       id_resources);
-					gda_connection_execute_non_select_command (gdacon, sql, &error);
-					g_free (sql);
-					if (error != NULL)
-						{
-							g_warning ("Error on saving rule: %s",
-							           error->message != NULL ? error->message : "no details");
-						}
-				}
-		}
+			_zak_autho_policy_changed (zak_autho);
 
-	error = NULL;
-	if (in_trans && !gda_connection_commit_transaction (gdacon, "zak_autho-save-to-db", &error))
-		{
-			g_warning ("Error on committing transaction: %s",
-			           error != NULL && error->message != NULL ? error->message : "No details");
+			priv->on_loading = FALSE;
+
+			/* readers switch to the new policy all at once */
+			_zak_autho_snapshot_publish (zak_autho);
+
+			*rows = n_rows;
 		}
-	else
+
+	if (locked)
 		{
-			ret = TRUE;
+			g_rec_mutex_unlock (&priv->mutex);
 		}
 
+	g_object_unref (dm);
+	g_free (prefix);
+
 	return ret;
 }
 
-/**
- * zak_autho_load_from_db:
- * @zak_autho: an #ZakAutho object.
- * @gdacon:
- * @table_prefix:
- * @replace:
- *
- */
-gboolean
-zak_autho_load_from_db (ZakAutho *zak_autho, GdaConnection *gdacon, const gchar *table_prefix, gboolean replace)
+/* the new policy is loaded aside, the checks go on with the current one
+ * till it replaces it */
+static gpointer
+_zak_autho_reload_thread (gpointer data)
 {
+	ZakAutho *zak_autho;
 	ZakAuthoPrivate *priv;
 
-	gboolean ret;
+	ZakAutho *loaded;
+	GdaConnection *gdacon;
+	gchar *table_prefix;
+	gint64 changelog_seq;
+	gint64 changelog_xmin;
+	gint64 start;
+	guint rows;
 
-	gchar *prefix;
+	zak_autho = (ZakAutho *)data;
+	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
 
-	gchar *sql;
+	start = g_get_monotonic_time ();
+
+	g_rec_mutex_lock (&priv->mutex);
+	gdacon = g_object_ref (priv->gdacon);
+	table_prefix = g_strdup (priv->table_prefix);
+	changelog_seq = priv->changelog_seq;
+	changelog_xmin = priv->changelog_xmin;
+	g_rec_mutex_unlock (&priv->mutex);
+
+	/* just what changed, if the changelog table tells it */
+	if (!_zak_autho_load_changes (zak_autho, gdacon, table_prefix, changelog_seq, changelog_xmin, &rows))
+		{
+			loaded = zak_autho_new ();
+			_zak_autho_load_from_db (loaded, gdacon, table_prefix, TRUE, FALSE);
+			rows = ZAK_AUTHO_GET_PRIVATE (loaded)->load_rows;
+
+			g_rec_mutex_lock (&priv->mutex);
+			_zak_autho_take_policy (zak_autho, loaded);
+			g_rec_mutex_unlock (&priv->mutex);
+
+			g_object_unref (loaded);
+		}
+	g_object_unref (gdacon);
+	g_free (table_prefix);
+
+	g_atomic_int_set (&priv->reloading, FALSE);
+
+	g_signal_emit (zak_autho, signals[RELOADED], 0, g_get_monotonic_time () - start, rows);
+
+	g_object_unref (zak_autho);
+
+	return NULL;
+}
+
+static void
+_zak_autho_check_updated (ZakAutho *zak_autho)
+{
 	GError *error;
+	gchar *sql;
+	GdaSqlParser *parser;
 	GdaDataModel *dm;
 
 	const GValue *gval;
-	gchar *role_id;
-	gchar *resource_id;
-	guint rule_type;
-
-	ZakAuthoIRole *irole;
-	ZakAuthoIRole *irole_parent;
-	ZakAuthoIResource *iresource;
-	ZakAuthoIResource *iresource_parent;
-	Rule *rule;
-
-	guint row;
-	guint rows;
 
-	g_return_val_if_fail (IS_ZAK_AUTHO (zak_autho), FALSE);
-	g_return_val_if_fail (GDA_IS_CONNECTION (gdacon), FALSE);
+	guint check_interval;
+	guint now;
+	gint check_next;
 
-	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
+	ZakAuthoPrivate *priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
 
-	priv->on_loading = TRUE;
+	g_return_if_fail (IS_ZAK_AUTHO (zak_autho));
 
-	ret = TRUE;
+	if (g_atomic_pointer_get (&priv->gdacon) == NULL
+	    || g_atomic_int_get (&priv->reloading))
+		{
+			/* not monitored, or the new policy is on its way */
+			return;
+		}
 
-	if (replace)
+	/* one caller an interval does the check, the others go on */
+	check_interval = g_atomic_int_get (&priv->check_interval);
+	if (check_interval > 0)
 		{
-			/* clearing current authorizations */
-			zak_autho_clear (zak_autho);
+			now = (guint)((g_get_monotonic_time () - priv->check_base) / 1000);
+			check_next = g_atomic_int_get (&priv->check_next);
+			if ((gint)(now - (guint)check_next) < 0
+			    || !g_atomic_int_compare_and_exchange (&priv->check_next, check_next, (gint)(now + check_interval)))
+				{
+					return;
+				}
 		}
 
-	if (table_prefix == NULL)
+	/* if somebody else is loading, the current snapshot is fine */
+	if (!g_rec_mutex_trylock (&priv->mutex))
 		{
-			prefix = g_strdup ("");
+			return;
 		}
-	else
+
+	if (priv->on_loading
+	    || !GDA_IS_CONNECTION (priv->gdacon))
 		{
-			prefix = g_strstrip (g_strdup (table_prefix));
+			g_rec_mutex_unlock (&priv->mutex);
+			return;
 		}
 
-	/* roles */
 	error = NULL;
-	sql = g_strdup_printf ("SELECT role_id FROM %sroles ORDER BY id",
-	                       prefix);
-	dm = gda_connection_execute_select_command (gdacon, sql, &error);
-	g_free (sql);
-	if (dm != NULL && error == NULL)
+	if (priv->version_stmt == NULL)
+		{
+			parser = gda_connection_create_parser (priv->gdacon);
+			if (parser == NULL)
+				{
+					parser = gda_sql_parser_new ();
+				}
+			sql = g_strdup_printf ("SELECT policy_version FROM %stimestamp_update",
+			                       priv->table_prefix);
+			priv->version_stmt = gda_sql_parser_parse_string (parser, sql, NULL, &error);
+			g_free (sql);
+			g_object_unref (parser);
+		}
+	dm = priv->version_stmt == NULL ? NULL : gda_connection_statement_execute_select (priv->gdacon, priv->version_stmt, NULL, &error);
+	if (dm != NULL && error == NULL && gda_data_model_get_n_rows (dm) > 0)
 		{
-			rows = gda_data_model_get_n_rows (dm);
-			for (row = 0; row < rows; row++)
+			gval = gda_data_model_get_value_at (dm, 0, 0, NULL);
+			if (!gda_value_is_null (gval)
+			    && _zak_autho_db_value_get_int64 (gval) != priv->policy_version
+			    && g_atomic_int_compare_and_exchange (&priv->reloading, FALSE, TRUE))
 				{
-					error = NULL;
-					irole = ZAK_AUTHO_IROLE (zak_autho_role_new (gda_value_stringify (gda_data_model_get_value_at (dm, 0, row, &error))));
-					zak_autho_add_role (zak_autho, irole);
+					/* to reload, without keeping the caller waiting */
+					g_thread_unref (g_thread_new ("zak_autho-reload", _zak_autho_reload_thread, g_object_ref (zak_autho)));
 				}
 		}
 	else if (error != NULL)
 		{
-			g_warning ("Error on reading table «%sroles»: %s",
-			           prefix,
+			g_warning ("Error on reading table «%stimestamp_update»: %s",
+			           priv->table_prefix,
 			           error->message != NULL ? error->message : "no details");
 		}
-	g_object_unref (dm);
+	if (dm != NULL)
+		{
+			g_object_unref (dm);
+		}
+
+	g_rec_mutex_unlock (&priv->mutex);
+}
+
+static gboolean
+_zak_autho_load_xml_file (ZakAutho *zak_autho, GFile *file, GError **error)
+{
+	gboolean ret;
+	GFileInputStream *stream;
+
+	stream = g_file_read (file, NULL, error);
+	if (stream == NULL)
+		{
+			return FALSE;
+		}
+
+	ret = zak_autho_load_from_xml_stream (zak_autho, G_INPUT_STREAM (stream), TRUE, error);
+	g_object_unref (stream);
+
+	return ret;
+}
+
+/* the file is read into a policy aside, that replaces the current one
+ * only if the file is valid */
+static gpointer
+_zak_autho_xml_reload_thread (gpointer data)
+{
+	ZakAutho *zak_autho;
+	ZakAuthoPrivate *priv;
+	ZakAuthoPrivate *loaded_priv;
+
+	ZakAutho *loaded;
+	GFile *file;
+	GError *error;
+	gchar *name;
+	gboolean reloaded;
+	gint64 start;
+	guint rows;
+
+	zak_autho = (ZakAutho *)data;
+	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
+
+	start = g_get_monotonic_time ();
+
+	g_rec_mutex_lock (&priv->mutex);
+	file = g_object_ref (priv->xml_file);
+	g_rec_mutex_unlock (&priv->mutex);
+
+	loaded = zak_autho_new ();
+	loaded_priv = ZAK_AUTHO_GET_PRIVATE (loaded);
 
-	/* roles parents */
 	error = NULL;
-	sql = g_strdup_printf ("SELECT r1.role_id, r2.role_id"
-	                       " FROM %sroles_parents AS rp"
-	                       " INNER JOIN %sroles AS r1 ON rp.id_roles = r1.id"
-	                       " INNER JOIN %sroles AS r2 ON rp.id_roles_parent = r2.id"
-	                       " ORDER BY rp.id_roles, rp.id_roles_parent",
-	                       prefix,
-	                       prefix,
-	                       prefix);
-	dm = gda_connection_execute_select_command (gdacon, sql, &error);
-	g_free (sql);
-	if (dm != NULL && error == NULL)
+	reloaded = _zak_autho_load_xml_file (loaded, file, &error);
+	if (reloaded)
 		{
-			rows = gda_data_model_get_n_rows (dm);
-			for (row = 0; row < rows; row++)
-				{
-					error = NULL;
-					irole = ZAK_AUTHO_IROLE (zak_autho_role_new (gda_value_stringify (gda_data_model_get_value_at (dm, 0, row, &error))));
-					error = NULL;
-					irole_parent = ZAK_AUTHO_IROLE (zak_autho_role_new (gda_value_stringify (gda_data_model_get_value_at (dm, 1, row, &error))));
-					zak_autho_add_parent_to_role (zak_autho, irole, irole_parent);
-				}
+			rows = loaded_priv->roles_idx->len
+			       + loaded_priv->resources_idx->len
+			       + g_hash_table_size (loaded_priv->rules);
+
+			g_rec_mutex_lock (&priv->mutex);
+			_zak_autho_take_policy (zak_autho, loaded);
+			g_rec_mutex_unlock (&priv->mutex);
 		}
-	else if (error != NULL)
+	else
 		{
-			g_warning ("Error on reading table «%sroles_parents»: %s",
-			           prefix,
-			           error->message != NULL ? error->message : "no details");
+			name = g_file_get_parse_name (file);
+			g_warning ("Error on reading «%s», the policy is unchanged: %s",
+			           name,
+			           error != NULL && error->message != NULL ? error->message : "no details");
+			g_free (name);
+			g_clear_error (&error);
 		}
-	g_object_unref (dm);
 
-	/* resources */
-	error = NULL;
-	sql = g_strdup_printf ("SELECT resource_id FROM %sresources ORDER BY id",
-	                       prefix);
-	dm = gda_connection_execute_select_command (gdacon, sql, &error);
-	g_free (sql);
-	if (dm != NULL && error == NULL)
+	g_object_unref (loaded);
+	g_object_unref (file);
+
+	g_atomic_int_set (&priv->reloading, FALSE);
+
+	if (reloaded)
 		{
-			rows = gda_data_model_get_n_rows (dm);
-			for (row = 0; row < rows; row++)
-				{
-					error = NULL;
-					iresource = ZAK_AUTHO_IRESOURCE (zak_autho_resource_new (gda_value_stringify (gda_data_model_get_value_at (dm, 0, row, &error))));
-					zak_autho_add_resource (zak_autho, iresource);
-				}
+			g_signal_emit (zak_autho, signals[RELOADED], 0, g_get_monotonic_time () - start, rows);
 		}
-	else if (error != NULL)
+
+	g_object_unref (zak_autho);
+
+	return NULL;
+}
+
+/* the source holds a reference on zak_autho, dropped when it's destroyed */
+static gboolean
+_zak_autho_xml_reload_timeout (gpointer user_data)
+{
+	ZakAutho *zak_autho = (ZakAutho *)user_data;
+	ZakAuthoPrivate *priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
+
+	GSource *source;
+
+	source = g_main_current_source ();
+
+	g_rec_mutex_lock (&priv->mutex);
+
+	/* replaced or cleared meanwhile */
+	if (g_source_is_destroyed (source))
 		{
-			g_warning ("Error on reading table «%sresources»: %s",
-			           prefix,
-			           error->message != NULL ? error->message : "no details");
+			g_rec_mutex_unlock (&priv->mutex);
+			return G_SOURCE_REMOVE;
 		}
-	g_object_unref (dm);
 
-	/* resources parents */
-	error = NULL;
-	sql = g_strdup_printf ("SELECT r1.resource_id, r2.resource_id"
-	                       " FROM %sresources_parents AS rp"
-	                       " INNER JOIN %sresources AS r1 ON rp.id_resources = r1.id"
-	                       " INNER JOIN %sresources AS r2 ON rp.id_resources_parent = r2.id"
-	                       " ORDER BY rp.id_resources, rp.id_resources_parent",
-	                       prefix,
-	                       prefix,
-	                       prefix);
-	dm = gda_connection_execute_select_command (gdacon, sql, &error);
-	g_free (sql);
-	if (dm != NULL && error == NULL)
+	/* the previous reload is still running: it's tried again later */
+	if (!g_atomic_int_compare_and_exchange (&priv->reloading, FALSE, TRUE))
 		{
-			rows = gda_data_model_get_n_rows (dm);
-			for (row = 0; row < rows; row++)
-				{
-					error = NULL;
-					iresource = ZAK_AUTHO_IRESOURCE (zak_autho_resource_new (gda_value_stringify (gda_data_model_get_value_at (dm, 0, row, &error))));
-					error = NULL;
-					iresource_parent = ZAK_AUTHO_IRESOURCE (zak_autho_resource_new (gda_value_stringify (gda_data_model_get_value_at (dm, 1, row, &error))));
-					zak_autho_add_parent_to_resource (zak_autho, iresource, iresource_parent);
-				}
+			g_rec_mutex_unlock (&priv->mutex);
+			return G_SOURCE_CONTINUE;
 		}
-	else if (error != NULL)
+
+	if (priv->xml_reload_source == source)
 		{
-			g_warning ("Error on reading table «%sresources_parents»: %s",
-			           prefix,
-			           error->message != NULL ? error->message : "no details");
+			g_source_unref (priv->xml_reload_source);
+			priv->xml_reload_source = NULL;
 		}
-	g_object_unref (dm);
 
-	/* rules */
-	error = NULL;
-	sql = g_strdup_printf ("SELECT ru.type, ro.role_id, re.resource_id"
-	                       " FROM %srules AS ru"
-	                       " LEFT JOIN %sroles AS ro ON ru.id_roles = ro.id"
-	                       " LEFT JOIN %sresources AS re ON ru.id_resources = re.id",
-	                       prefix,
-	                       prefix,
-	                       prefix);
-	dm = gda_connection_execute_select_command (gdacon, sql, &error);
-	g_free (sql);
-	if (dm != NULL && error == NULL)
+	g_rec_mutex_unlock (&priv->mutex);
+
+	g_thread_unref (g_thread_new ("zak_autho-xml-reload", _zak_autho_xml_reload_thread, g_object_ref (zak_autho)));
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+_zak_autho_xml_weak_ref_free (gpointer data, GClosure *closure)
+{
+	g_weak_ref_clear ((GWeakRef *)data);
+	g_free (data);
+}
+
+static void
+_zak_autho_xml_file_changed (GFileMonitor *monitor,
+                             GFile *file,
+                             GFile *other_file,
+                             GFileMonitorEvent event_type,
+                             gpointer user_data)
+{
+	ZakAutho *zak_autho;
+	ZakAuthoPrivate *priv;
+
+	switch (event_type)
 		{
-			rows = gda_data_model_get_n_rows (dm);
-			for (row = 0; row < rows; row++)
-				{
-					error = NULL;
-					gval = gda_data_model_get_value_at (dm, 1, row, &error);
-					if (gval == NULL || error != NULL)
-						{
-							g_warning ("Error on reading role_id value: %s",
-							           error != NULL && error->message != NULL ? error->message : "no details");
-						}
-					else if (gval != NULL && error == NULL && !gda_value_is_null (gval))
-						{
-							role_id = gda_value_stringify (gval);
-							irole = zak_autho_get_role_from_id (zak_autho, role_id);
-							if (irole != NULL)
-								{
-									error = NULL;
-									gval = gda_data_model_get_value_at (dm, 2, row, &error);
-									if (gval == NULL || gda_value_is_null (gval))
-										{
-											if (error != NULL)
-												{
-													g_warning ("Error on reading resource value: %s",
-													           error != NULL && error->message != NULL ? error->message : "no details");
-												}
-											iresource = NULL;
-										}
-									else
-										{
-											resource_id = gda_value_stringify (gval);
-											iresource = zak_autho_get_resource_from_id (zak_autho, resource_id);
-										}
+			case G_FILE_MONITOR_EVENT_CHANGED:
+			case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+			case G_FILE_MONITOR_EVENT_CREATED:
+			case G_FILE_MONITOR_EVENT_MOVED_IN:
+			case G_FILE_MONITOR_EVENT_RENAMED:
+				break;
 
-									error = NULL;
-									gval = gda_data_model_get_value_at (dm, 0, row, &error);
-									if (gval == NULL || error != NULL)
-										{
-											g_warning ("Error on reading type value: %s",
-											           error != NULL && error->message != NULL ? error->message : "no details");
-										}
-									else if (gval != NULL && error == NULL && !gda_value_is_null (gval))
-										{
-											rule_type = g_value_get_int (gval);
-											if (rule_type == 1)
-												{
-													zak_autho_allow (zak_autho, irole, iresource);
-												}
-											else if (rule_type == 2)
-												{
-													zak_autho_deny (zak_autho, irole, iresource);
-												}
-											else
-												{
-													g_warning ("Rule type %d not admitted", rule_type);
-												}
-										}
-								}
-						}
-				}
+			default:
+				return;
 		}
-	else if (error != NULL)
+
+	/* the handler can run while the last reference is being dropped in
+	 * another thread */
+	zak_autho = g_weak_ref_get ((GWeakRef *)user_data);
+	if (zak_autho == NULL)
 		{
-			g_warning ("Error on reading table «%srules»: %s",
-			           prefix,
-			           error->message != NULL ? error->message : "no details");
+			return;
 		}
-	g_object_unref (dm);
+	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
 
-	g_free (prefix);
+	g_rec_mutex_lock (&priv->mutex);
 
-	if (priv->gdt_last_load != NULL)
+	/* not watched anymore, or watched by another monitor */
+	if (priv->xml_monitor == monitor)
 		{
-			g_date_time_unref (priv->gdt_last_load);
+			/* a burst of events (the file being written) reloads once,
+			 * after the last one */
+			if (priv->xml_reload_source != NULL)
+				{
+					g_source_destroy (priv->xml_reload_source);
+					g_source_unref (priv->xml_reload_source);
+				}
+			priv->xml_reload_source = g_timeout_source_new (ZAK_AUTHO_XML_RELOAD_DELAY);
+			g_source_set_callback (priv->xml_reload_source, _zak_autho_xml_reload_timeout,
+			                       g_object_ref (zak_autho), g_object_unref);
+			g_source_attach (priv->xml_reload_source, priv->xml_context);
 		}
-	priv->gdt_last_load = g_date_time_new_now_local ();
 
-	priv->on_loading = FALSE;
+	g_rec_mutex_unlock (&priv->mutex);
 
-	return ret;
+	g_object_unref (zak_autho);
 }
 
-gboolean
-zak_autho_load_from_db_with_monitor (ZakAutho *zak_autho, GdaConnection *gdacon, const gchar *table_prefix, gboolean replace)
+static void
+_zak_autho_xml_monitor_clear (ZakAutho *zak_autho)
 {
 	ZakAuthoPrivate *priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
 
-	g_return_val_if_fail (IS_ZAK_AUTHO (zak_autho), FALSE);
-	g_return_val_if_fail (GDA_IS_CONNECTION (gdacon), FALSE);
+	g_rec_mutex_lock (&priv->mutex);
 
-	priv->gdacon = gdacon;
-	if (table_prefix == NULL)
+	if (priv->xml_reload_source != NULL)
 		{
-			if (priv->table_prefix != NULL)
-				{
-					g_free (priv->table_prefix);
-				}
-			priv->table_prefix = g_strdup ("");
+			g_source_destroy (priv->xml_reload_source);
+			g_source_unref (priv->xml_reload_source);
+			priv->xml_reload_source = NULL;
 		}
-	else
+	if (priv->xml_monitor != NULL)
 		{
-			priv->table_prefix = g_strdup (table_prefix);
+			g_signal_handler_disconnect (priv->xml_monitor, priv->xml_monitor_changed);
+			g_file_monitor_cancel (priv->xml_monitor);
+			g_object_unref (priv->xml_monitor);
+			priv->xml_monitor = NULL;
+		}
+	if (priv->xml_file != NULL)
+		{
+			g_object_unref (priv->xml_file);
+			priv->xml_file = NULL;
+		}
+	if (priv->xml_context != NULL)
+		{
+			g_main_context_unref (priv->xml_context);
+			priv->xml_context = NULL;
 		}
 
-	zak_autho_load_from_db (zak_autho, gdacon, table_prefix, replace);
+	g_rec_mutex_unlock (&priv->mutex);
 }
 
-static void
-_zak_autho_check_updated (ZakAutho *zak_autho)
+/**
+ * zak_autho_load_from_xml_file_with_monitor:
+ * @zak_autho: an #ZakAutho object.
+ * @file: a #GFile with the xml of zak_autho_get_xml().
+ * @error: return location for a #GError, or NULL.
+ *
+ * Replaces the policy with the one of @file, and keeps watching @file:
+ * when its changes settle, it's read again in a thread and the new
+ * policy replaces the current one all at once, only if @file is valid.
+ * The changes are seen through the thread-default main context of the
+ * caller, that has to be running.
+ *
+ * Returns: #TRUE on success; on error the policy is unchanged.
+ */
+gboolean
+zak_autho_load_from_xml_file_with_monitor (ZakAutho *zak_autho, GFile *file, GError **error)
 {
-	GError *error;
-	gchar *sql;
-	GdaDataModel *dm;
+	ZakAuthoPrivate *priv;
 
-	const GValue *gval;
-	const GdaTimestamp *gda_timestamp;
-	GDateTime *gda_datetime;
+	gboolean ret;
+	GFileMonitor *monitor;
+	ZakAutho *loaded;
+	GWeakRef *weak;
 
-	ZakAuthoPrivate *priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
+	g_return_val_if_fail (IS_ZAK_AUTHO (zak_autho), FALSE);
+	g_return_val_if_fail (G_IS_FILE (file), FALSE);
 
-	g_return_if_fail (IS_ZAK_AUTHO (zak_autho));
+	priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
 
-	if (priv->on_loading)
+	/* watching first, not to miss the changes made while reading */
+	monitor = g_file_monitor_file (file, G_FILE_MONITOR_NONE, NULL, error);
+	if (monitor == NULL)
 		{
-			return;
+			return FALSE;
 		}
 
-	if (!GDA_IS_CONNECTION (priv->gdacon))
+	loaded = zak_autho_new ();
+	ret = _zak_autho_load_xml_file (loaded, file, error);
+	if (ret)
 		{
-			return;
-		}
+			g_rec_mutex_lock (&priv->mutex);
 
-	error = NULL;
-	sql = g_strdup_printf ("SELECT update FROM %stimestamp_update",
-	                       priv->table_prefix);
-	dm = gda_connection_execute_select_command (priv->gdacon, sql, &error);
-	g_free (sql);
-	if (dm != NULL && error == NULL && gda_data_model_get_n_rows (dm) > 0)
-		{
-			gval = gda_data_model_get_value_at (dm, 0, 0, NULL);
-			if (!gda_value_is_null (gval))
-				{
-					gda_timestamp = gda_value_get_timestamp (gval);
-					gda_datetime = g_date_time_new_local (gda_timestamp->year,
-					                                      gda_timestamp->month,
-					                                      gda_timestamp->day,
-					                                      gda_timestamp->hour,
-					                                      gda_timestamp->minute,
-					                                      gda_timestamp->second);
+			_zak_autho_take_policy (zak_autho, loaded);
 
-					if (g_date_time_compare (priv->gdt_last_load, gda_datetime) < 0)
-						{
-							/* to reload */
-							zak_autho_load_from_db_with_monitor (zak_autho, priv->gdacon, priv->table_prefix, TRUE);
-						}
-					g_date_time_unref (gda_datetime);
-				}
+			_zak_autho_xml_monitor_clear (zak_autho);
+			priv->xml_file = g_object_ref (file);
+			priv->xml_monitor = monitor;
+			priv->xml_context = g_main_context_ref_thread_default ();
+			weak = g_new0 (GWeakRef, 1);
+			g_weak_ref_init (weak, zak_autho);
+			priv->xml_monitor_changed = g_signal_connect_data (monitor, "changed",
+			                                                   G_CALLBACK (_zak_autho_xml_file_changed), weak,
+			                                                   _zak_autho_xml_weak_ref_free, 0);
+
+			g_rec_mutex_unlock (&priv->mutex);
 		}
-	else if (error != NULL)
+	else
 		{
-			g_warning ("Error on reading table «%stimestamp_update»: %s",
-			           priv->table_prefix,
-			           error->message != NULL ? error->message : "no details");
+			g_object_unref (monitor);
 		}
-	g_object_unref (dm);
+	g_object_unref (loaded);
+
+	return ret;
 }
 
 /* PRIVATE */
@@ -2334,6 +8374,18 @@ zak_autho_set_property (GObject *object,
 
 	switch (property_id)
 		{
+			case PROP_COMPILED:
+				zak_autho_set_compiled (zak_autho, g_value_get_boolean (value));
+				break;
+
+			case PROP_CACHE_SIZE:
+				zak_autho_set_cache_size (zak_autho, g_value_get_uint (value));
+				break;
+
+			case PROP_CHECK_INTERVAL:
+				zak_autho_set_check_interval (zak_autho, g_value_get_uint (value));
+				break;
+
 			default:
 				G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
 				break;
@@ -2351,8 +8403,60 @@ zak_autho_get_property (GObject *object,
 
 	switch (property_id)
 		{
+			case PROP_COMPILED:
+				g_value_set_boolean (value, zak_autho_get_compiled (zak_autho));
+				break;
+
+			case PROP_CACHE_SIZE:
+				g_value_set_uint (value, zak_autho_get_cache_size (zak_autho));
+				break;
+
+			case PROP_CHECK_INTERVAL:
+				g_value_set_uint (value, zak_autho_get_check_interval (zak_autho));
+				break;
+
 			default:
 				G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
 				break;
 	  }
 }
+
+static void
+zak_autho_finalize (GObject *object)
+{
+	ZakAutho *zak_autho = (ZakAutho *)object;
+	ZakAuthoPrivate *priv = ZAK_AUTHO_GET_PRIVATE (zak_autho);
+
+	if (priv->mapped_snapshot != NULL)
+		{
+			_zak_autho_snapshot_unref (priv->mapped_snapshot);
+		}
+	_zak_autho_snapshot_unref (priv->snapshot);
+
+	g_hash_table_destroy (priv->rules);
+	g_hash_table_destroy (priv->roles);
+	g_hash_table_destroy (priv->resources);
+	g_ptr_array_free (priv->roles_idx, TRUE);
+	g_ptr_array_free (priv->resources_idx, TRUE);
+
+	g_free (priv->role_name_prefix);
+	g_free (priv->resource_name_prefix);
+
+	g_free (priv->cache);
+	g_free (priv->cache_hands);
+	g_free (priv->visit_marks);
+	g_array_free (priv->visit_stack, TRUE);
+
+	g_free (priv->table_prefix);
+	_zak_autho_xml_monitor_clear (zak_autho);
+	if (priv->version_stmt != NULL)
+		{
+			g_object_unref (priv->version_stmt);
+		}
+	_zak_autho_journal_reset (zak_autho, NULL, NULL);
+
+	g_rec_mutex_clear (&priv->mutex);
+	g_mutex_clear (&priv->cache_mutex);
+
+	G_OBJECT_CLASS (zak_autho_parent_class)->finalize (object);
+}
@@ -21,6 +21,7 @@
 
 #include <glib.h>
 #include <glib-object.h>
+#include <gio/gio.h>
 
 #include <libxml/tree.h>
 #include <libgda/libgda.h>
@@ -55,6 +56,11 @@ struct _ZakAuthoClass
 
 GType zak_autho_get_type (void) G_GNUC_CONST;
 
+typedef guint64 ZakAuthoRoleHandle;
+typedef guint64 ZakAuthoResourceHandle;
+
+#define ZAK_AUTHO_HANDLE_INVALID 0
+
 
 ZakAutho *zak_autho_new (void);
 
@@ -63,12 +69,23 @@ const gchar *zak_autho_get_role_name_prefix (ZakAutho *zak_autho);
 void zak_autho_set_resource_name_prefix (ZakAutho *zak_autho, const gchar *prefix);
 const gchar *zak_autho_get_resource_name_prefix (ZakAutho *zak_autho);
 
+void zak_autho_set_compiled (ZakAutho *zak_autho, gboolean compiled);
+gboolean zak_autho_get_compiled (ZakAutho *zak_autho);
+
+void zak_autho_set_cache_size (ZakAutho *zak_autho, guint cache_size);
+guint zak_autho_get_cache_size (ZakAutho *zak_autho);
+void zak_autho_get_cache_stats (ZakAutho *zak_autho, guint64 *hits, guint64 *misses);
+
+void zak_autho_set_check_interval (ZakAutho *zak_autho, guint check_interval);
+guint zak_autho_get_check_interval (ZakAutho *zak_autho);
+
 void zak_autho_add_role (ZakAutho *zak_autho, ZakAuthoIRole *irole);
 void zak_autho_add_role_with_parents (ZakAutho *zak_autho, ZakAuthoIRole *irole, ...);
 void zak_autho_add_parent_to_role (ZakAutho *zak_autho, ZakAuthoIRole *irole, ZakAuthoIRole *irole_parent);
 void zak_autho_add_parents_to_role (ZakAutho *zak_autho, ZakAuthoIRole *irole, ...);
 
 gboolean zak_autho_role_is_child (ZakAutho *zak_autho, ZakAuthoIRole *irole, ZakAuthoIRole *irole_parent);
+GList *zak_autho_role_get_ancestors (ZakAutho *zak_autho, ZakAuthoIRole *irole);
 
 ZakAuthoIRole *zak_autho_get_role_from_id (ZakAutho *zak_autho, const gchar *role_id);
 
@@ -78,6 +95,7 @@ void zak_autho_add_parent_to_resource (ZakAutho *zak_autho, ZakAuthoIResource *i
 void zak_autho_add_parents_to_resource (ZakAutho *zak_autho, ZakAuthoIResource *iresource, ...);
 
 gboolean zak_autho_resource_is_child (ZakAutho *zak_autho, ZakAuthoIResource *iresource, ZakAuthoIResource *iresource_parent);
+GList *zak_autho_resource_get_ancestors (ZakAutho *zak_autho, ZakAuthoIResource *iresource);
 
 ZakAuthoIResource *zak_autho_get_resource_from_id (ZakAutho *zak_autho, const gchar *resource_id);
 
@@ -85,11 +103,25 @@ void zak_autho_allow (ZakAutho *zak_autho, ZakAuthoIRole *irole, ZakAuthoIResour
 void zak_autho_deny (ZakAutho *zak_autho, ZakAuthoIRole *irole, ZakAuthoIResource *iresource);
 
 gboolean zak_autho_is_allowed (ZakAutho *zak_autho, ZakAuthoIRole *irole, ZakAuthoIResource *iresource, gboolean exclude_null);
+ZakAuthoRoleHandle zak_autho_lookup_role_handle (ZakAutho *zak_autho, const gchar *role_id);
+ZakAuthoResourceHandle zak_autho_lookup_resource_handle (ZakAutho *zak_autho, const gchar *resource_id);
+gboolean zak_autho_is_allowed_h (ZakAutho *zak_autho, ZakAuthoRoleHandle role, ZakAuthoResourceHandle resource, gboolean exclude_null);
+
+gboolean zak_autho_filter_allowed (ZakAutho *zak_autho, ZakAuthoIRole *irole, const gchar **resource_ids, guint n, guint8 *out_mask, gboolean exclude_null);
+GArray *zak_autho_get_allowed_resources (ZakAutho *zak_autho, ZakAuthoIRole *irole, ZakAuthoIResource *subtree_root, gboolean exclude_null);
+GArray *zak_autho_get_allowed_resources_page (ZakAutho *zak_autho, ZakAuthoIRole *irole, ZakAuthoIResource *subtree_root, gboolean exclude_null, guint offset, guint limit);
+GList *zak_autho_get_roles_allowed_on (ZakAutho *zak_autho, ZakAuthoIResource *iresource, gboolean exclude_null);
 
 gboolean zak_autho_clear (ZakAutho *zak_autho);
 
 xmlNodePtr zak_autho_get_xml (ZakAutho *zak_autho);
+gboolean zak_autho_write_xml (ZakAutho *zak_autho, GOutputStream *stream, GError **error);
 gboolean zak_autho_load_from_xml (ZakAutho *zak_autho, xmlNodePtr xnode, gboolean replace);
+gboolean zak_autho_load_from_xml_stream (ZakAutho *zak_autho, GInputStream *stream, gboolean replace, GError **error);
+gboolean zak_autho_load_from_xml_file_with_monitor (ZakAutho *zak_autho, GFile *file, GError **error);
+
+gboolean zak_autho_save_snapshot (ZakAutho *zak_autho, const gchar *path);
+gboolean zak_autho_load_snapshot (ZakAutho *zak_autho, const gchar *path);
 
 gboolean zak_autho_save_to_db (ZakAutho *zak_autho, GdaConnection *gdacon, const gchar *table_prefix, gboolean replace);
 gboolean zak_autho_load_from_db (ZakAutho *zak_autho, GdaConnection *gdacon, const gchar *table_prefix, gboolean replace);
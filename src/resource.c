@@ -29,6 +29,7 @@ static void zak_autho_resource_init (ZakAuthoResource *form);
 static void zak_autho_iresource_interface_init (ZakAuthoIResourceIface *iface);
 
 static const gchar *zak_autho_resource_get_resource_id (ZakAuthoIResource *iresource);
+static const gchar *zak_autho_resource_peek_resource_id (ZakAuthoIResource *iresource);
 
 static void zak_autho_resource_set_property (GObject *object,
                                guint property_id,
@@ -72,6 +73,7 @@ static void
 zak_autho_iresource_interface_init (ZakAuthoIResourceIface *iface)
 {
 	iface->get_resource_id = zak_autho_resource_get_resource_id;
+	iface->peek_resource_id = zak_autho_resource_peek_resource_id;
 }
 
 /**
@@ -114,6 +116,18 @@ static const gchar
 	return ret;
 }
 
+static const gchar
+*zak_autho_resource_peek_resource_id (ZakAuthoIResource *iresource)
+{
+	ZakAuthoResourcePrivate *priv;
+
+	g_return_val_if_fail (ZAK_AUTHO_IS_RESOURCE (iresource), NULL);
+
+	priv = ZAK_AUTHO_RESOURCE_GET_PRIVATE (iresource);
+
+	return (const gchar *)priv->resource_id;
+}
+
 static void
 zak_autho_resource_set_property (GObject *object,
                    guint property_id,
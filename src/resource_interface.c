@@ -25,6 +25,9 @@
 typedef ZakAuthoIResourceIface ZakAuthoIResourceInterface;
 G_DEFINE_INTERFACE (ZakAuthoIResource, zak_autho_iresource, G_TYPE_OBJECT)
 
+/* the copy of the id, for implementations without peek_resource_id */
+static G_DEFINE_QUARK (zak-autho-iresource-resource-id, zak_autho_iresource_resource_id)
+
 static void
 zak_autho_iresource_default_init (ZakAuthoIResourceInterface *iface)
 {
@@ -50,3 +53,51 @@ const gchar
 
 	return ret;
 }
+
+/**
+ * zak_autho_iresource_peek_resource_id:
+ * @iresource: an #ZakAuthoIResource object.
+ *
+ * Returns: the resource id owned by @iresource, without copying it; for
+ * implementations that don't provide peek_resource_id, the copy get_resource_id returns
+ * the first time is kept on @iresource and returned from then on.
+ */
+const gchar
+*zak_autho_iresource_peek_resource_id (ZakAuthoIResource *iresource)
+{
+	ZakAuthoIResourceIface *iface;
+
+	const gchar *ret;
+	gchar *id;
+
+	ret = NULL;
+
+	g_return_val_if_fail (ZAK_AUTHO_IS_IRESOURCE (iresource), ret);
+
+	iface = ZAK_AUTHO_IRESOURCE_GET_IFACE (iresource);
+
+	if (iface->peek_resource_id)
+		{
+			ret = (* iface->peek_resource_id) (iresource);
+		}
+	else if (iface->get_resource_id)
+		{
+			ret = g_object_get_qdata (G_OBJECT (iresource), zak_autho_iresource_resource_id_quark ());
+			if (ret == NULL)
+				{
+					id = (gchar *)(* iface->get_resource_id) (iresource);
+					if (g_object_replace_qdata (G_OBJECT (iresource), zak_autho_iresource_resource_id_quark (), NULL, id, g_free, NULL))
+						{
+							ret = id;
+						}
+					else
+						{
+							/* another thread got there first */
+							g_free (id);
+							ret = g_object_get_qdata (G_OBJECT (iresource), zak_autho_iresource_resource_id_quark ());
+						}
+				}
+		}
+
+	return ret;
+}
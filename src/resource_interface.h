@@ -39,11 +39,13 @@ struct _ZakAuthoIResourceIface
 		GTypeInterface g_iface;
 
 		const gchar *(*get_resource_id) (ZakAuthoIResource *iresource);
+		const gchar *(*peek_resource_id) (ZakAuthoIResource *iresource);
 	};
 
 GType zak_autho_iresource_get_type (void) G_GNUC_CONST;
 
 const gchar *zak_autho_iresource_get_resource_id (ZakAuthoIResource *iresource);
+const gchar *zak_autho_iresource_peek_resource_id (ZakAuthoIResource *iresource);
 
 
 G_END_DECLS
@@ -29,6 +29,7 @@ static void zak_autho_role_init (ZakAuthoRole *role);
 static void zak_autho_irole_interface_init (ZakAuthoIRoleIface *iface);
 
 static const gchar *zak_autho_role_get_role_id (ZakAuthoIRole *irole);
+static const gchar *zak_autho_role_peek_role_id (ZakAuthoIRole *irole);
 
 static void zak_autho_role_set_property (GObject *object,
                                guint property_id,
@@ -72,6 +73,7 @@ static void
 zak_autho_irole_interface_init (ZakAuthoIRoleIface *iface)
 {
 	iface->get_role_id = zak_autho_role_get_role_id;
+	iface->peek_role_id = zak_autho_role_peek_role_id;
 }
 
 /**
@@ -114,6 +116,18 @@ static const gchar
 	return ret;
 }
 
+static const gchar
+*zak_autho_role_peek_role_id (ZakAuthoIRole *irole)
+{
+	ZakAuthoRolePrivate *priv;
+
+	g_return_val_if_fail (ZAK_AUTHO_IS_ROLE (irole), NULL);
+
+	priv = ZAK_AUTHO_ROLE_GET_PRIVATE (irole);
+
+	return (const gchar *)priv->role_id;
+}
+
 static void
 zak_autho_role_set_property (GObject *object,
                    guint property_id,
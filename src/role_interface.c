@@ -25,6 +25,9 @@
 typedef ZakAuthoIRoleIface ZakAuthoIRoleInterface;
 G_DEFINE_INTERFACE (ZakAuthoIRole, zak_autho_irole, G_TYPE_OBJECT)
 
+/* the copy of the id, for implementations without peek_role_id */
+static G_DEFINE_QUARK (zak-autho-irole-role-id, zak_autho_irole_role_id)
+
 static void
 zak_autho_irole_default_init (ZakAuthoIRoleInterface *iface)
 {
@@ -50,3 +53,51 @@ const gchar
 
 	return ret;
 }
+
+/**
+ * zak_autho_irole_peek_role_id:
+ * @irole: an #ZakAuthoIRole object.
+ *
+ * Returns: the role id owned by @irole, without copying it; for
+ * implementations that don't provide peek_role_id, the copy get_role_id returns
+ * the first time is kept on @irole and returned from then on.
+ */
+const gchar
+*zak_autho_irole_peek_role_id (ZakAuthoIRole *irole)
+{
+	ZakAuthoIRoleIface *iface;
+
+	const gchar *ret;
+	gchar *id;
+
+	ret = NULL;
+
+	g_return_val_if_fail (ZAK_AUTHO_IS_IROLE (irole), ret);
+
+	iface = ZAK_AUTHO_IROLE_GET_IFACE (irole);
+
+	if (iface->peek_role_id)
+		{
+			ret = (* iface->peek_role_id) (irole);
+		}
+	else if (iface->get_role_id)
+		{
+			ret = g_object_get_qdata (G_OBJECT (irole), zak_autho_irole_role_id_quark ());
+			if (ret == NULL)
+				{
+					id = (gchar *)(* iface->get_role_id) (irole);
+					if (g_object_replace_qdata (G_OBJECT (irole), zak_autho_irole_role_id_quark (), NULL, id, g_free, NULL))
+						{
+							ret = id;
+						}
+					else
+						{
+							/* another thread got there first */
+							g_free (id);
+							ret = g_object_get_qdata (G_OBJECT (irole), zak_autho_irole_role_id_quark ());
+						}
+				}
+		}
+
+	return ret;
+}
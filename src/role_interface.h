@@ -39,11 +39,13 @@ struct _ZakAuthoIRoleIface
 		GTypeInterface g_iface;
 
 		const gchar *(*get_role_id) (ZakAuthoIRole *irole);
+		const gchar *(*peek_role_id) (ZakAuthoIRole *irole);
 	};
 
 GType zak_autho_irole_get_type (void) G_GNUC_CONST;
 
 const gchar *zak_autho_irole_get_role_id (ZakAuthoIRole *irole);
+const gchar *zak_autho_irole_peek_role_id (ZakAuthoIRole *irole);
 
 
 G_END_DECLS
@@ -0,0 +1,326 @@
+/*
+ * Copyright (C) 2010-2015 Andrea Zagli <azagli@libero.it>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/* measures zak_autho_is_allowed, zak_autho_role_is_child and
+ * zak_autho_get_role_from_id on a synthetic policy, with one thread and
+ * with --threads threads sharing the same ZakAutho.
+ * every result is printed as one json object per line: throughput comes
+ * from an untimed run, the latency percentiles from a second run timing
+ * every call (so they include the cost of reading the clock). */
+
+#include <stdlib.h>
+
+#include <glib/gprintf.h>
+
+#include "bench_policy.h"
+
+typedef struct
+	{
+		BenchPolicy *policy;
+		ZakAutho *zak_autho;
+
+		guint n_queries;
+		guint32 *query_a;
+		guint32 *query_b;
+	} Bench;
+
+typedef gboolean (*BenchOp) (Bench *bench, guint query);
+
+typedef struct
+	{
+		const gchar *name;
+		BenchOp op;
+	} Workload;
+
+typedef struct
+	{
+		Bench *bench;
+		const Workload *workload;
+		guint first_query;
+		guint ops;
+		guint32 *latencies;
+		guint hits;
+
+		GMutex *gate_mutex;
+		GCond *gate_cond;
+		gboolean *gate_open;
+	} Worker;
+
+static gboolean
+op_is_allowed (Bench *bench, guint query)
+{
+	return zak_autho_is_allowed (bench->zak_autho,
+	                             bench->policy->iroles[bench->query_a[query]],
+	                             bench->policy->iresources[bench->query_b[query] % bench->policy->n_resources],
+	                             FALSE);
+}
+
+static gboolean
+op_role_is_child (Bench *bench, guint query)
+{
+	return zak_autho_role_is_child (bench->zak_autho,
+	                                bench->policy->iroles[bench->query_a[query]],
+	                                bench->policy->iroles[bench->query_b[query] % bench->policy->n_roles]);
+}
+
+static gboolean
+op_get_role_from_id (Bench *bench, guint query)
+{
+	return zak_autho_get_role_from_id (bench->zak_autho,
+	                                   bench->policy->role_ids[bench->query_a[query]]) != NULL;
+}
+
+static const Workload workloads[] =
+	{
+		{ "is_allowed", op_is_allowed },
+		{ "role_is_child", op_role_is_child },
+		{ "get_role_from_id", op_get_role_from_id }
+	};
+
+static gpointer
+worker_run (gpointer data)
+{
+	Worker *worker;
+	guint i;
+	guint query;
+	gint64 start;
+	gint64 elapsed;
+
+	worker = (Worker *)data;
+
+	g_mutex_lock (worker->gate_mutex);
+	while (!*worker->gate_open)
+		{
+			g_cond_wait (worker->gate_cond, worker->gate_mutex);
+		}
+	g_mutex_unlock (worker->gate_mutex);
+
+	query = worker->first_query;
+	for (i = 0; i < worker->ops; i++)
+		{
+			if (worker->latencies != NULL)
+				{
+					start = bench_now_ns ();
+					worker->hits += worker->workload->op (worker->bench, query);
+					elapsed = bench_now_ns () - start;
+					worker->latencies[i] = (guint32)MIN (elapsed, G_MAXUINT32);
+				}
+			else
+				{
+					worker->hits += worker->workload->op (worker->bench, query);
+				}
+
+			if (++query == worker->bench->n_queries)
+				{
+					query = 0;
+				}
+		}
+
+	return NULL;
+}
+
+/* runs ops calls per thread and returns the wall clock time in ns */
+static gint64
+bench_run (Bench *bench, const Workload *workload, guint threads, guint ops, guint32 *latencies)
+{
+	Worker *workers;
+	GThread **thread;
+	GMutex gate_mutex;
+	GCond gate_cond;
+	gboolean gate_open;
+	gint64 start;
+	guint i;
+
+	g_mutex_init (&gate_mutex);
+	g_cond_init (&gate_cond);
+	gate_open = FALSE;
+
+	workers = g_new0 (Worker, threads);
+	thread = g_new (GThread *, threads);
+	for (i = 0; i < threads; i++)
+		{
+			workers[i].bench = bench;
+			workers[i].workload = workload;
+			workers[i].first_query = (i * (bench->n_queries / threads)) % bench->n_queries;
+			workers[i].ops = ops;
+			workers[i].latencies = latencies == NULL ? NULL : latencies + (gsize)i * ops;
+			workers[i].gate_mutex = &gate_mutex;
+			workers[i].gate_cond = &gate_cond;
+			workers[i].gate_open = &gate_open;
+
+			thread[i] = g_thread_new ("bench", worker_run, &workers[i]);
+		}
+
+	g_mutex_lock (&gate_mutex);
+	gate_open = TRUE;
+	start = bench_now_ns ();
+	g_cond_broadcast (&gate_cond);
+	g_mutex_unlock (&gate_mutex);
+
+	for (i = 0; i < threads; i++)
+		{
+			g_thread_join (thread[i]);
+		}
+	start = bench_now_ns () - start;
+
+	g_free (thread);
+	g_free (workers);
+	g_mutex_clear (&gate_mutex);
+	g_cond_clear (&gate_cond);
+
+	return start;
+}
+
+static int
+latency_compare (const void *a, const void *b)
+{
+	guint32 la = *(const guint32 *)a;
+	guint32 lb = *(const guint32 *)b;
+
+	return la < lb ? -1 : (la > lb ? 1 : 0);
+}
+
+static guint32
+latency_percentile (const guint32 *latencies, gsize n, gdouble p)
+{
+	return latencies[(gsize)((n - 1) * p)];
+}
+
+static void
+bench_workload (Bench *bench, const Workload *workload, guint threads, guint ops)
+{
+	guint32 *latencies;
+	gsize n;
+	gint64 elapsed;
+
+	n = (gsize)threads * ops;
+	latencies = g_new (guint32, n);
+
+	/* warm up: builds the lazy parts of the snapshot */
+	bench_run (bench, workload, 1, MIN (ops, bench->n_queries), NULL);
+
+	elapsed = bench_run (bench, workload, threads, ops, NULL);
+
+	bench_run (bench, workload, threads, ops, latencies);
+	qsort (latencies, n, sizeof (guint32), latency_compare);
+
+	g_printf ("{\"bench\":\"%s\",\"threads\":%u,\"ops\":%" G_GSIZE_FORMAT ","
+	          "\"seconds\":%.6f,\"ops_per_sec\":%.0f,"
+	          "\"p50_ns\":%u,\"p99_ns\":%u,\"p999_ns\":%u,\"max_ns\":%u}\n",
+	          workload->name,
+	          threads,
+	          n,
+	          elapsed / 1e9,
+	          n / (elapsed / 1e9),
+	          latency_percentile (latencies, n, 0.5),
+	          latency_percentile (latencies, n, 0.99),
+	          latency_percentile (latencies, n, 0.999),
+	          latencies[n - 1]);
+
+	g_free (latencies);
+}
+
+int
+main (int argc, char **argv)
+{
+	BenchPolicyParams params;
+	gint threads;
+	gint ops;
+	gint queries;
+	gboolean compiled;
+	gint cache_size;
+
+	GOptionEntry *policy_entries;
+	GOptionContext *context;
+	GError *error;
+
+	Bench bench;
+	GRand *rand;
+	guint i;
+	guint w;
+
+	GOptionEntry entries[] =
+		{
+			{ "threads", 't', 0, G_OPTION_ARG_INT, &threads, "Threads of the multi threaded runs", "N" },
+			{ "ops", 'n', 0, G_OPTION_ARG_INT, &ops, "Calls per thread", "N" },
+			{ "queries", 'q', 0, G_OPTION_ARG_INT, &queries, "Distinct random queries cycled through", "N" },
+			{ "compiled", 'c', 0, G_OPTION_ARG_NONE, &compiled, "Evaluate on the compiled matrix", NULL },
+			{ "cache-size", 0, 0, G_OPTION_ARG_INT, &cache_size, "Size of the decision cache", "N" },
+			{ NULL }
+		};
+
+	bench_policy_params_init (&params);
+	threads = MAX (g_get_num_processors (), 2);
+	ops = 200000;
+	queries = 4096;
+	compiled = FALSE;
+	cache_size = 0;
+
+	policy_entries = bench_policy_option_entries (&params);
+
+	context = g_option_context_new ("- zakautho evaluation benchmark");
+	g_option_context_add_main_entries (context, entries, NULL);
+	g_option_context_add_main_entries (context, policy_entries, NULL);
+
+	error = NULL;
+	if (!g_option_context_parse (context, &argc, &argv, &error))
+		{
+			g_warning ("Error on command line: %s.", error->message);
+			return 1;
+		}
+	g_option_context_free (context);
+	g_free (policy_entries);
+
+	threads = MAX (threads, 1);
+	ops = MAX (ops, 1);
+	queries = MAX (queries, 1);
+
+	bench.policy = bench_policy_generate (&params);
+	bench_policy_print_json (bench.policy);
+
+	bench.zak_autho = bench_policy_load (bench.policy);
+	zak_autho_set_compiled (bench.zak_autho, compiled);
+	zak_autho_set_cache_size (bench.zak_autho, cache_size);
+
+	bench.n_queries = queries;
+	bench.query_a = g_new (guint32, queries);
+	bench.query_b = g_new (guint32, queries);
+	rand = g_rand_new_with_seed (params.seed + 1);
+	for (i = 0; i < bench.n_queries; i++)
+		{
+			bench.query_a[i] = g_rand_int_range (rand, 0, bench.policy->n_roles);
+			bench.query_b[i] = g_rand_int (rand);
+		}
+	g_rand_free (rand);
+
+	for (w = 0; w < G_N_ELEMENTS (workloads); w++)
+		{
+			bench_workload (&bench, &workloads[w], 1, ops);
+			if (threads > 1)
+				{
+					bench_workload (&bench, &workloads[w], threads, ops);
+				}
+		}
+
+	g_object_unref (bench.zak_autho);
+	bench_policy_free (bench.policy);
+	g_free (bench.query_a);
+	g_free (bench.query_b);
+
+	return 0;
+}
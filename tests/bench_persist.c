@@ -0,0 +1,461 @@
+/*
+ * Copyright (C) 2010-2015 Andrea Zagli <azagli@libero.it>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/* measures zak_autho_get_xml, zak_autho_write_xml, zak_autho_load_from_xml,
+ * zak_autho_load_from_xml_stream, zak_autho_save_to_db (of the whole policy
+ * and, after zak_autho_load_from_db, of one more rule),
+ * zak_autho_load_from_db, zak_autho_save_snapshot and zak_autho_load_snapshot
+ * on synthetic policies of --rules rules, using an xml file, a sqlite
+ * database and a snapshot file in --dir.
+ * the resource tree is deepened until the policy has room for the rules.
+ * every path runs on four cumulative policies: roles only, then resources,
+ * then parents, then rules; the time of a phase is the difference with the
+ * previous policy, the time of the path is the one on the whole policy.
+ * peak_rss_kb is the peak resident size of the process while the path runs
+ * on the whole policy. one json object per line. */
+
+#include <string.h>
+
+#include <glib/gprintf.h>
+#include <glib/gstdio.h>
+
+#include <libxml/tree.h>
+#include <libxml/parser.h>
+
+#include <libgda/libgda.h>
+
+#include "bench_policy.h"
+
+enum
+{
+	STAGE_ROLES,
+	STAGE_RESOURCES,
+	STAGE_PARENTS,
+	STAGE_RULES,
+	N_STAGES
+};
+
+static const gchar *stage_names[N_STAGES] =
+	{
+		"roles",
+		"resources",
+		"parents",
+		"rules"
+	};
+
+enum
+{
+	PATH_XML_SAVE,
+	PATH_XML_WRITE,
+	PATH_XML_LOAD,
+	PATH_XML_STREAM_LOAD,
+	PATH_DB_SAVE,
+	PATH_DB_LOAD,
+	PATH_DB_SAVE_ONE_RULE,
+	PATH_SNAPSHOT_SAVE,
+	PATH_SNAPSHOT_LOAD,
+	N_PATHS
+};
+
+static const gchar *path_names[N_PATHS] =
+	{
+		"xml_save",
+		"xml_write",
+		"xml_load",
+		"xml_stream_load",
+		"db_save",
+		"db_load",
+		"db_save_one_rule",
+		"snapshot_save",
+		"snapshot_load"
+	};
+
+typedef struct
+	{
+		gboolean done;
+		gint64 ns[N_STAGES];
+		glong peak_rss;
+	} PathResult;
+
+static const gchar *sqlite_schema[] =
+	{
+		"CREATE TABLE roles (id integer NOT NULL PRIMARY KEY, role_id varchar(255) DEFAULT '')",
+		"CREATE TABLE roles_parents (id_roles integer NOT NULL, id_roles_parent integer NOT NULL,"
+		" PRIMARY KEY (id_roles, id_roles_parent))",
+		"CREATE TABLE resources (id integer NOT NULL PRIMARY KEY, resource_id varchar(255) DEFAULT '')",
+		"CREATE TABLE resources_parents (id_resources integer NOT NULL, id_resources_parent integer NOT NULL,"
+		" PRIMARY KEY (id_resources, id_resources_parent))",
+		"CREATE TABLE rules (id integer NOT NULL PRIMARY KEY, type integer, id_roles integer, id_resources integer)"
+	};
+
+static gchar *dir = NULL;
+
+/* deepens the resource tree until at most a quarter of the
+ * role/resource pairs carry a rule */
+static void
+params_scale_to_rules (BenchPolicyParams *params, guint64 rules)
+{
+	guint64 n_roles;
+	guint64 n_resources;
+	guint64 level;
+	gint depth;
+
+	n_roles = (guint64)MAX (params->role_depth, 1) * MAX (params->role_width, 1);
+	params->resource_fanout = MAX (params->resource_fanout, 2);
+
+	n_resources = 0;
+	level = 1;
+	depth = 0;
+	while (depth < params->resource_depth
+	       || n_roles * n_resources < 4 * rules)
+		{
+			n_resources += level;
+			level *= params->resource_fanout;
+			depth++;
+		}
+
+	params->resource_depth = depth;
+	params->rule_density = (gdouble)rules / (n_roles * n_resources);
+}
+
+static ZakAutho
+*load_stage (BenchPolicy *policy, guint stage)
+{
+	ZakAutho *zak_autho;
+
+	zak_autho = zak_autho_new ();
+
+	bench_policy_load_roles (policy, zak_autho);
+	if (stage >= STAGE_RESOURCES)
+		{
+			bench_policy_load_resources (policy, zak_autho);
+		}
+	if (stage >= STAGE_PARENTS)
+		{
+			bench_policy_load_parents (policy, zak_autho);
+		}
+	if (stage >= STAGE_RULES)
+		{
+			bench_policy_load_rules (policy, zak_autho);
+		}
+
+	return zak_autho;
+}
+
+/* a new empty database */
+static GdaConnection
+*db_open (void)
+{
+	GdaConnection *gdacon;
+	GError *error;
+	gchar *filename;
+	gchar *cnc_string;
+	guint i;
+
+	filename = g_build_filename (dir, "zakautho-bench.db", NULL);
+	g_remove (filename);
+	g_free (filename);
+
+	cnc_string = g_strdup_printf ("SQLite://DB_DIR=%s;DB_NAME=zakautho-bench", dir);
+
+	error = NULL;
+	gdacon = gda_connection_open_from_string (NULL, cnc_string, NULL, 0, &error);
+	g_free (cnc_string);
+	if (gdacon == NULL)
+		{
+			g_warning ("Error on creating GdaConnection: %s",
+			           error != NULL && error->message != NULL ? error->message : "no details");
+			return NULL;
+		}
+
+	for (i = 0; i < G_N_ELEMENTS (sqlite_schema); i++)
+		{
+			error = NULL;
+			gda_connection_execute_non_select_command (gdacon, sqlite_schema[i], &error);
+			if (error != NULL)
+				{
+					g_warning ("Error on creating the schema: %s",
+					           error->message != NULL ? error->message : "no details");
+					g_object_unref (gdacon);
+					return NULL;
+				}
+		}
+
+	return gdacon;
+}
+
+static void
+path_start (guint stage, gint64 *start)
+{
+	if (stage == STAGE_RULES)
+		{
+			bench_reset_peak_rss ();
+		}
+	*start = bench_now_ns ();
+}
+
+static void
+path_end (PathResult *result, guint stage, gint64 start)
+{
+	result->ns[stage] = bench_now_ns () - start;
+	if (stage == STAGE_RULES)
+		{
+			result->peak_rss = bench_get_peak_rss ();
+			result->done = TRUE;
+		}
+}
+
+static void
+bench_stage (BenchPolicy *policy, guint stage, gboolean with_xml, gboolean with_db, gboolean with_snapshot, PathResult *results)
+{
+	ZakAutho *zak_autho;
+	GdaConnection *gdacon;
+	gchar *xml_filename;
+	gchar *snapshot_filename;
+	xmlDocPtr xdoc;
+	GFile *file;
+	GFileInputStream *stream;
+	GFileOutputStream *ostream;
+	gint64 start;
+
+	xml_filename = g_build_filename (dir, "zakautho-bench.xml", NULL);
+	snapshot_filename = g_build_filename (dir, "zakautho-bench.snapshot", NULL);
+
+	zak_autho = load_stage (policy, stage);
+
+	if (with_xml)
+		{
+			path_start (stage, &start);
+			xdoc = xmlNewDoc ("1.0");
+			xmlDocSetRootElement (xdoc, zak_autho_get_xml (zak_autho));
+			xmlSaveFile (xml_filename, xdoc);
+			path_end (&results[PATH_XML_SAVE], stage, start);
+			xmlFreeDoc (xdoc);
+
+			/* the same file, for the load paths */
+			file = g_file_new_for_path (xml_filename);
+			path_start (stage, &start);
+			ostream = g_file_replace (file, NULL, FALSE, G_FILE_CREATE_NONE, NULL, NULL);
+			zak_autho_write_xml (zak_autho, G_OUTPUT_STREAM (ostream), NULL);
+			g_output_stream_close (G_OUTPUT_STREAM (ostream), NULL, NULL);
+			path_end (&results[PATH_XML_WRITE], stage, start);
+			g_object_unref (ostream);
+			g_object_unref (file);
+		}
+
+	gdacon = NULL;
+	if (with_db)
+		{
+			gdacon = db_open ();
+		}
+	if (gdacon != NULL)
+		{
+			path_start (stage, &start);
+			zak_autho_save_to_db (zak_autho, gdacon, NULL, TRUE);
+			path_end (&results[PATH_DB_SAVE], stage, start);
+		}
+
+	if (with_snapshot)
+		{
+			path_start (stage, &start);
+			zak_autho_save_snapshot (zak_autho, snapshot_filename);
+			path_end (&results[PATH_SNAPSHOT_SAVE], stage, start);
+		}
+
+	g_object_unref (zak_autho);
+
+	if (with_xml)
+		{
+			zak_autho = zak_autho_new ();
+			path_start (stage, &start);
+			xdoc = xmlParseFile (xml_filename);
+			zak_autho_load_from_xml (zak_autho, xmlDocGetRootElement (xdoc), TRUE);
+			path_end (&results[PATH_XML_LOAD], stage, start);
+			xmlFreeDoc (xdoc);
+			g_object_unref (zak_autho);
+
+			zak_autho = zak_autho_new ();
+			file = g_file_new_for_path (xml_filename);
+			path_start (stage, &start);
+			stream = g_file_read (file, NULL, NULL);
+			zak_autho_load_from_xml_stream (zak_autho, G_INPUT_STREAM (stream), TRUE, NULL);
+			path_end (&results[PATH_XML_STREAM_LOAD], stage, start);
+			g_object_unref (stream);
+			g_object_unref (file);
+			g_object_unref (zak_autho);
+		}
+
+	if (gdacon != NULL)
+		{
+			zak_autho = zak_autho_new ();
+			path_start (stage, &start);
+			zak_autho_load_from_db (zak_autho, gdacon, NULL, TRUE);
+			path_end (&results[PATH_DB_LOAD], stage, start);
+
+			/* writes just the new rule */
+			zak_autho_allow (zak_autho, policy->iroles[0], NULL);
+			path_start (stage, &start);
+			zak_autho_save_to_db (zak_autho, gdacon, NULL, TRUE);
+			path_end (&results[PATH_DB_SAVE_ONE_RULE], stage, start);
+			g_object_unref (zak_autho);
+			g_object_unref (gdacon);
+		}
+
+	if (with_snapshot)
+		{
+			zak_autho = zak_autho_new ();
+			path_start (stage, &start);
+			zak_autho_load_snapshot (zak_autho, snapshot_filename);
+			path_end (&results[PATH_SNAPSHOT_LOAD], stage, start);
+			g_object_unref (zak_autho);
+		}
+
+	g_free (xml_filename);
+	g_free (snapshot_filename);
+}
+
+static void
+print_result (const gchar *name, guint64 target, BenchPolicy *policy, PathResult *result)
+{
+	guint stage;
+
+	g_printf ("{\"bench\":\"%s\",\"target_rules\":%" G_GUINT64_FORMAT ","
+	          "\"roles\":%u,\"resources\":%u,\"rules\":%u,"
+	          "\"seconds\":%.6f,\"phases\":{",
+	          name,
+	          target,
+	          policy->n_roles,
+	          policy->n_resources,
+	          policy->n_rules,
+	          result->ns[STAGE_RULES] / 1e9);
+	for (stage = 0; stage < N_STAGES; stage++)
+		{
+			g_printf ("%s\"%s\":%.6f",
+			          stage > 0 ? "," : "",
+			          stage_names[stage],
+			          (result->ns[stage] - (stage > 0 ? result->ns[stage - 1] : 0)) / 1e9);
+		}
+	g_printf ("},\"peak_rss_kb\":%ld}\n", result->peak_rss);
+}
+
+int
+main (int argc, char **argv)
+{
+	BenchPolicyParams defaults;
+	BenchPolicyParams params;
+	gchar *rules;
+	gboolean skip_xml;
+	gboolean skip_db;
+	gboolean skip_snapshot;
+
+	GOptionEntry *policy_entries;
+	GOptionContext *context;
+	GError *error;
+
+	gchar **targets;
+	guint64 target;
+	BenchPolicy *policy;
+	PathResult results[N_PATHS];
+	guint i;
+	guint stage;
+	guint path;
+
+	GOptionEntry entries[] =
+		{
+			{ "rules", 'r', 0, G_OPTION_ARG_STRING, &rules, "Comma separated sizes of the policies, in rules", "N,..." },
+			{ "dir", 'd', 0, G_OPTION_ARG_FILENAME, &dir, "Directory of the xml file, of the sqlite database and of the snapshot", "DIR" },
+			{ "skip-xml", 0, 0, G_OPTION_ARG_NONE, &skip_xml, "Don't measure the xml paths", NULL },
+			{ "skip-db", 0, 0, G_OPTION_ARG_NONE, &skip_db, "Don't measure the database paths", NULL },
+			{ "skip-snapshot", 0, 0, G_OPTION_ARG_NONE, &skip_snapshot, "Don't measure the snapshot paths", NULL },
+			{ NULL }
+		};
+
+	bench_policy_params_init (&defaults);
+	defaults.resource_depth = 1;
+	rules = NULL;
+	skip_xml = FALSE;
+	skip_db = FALSE;
+	skip_snapshot = FALSE;
+
+	policy_entries = bench_policy_option_entries (&defaults);
+
+	context = g_option_context_new ("- zakautho persistence benchmark");
+	g_option_context_add_main_entries (context, entries, NULL);
+	g_option_context_add_main_entries (context, policy_entries, NULL);
+
+	error = NULL;
+	if (!g_option_context_parse (context, &argc, &argv, &error))
+		{
+			g_warning ("Error on command line: %s.", error->message);
+			return 1;
+		}
+	g_option_context_free (context);
+	g_free (policy_entries);
+
+	if (rules == NULL)
+		{
+			rules = g_strdup ("1000,10000,100000,1000000");
+		}
+	if (dir == NULL)
+		{
+			dir = g_strdup (g_get_tmp_dir ());
+		}
+
+	if (!skip_db)
+		{
+			gda_init ();
+		}
+
+	targets = g_strsplit (rules, ",", -1);
+	for (i = 0; targets[i] != NULL; i++)
+		{
+			target = g_ascii_strtoull (targets[i], NULL, 10);
+			if (target == 0)
+				{
+					continue;
+				}
+
+			params = defaults;
+			params_scale_to_rules (&params, target);
+
+			policy = bench_policy_generate (&params);
+			bench_policy_print_json (policy);
+
+			memset (results, 0, sizeof (results));
+			for (stage = 0; stage < N_STAGES; stage++)
+				{
+					bench_stage (policy, stage, !skip_xml, !skip_db, !skip_snapshot, results);
+				}
+
+			for (path = 0; path < N_PATHS; path++)
+				{
+					if (results[path].done)
+						{
+							print_result (path_names[path], target, policy, &results[path]);
+						}
+				}
+
+			bench_policy_free (policy);
+		}
+
+	g_strfreev (targets);
+	g_free (rules);
+	g_free (dir);
+
+	return 0;
+}
@@ -0,0 +1,458 @@
+/*
+ * Copyright (C) 2010-2015 Andrea Zagli <azagli@libero.it>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/* synthetic policy generator shared by the benchmarks
+ *
+ * roles are laid out in role_depth levels of role_width roles; every role
+ * below the first level gets role_fanin distinct parents from the level
+ * above, so fan-in > 1 makes diamonds in the role graph.
+ * resources form a tree resource_depth levels deep with resource_fanout
+ * children per node; with probability diamond_density a resource gets a
+ * second parent from its parent's level.
+ * every role gets rules on about rule_density * n_resources resources,
+ * one deny every four rules.
+ * the same params always produce the same policy. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include <glib/gprintf.h>
+
+#include "bench_policy.h"
+#include "role.h"
+#include "resource.h"
+
+void
+bench_policy_params_init (BenchPolicyParams *params)
+{
+	params->role_depth = 6;
+	params->role_width = 50;
+	params->role_fanin = 2;
+	params->resource_depth = 5;
+	params->resource_fanout = 5;
+	params->diamond_density = 0.05;
+	params->rule_density = 0.01;
+	params->seed = 1;
+}
+
+GOptionEntry
+*bench_policy_option_entries (BenchPolicyParams *params)
+{
+	GOptionEntry *entries;
+
+	entries = g_new0 (GOptionEntry, 9);
+
+	entries[0] = (GOptionEntry) { "role-depth", 0, 0, G_OPTION_ARG_INT, &params->role_depth, "Levels of roles", "N" };
+	entries[1] = (GOptionEntry) { "role-width", 0, 0, G_OPTION_ARG_INT, &params->role_width, "Roles per level", "N" };
+	entries[2] = (GOptionEntry) { "role-fanin", 0, 0, G_OPTION_ARG_INT, &params->role_fanin, "Parents of every non root role", "N" };
+	entries[3] = (GOptionEntry) { "resource-depth", 0, 0, G_OPTION_ARG_INT, &params->resource_depth, "Levels of the resource tree", "N" };
+	entries[4] = (GOptionEntry) { "resource-fanout", 0, 0, G_OPTION_ARG_INT, &params->resource_fanout, "Children of every non leaf resource", "N" };
+	entries[5] = (GOptionEntry) { "diamond-density", 0, 0, G_OPTION_ARG_DOUBLE, &params->diamond_density, "Probability of a second resource parent", "P" };
+	entries[6] = (GOptionEntry) { "rule-density", 0, 0, G_OPTION_ARG_DOUBLE, &params->rule_density, "Fraction of resources every role has a rule on", "P" };
+	entries[7] = (GOptionEntry) { "seed", 0, 0, G_OPTION_ARG_INT, &params->seed, "Random seed", "N" };
+
+	return entries;
+}
+
+static void
+bench_policy_generate_roles (BenchPolicy *policy, GRand *rand)
+{
+	guint width;
+	guint fanin;
+	guint level;
+	guint i;
+	guint j;
+	guint32 n;
+	guint32 first;
+	guint32 parent;
+
+	width = MAX (policy->params.role_width, 1);
+	fanin = CLAMP (policy->params.role_fanin, 0, (gint)width);
+
+	policy->n_roles = MAX (policy->params.role_depth, 1) * width;
+	policy->role_ids = g_new (gchar *, policy->n_roles);
+	policy->role_parents_offset = g_new (guint32, policy->n_roles + 1);
+	policy->role_parents = g_new (guint32, policy->n_roles * fanin);
+
+	n = 0;
+	for (i = 0; i < policy->n_roles; i++)
+		{
+			policy->role_ids[i] = g_strdup_printf ("role-%u", i);
+			policy->role_parents_offset[i] = n;
+
+			level = i / width;
+			if (level == 0)
+				{
+					continue;
+				}
+
+			/* fanin distinct parents out of the level above */
+			first = n;
+			while (n - first < fanin)
+				{
+					parent = (level - 1) * width + g_rand_int_range (rand, 0, width);
+					for (j = first; j < n; j++)
+						{
+							if (policy->role_parents[j] == parent)
+								{
+									break;
+								}
+						}
+					if (j == n)
+						{
+							policy->role_parents[n++] = parent;
+						}
+				}
+		}
+	policy->role_parents_offset[policy->n_roles] = n;
+}
+
+static void
+bench_policy_generate_resources (BenchPolicy *policy, GRand *rand)
+{
+	guint fanout;
+	guint depth;
+	guint i;
+	guint32 n;
+	guint32 level_start;
+	guint32 level_end;
+	guint32 parent;
+	guint32 other;
+
+	fanout = MAX (policy->params.resource_fanout, 1);
+	depth = MAX (policy->params.resource_depth, 1);
+
+	policy->n_resources = 0;
+	level_end = 1;
+	for (i = 0; i < depth; i++)
+		{
+			policy->n_resources += level_end;
+			level_end *= fanout;
+		}
+
+	policy->resource_ids = g_new (gchar *, policy->n_resources);
+	policy->resource_parents_offset = g_new (guint32, policy->n_resources + 1);
+	policy->resource_parents = g_new (guint32, policy->n_resources * 2);
+
+	/* breadth first: children of node p are 1 + p * fanout ... */
+	n = 0;
+	level_start = 0;
+	level_end = 1;
+	for (i = 0; i < policy->n_resources; i++)
+		{
+			policy->resource_ids[i] = g_strdup_printf ("resource-%u", i);
+			policy->resource_parents_offset[i] = n;
+
+			if (i == 0)
+				{
+					continue;
+				}
+
+			parent = (i - 1) / fanout;
+			if (parent >= level_end)
+				{
+					level_start = level_end;
+					level_end = level_end * fanout + 1;
+				}
+			policy->resource_parents[n++] = parent;
+
+			if (level_end - level_start > 1
+			    && g_rand_double (rand) < policy->params.diamond_density)
+				{
+					do
+						{
+							other = g_rand_int_range (rand, level_start, level_end);
+						} while (other == parent);
+					policy->resource_parents[n++] = other;
+				}
+		}
+	policy->resource_parents_offset[policy->n_resources] = n;
+}
+
+static void
+bench_policy_generate_rules (BenchPolicy *policy, GRand *rand)
+{
+	guint i;
+	guint j;
+	guint per_role;
+	gdouble expected;
+	GHashTable *seen;
+	guint32 resource;
+	guint n_alloc;
+
+	expected = policy->params.rule_density * policy->n_resources;
+	if (expected > policy->n_resources)
+		{
+			expected = policy->n_resources;
+		}
+
+	n_alloc = ((guint)expected + 1) * policy->n_roles;
+	policy->rule_role = g_new (guint32, n_alloc);
+	policy->rule_resource = g_new (guint32, n_alloc);
+	policy->rule_allow = g_new (guint8, n_alloc);
+	policy->n_rules = 0;
+
+	seen = g_hash_table_new (g_direct_hash, g_direct_equal);
+	for (i = 0; i < policy->n_roles; i++)
+		{
+			per_role = (guint)expected;
+			if (per_role < policy->n_resources
+			    && g_rand_double (rand) < expected - per_role)
+				{
+					per_role++;
+				}
+
+			g_hash_table_remove_all (seen);
+			for (j = 0; j < per_role; j++)
+				{
+					do
+						{
+							resource = g_rand_int_range (rand, 0, policy->n_resources);
+						} while (g_hash_table_contains (seen, GUINT_TO_POINTER (resource + 1)));
+					g_hash_table_add (seen, GUINT_TO_POINTER (resource + 1));
+
+					policy->rule_role[policy->n_rules] = i;
+					policy->rule_resource[policy->n_rules] = resource;
+					policy->rule_allow[policy->n_rules] = g_rand_int_range (rand, 0, 4) != 0;
+					policy->n_rules++;
+				}
+		}
+	g_hash_table_destroy (seen);
+}
+
+/**
+ * bench_policy_generate:
+ * @params:
+ *
+ * Returns: the description of a synthetic policy; nothing is loaded
+ * into a #ZakAutho until one of the bench_policy_load functions is called.
+ */
+BenchPolicy
+*bench_policy_generate (const BenchPolicyParams *params)
+{
+	BenchPolicy *policy;
+	GRand *rand;
+
+	policy = g_new0 (BenchPolicy, 1);
+	policy->params = *params;
+
+	rand = g_rand_new_with_seed (params->seed);
+	bench_policy_generate_roles (policy, rand);
+	bench_policy_generate_resources (policy, rand);
+	bench_policy_generate_rules (policy, rand);
+	g_rand_free (rand);
+
+	return policy;
+}
+
+void
+bench_policy_free (BenchPolicy *policy)
+{
+	guint i;
+
+	for (i = 0; i < policy->n_roles; i++)
+		{
+			g_free (policy->role_ids[i]);
+		}
+	for (i = 0; i < policy->n_resources; i++)
+		{
+			g_free (policy->resource_ids[i]);
+		}
+
+	g_free (policy->role_ids);
+	g_free (policy->role_parents_offset);
+	g_free (policy->role_parents);
+	g_free (policy->resource_ids);
+	g_free (policy->resource_parents_offset);
+	g_free (policy->resource_parents);
+	g_free (policy->rule_role);
+	g_free (policy->rule_resource);
+	g_free (policy->rule_allow);
+	g_free (policy->iroles);
+	g_free (policy->iresources);
+	g_free (policy);
+}
+
+/* the objects belong to the last #ZakAutho they were loaded into;
+ * roles and resources have to be loaded before parents and rules */
+void
+bench_policy_load_roles (BenchPolicy *policy, ZakAutho *zak_autho)
+{
+	guint i;
+
+	g_free (policy->iroles);
+	policy->iroles = g_new (ZakAuthoIRole *, policy->n_roles);
+
+	for (i = 0; i < policy->n_roles; i++)
+		{
+			policy->iroles[i] = ZAK_AUTHO_IROLE (zak_autho_role_new (policy->role_ids[i]));
+			zak_autho_add_role (zak_autho, policy->iroles[i]);
+		}
+}
+
+void
+bench_policy_load_resources (BenchPolicy *policy, ZakAutho *zak_autho)
+{
+	guint i;
+
+	g_free (policy->iresources);
+	policy->iresources = g_new (ZakAuthoIResource *, policy->n_resources);
+
+	for (i = 0; i < policy->n_resources; i++)
+		{
+			policy->iresources[i] = ZAK_AUTHO_IRESOURCE (zak_autho_resource_new (policy->resource_ids[i]));
+			zak_autho_add_resource (zak_autho, policy->iresources[i]);
+		}
+}
+
+void
+bench_policy_load_parents (BenchPolicy *policy, ZakAutho *zak_autho)
+{
+	guint i;
+	guint32 j;
+
+	for (i = 0; i < policy->n_roles; i++)
+		{
+			for (j = policy->role_parents_offset[i]; j < policy->role_parents_offset[i + 1]; j++)
+				{
+					zak_autho_add_parent_to_role (zak_autho, policy->iroles[i], policy->iroles[policy->role_parents[j]]);
+				}
+		}
+
+	for (i = 0; i < policy->n_resources; i++)
+		{
+			for (j = policy->resource_parents_offset[i]; j < policy->resource_parents_offset[i + 1]; j++)
+				{
+					zak_autho_add_parent_to_resource (zak_autho, policy->iresources[i], policy->iresources[policy->resource_parents[j]]);
+				}
+		}
+}
+
+void
+bench_policy_load_rules (BenchPolicy *policy, ZakAutho *zak_autho)
+{
+	guint i;
+
+	for (i = 0; i < policy->n_rules; i++)
+		{
+			if (policy->rule_allow[i])
+				{
+					zak_autho_allow (zak_autho, policy->iroles[policy->rule_role[i]], policy->iresources[policy->rule_resource[i]]);
+				}
+			else
+				{
+					zak_autho_deny (zak_autho, policy->iroles[policy->rule_role[i]], policy->iresources[policy->rule_resource[i]]);
+				}
+		}
+}
+
+ZakAutho
+*bench_policy_load (BenchPolicy *policy)
+{
+	ZakAutho *zak_autho;
+
+	zak_autho = zak_autho_new ();
+
+	bench_policy_load_roles (policy, zak_autho);
+	bench_policy_load_resources (policy, zak_autho);
+	bench_policy_load_parents (policy, zak_autho);
+	bench_policy_load_rules (policy, zak_autho);
+
+	return zak_autho;
+}
+
+void
+bench_policy_print_json (BenchPolicy *policy)
+{
+	g_printf ("{\"policy\":{\"role_depth\":%d,\"role_width\":%d,\"role_fanin\":%d,"
+	          "\"resource_depth\":%d,\"resource_fanout\":%d,"
+	          "\"diamond_density\":%g,\"rule_density\":%g,\"seed\":%d,"
+	          "\"roles\":%u,\"role_parents\":%u,\"resources\":%u,\"resource_diamonds\":%u,\"rules\":%u}}\n",
+	          policy->params.role_depth,
+	          policy->params.role_width,
+	          policy->params.role_fanin,
+	          policy->params.resource_depth,
+	          policy->params.resource_fanout,
+	          policy->params.diamond_density,
+	          policy->params.rule_density,
+	          policy->params.seed,
+	          policy->n_roles,
+	          policy->role_parents_offset[policy->n_roles],
+	          policy->n_resources,
+	          policy->resource_parents_offset[policy->n_resources] - (policy->n_resources - 1),
+	          policy->n_rules);
+}
+
+gint64
+bench_now_ns (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+
+	return (gint64)ts.tv_sec * G_GINT64_CONSTANT (1000000000) + ts.tv_nsec;
+}
+
+/* lets the next bench_get_peak_rss cover only what follows (linux) */
+void
+bench_reset_peak_rss (void)
+{
+	FILE *f;
+
+	f = fopen ("/proc/self/clear_refs", "w");
+	if (f != NULL)
+		{
+			fputs ("5", f);
+			fclose (f);
+		}
+}
+
+/* peak resident set size in kB */
+glong
+bench_get_peak_rss (void)
+{
+	FILE *f;
+	gchar line[256];
+	glong ret;
+	struct rusage usage;
+
+	ret = -1;
+
+	f = fopen ("/proc/self/status", "r");
+	if (f != NULL)
+		{
+			while (fgets (line, sizeof (line), f) != NULL)
+				{
+					if (g_str_has_prefix (line, "VmHWM:"))
+						{
+							ret = strtol (line + 6, NULL, 10);
+							break;
+						}
+				}
+			fclose (f);
+		}
+
+	if (ret < 0 && getrusage (RUSAGE_SELF, &usage) == 0)
+		{
+			ret = usage.ru_maxrss;
+		}
+
+	return ret;
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2010-2015 Andrea Zagli <azagli@libero.it>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __BENCH_POLICY_H__
+#define __BENCH_POLICY_H__
+
+#include <glib.h>
+
+#include "autoz.h"
+
+G_BEGIN_DECLS
+
+
+typedef struct
+	{
+		gint role_depth;
+		gint role_width;
+		gint role_fanin;
+		gint resource_depth;
+		gint resource_fanout;
+		gdouble diamond_density;
+		gdouble rule_density;
+		gint seed;
+	} BenchPolicyParams;
+
+typedef struct
+	{
+		BenchPolicyParams params;
+
+		guint n_roles;
+		gchar **role_ids;
+		guint32 *role_parents_offset;
+		guint32 *role_parents;
+
+		guint n_resources;
+		gchar **resource_ids;
+		guint32 *resource_parents_offset;
+		guint32 *resource_parents;
+
+		guint n_rules;
+		guint32 *rule_role;
+		guint32 *rule_resource;
+		guint8 *rule_allow;
+
+		ZakAuthoIRole **iroles;
+		ZakAuthoIResource **iresources;
+	} BenchPolicy;
+
+void bench_policy_params_init (BenchPolicyParams *params);
+GOptionEntry *bench_policy_option_entries (BenchPolicyParams *params);
+
+BenchPolicy *bench_policy_generate (const BenchPolicyParams *params);
+void bench_policy_free (BenchPolicy *policy);
+
+void bench_policy_load_roles (BenchPolicy *policy, ZakAutho *zak_autho);
+void bench_policy_load_resources (BenchPolicy *policy, ZakAutho *zak_autho);
+void bench_policy_load_parents (BenchPolicy *policy, ZakAutho *zak_autho);
+void bench_policy_load_rules (BenchPolicy *policy, ZakAutho *zak_autho);
+ZakAutho *bench_policy_load (BenchPolicy *policy);
+
+void bench_policy_print_json (BenchPolicy *policy);
+
+gint64 bench_now_ns (void);
+void bench_reset_peak_rss (void);
+glong bench_get_peak_rss (void);
+
+
+G_END_DECLS
+
+#endif /* __BENCH_POLICY_H__ */
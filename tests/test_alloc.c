@@ -0,0 +1,279 @@
+/*
+ * Copyright (C) 2010-2015 Andrea Zagli <azagli@libero.it>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/* checks that zak_autho_is_allowed doesn't allocate once the policy is built */
+
+#include <stdlib.h>
+#include <errno.h>
+
+#include <glib/gprintf.h>
+
+#include "autoz.h"
+#include "role.h"
+#include "resource.h"
+
+#define CHECKS 1000000
+
+static volatile gboolean counting = FALSE;
+static volatile gsize allocations = 0;
+
+#ifdef __GLIBC__
+
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t nmemb, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+extern void *__libc_memalign (size_t alignment, size_t size);
+
+void
+*malloc (size_t size)
+{
+	if (counting)
+		{
+			allocations++;
+		}
+	return __libc_malloc (size);
+}
+
+void
+*calloc (size_t nmemb, size_t size)
+{
+	if (counting)
+		{
+			allocations++;
+		}
+	return __libc_calloc (nmemb, size);
+}
+
+void
+*realloc (void *ptr, size_t size)
+{
+	if (counting)
+		{
+			allocations++;
+		}
+	return __libc_realloc (ptr, size);
+}
+
+void
+*memalign (size_t alignment, size_t size)
+{
+	if (counting)
+		{
+			allocations++;
+		}
+	return __libc_memalign (alignment, size);
+}
+
+void
+*aligned_alloc (size_t alignment, size_t size)
+{
+	return memalign (alignment, size);
+}
+
+int
+posix_memalign (void **memptr, size_t alignment, size_t size)
+{
+	void *ptr;
+
+	ptr = memalign (alignment, size);
+	if (ptr == NULL)
+		{
+			return ENOMEM;
+		}
+
+	*memptr = ptr;
+	return 0;
+}
+
+#endif
+
+/* a role and a resource implemented outside the library, without the
+ * peek_* functions */
+typedef struct
+	{
+		GObject parent;
+		gchar *id;
+	} TestNode;
+
+typedef GObjectClass TestNodeClass;
+
+static void test_node_irole_init (ZakAuthoIRoleIface *iface);
+static void test_node_iresource_init (ZakAuthoIResourceIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (TestNode, test_node, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (ZAK_AUTHO_TYPE_IROLE,
+                                                test_node_irole_init)
+                         G_IMPLEMENT_INTERFACE (ZAK_AUTHO_TYPE_IRESOURCE,
+                                                test_node_iresource_init))
+
+static const gchar
+*test_node_get_id (TestNode *node)
+{
+	return (const gchar *)g_strdup (node->id);
+}
+
+static void
+test_node_irole_init (ZakAuthoIRoleIface *iface)
+{
+	iface->get_role_id = (const gchar *(*) (ZakAuthoIRole *))test_node_get_id;
+}
+
+static void
+test_node_iresource_init (ZakAuthoIResourceIface *iface)
+{
+	iface->get_resource_id = (const gchar *(*) (ZakAuthoIResource *))test_node_get_id;
+}
+
+static void
+test_node_finalize (GObject *object)
+{
+	g_free (((TestNode *)object)->id);
+
+	G_OBJECT_CLASS (test_node_parent_class)->finalize (object);
+}
+
+static void
+test_node_class_init (TestNodeClass *klass)
+{
+	klass->finalize = test_node_finalize;
+}
+
+static void
+test_node_init (TestNode *node)
+{
+}
+
+static TestNode
+*test_node_new (const gchar *id)
+{
+	TestNode *node;
+
+	node = g_object_new (test_node_get_type (), NULL);
+	node->id = g_strdup (id);
+
+	return node;
+}
+
+int
+main (int argc, char **argv)
+{
+	ZakAutho *zak_autho;
+	ZakAuthoRole *role_writer;
+	ZakAuthoRole *role_writer_child;
+	ZakAuthoRole *role_read_only;
+	ZakAuthoResource *resource_page;
+	ZakAuthoResource *resource_paragraph;
+	TestNode *role_external;
+	TestNode *resource_external;
+
+	gboolean allowed;
+	guint mode;
+	guint i;
+
+	ZakAuthoRoleHandle handle_writer_child;
+	ZakAuthoResourceHandle handle_paragraph;
+
+	guint64 hits;
+	guint64 misses;
+
+#ifndef __GLIBC__
+	/* skipped */
+	return 77;
+#endif
+
+	zak_autho = zak_autho_new ();
+
+	zak_autho_set_role_name_prefix (zak_autho, "app:");
+	zak_autho_set_resource_name_prefix (zak_autho, "app:");
+
+	role_writer = zak_autho_role_new ("app:writer");
+	zak_autho_add_role (zak_autho, ZAK_AUTHO_IROLE (role_writer));
+
+	role_writer_child = zak_autho_role_new ("app:writer-child");
+	zak_autho_add_role_with_parents (zak_autho, ZAK_AUTHO_IROLE (role_writer_child),
+	                             ZAK_AUTHO_IROLE (role_writer),
+	                             NULL);
+
+	role_read_only = zak_autho_role_new ("app:read-only");
+	zak_autho_add_role (zak_autho, ZAK_AUTHO_IROLE (role_read_only));
+
+	resource_page = zak_autho_resource_new ("app:page");
+	zak_autho_add_resource (zak_autho, ZAK_AUTHO_IRESOURCE (resource_page));
+
+	resource_paragraph = zak_autho_resource_new ("app:paragraph");
+	zak_autho_add_resource_with_parents (zak_autho, ZAK_AUTHO_IRESOURCE (resource_paragraph),
+	                                 ZAK_AUTHO_IRESOURCE (resource_page),
+	                                 NULL);
+
+	role_external = test_node_new ("app:external");
+	zak_autho_add_role_with_parents (zak_autho, ZAK_AUTHO_IROLE (role_external),
+	                             ZAK_AUTHO_IROLE (role_writer),
+	                             NULL);
+
+	resource_external = test_node_new ("app:external");
+	zak_autho_add_resource_with_parents (zak_autho, ZAK_AUTHO_IRESOURCE (resource_external),
+	                                 ZAK_AUTHO_IRESOURCE (resource_page),
+	                                 NULL);
+
+	zak_autho_allow (zak_autho, ZAK_AUTHO_IROLE (role_writer), ZAK_AUTHO_IRESOURCE (resource_page));
+	zak_autho_deny (zak_autho, ZAK_AUTHO_IROLE (role_read_only), NULL);
+
+	handle_writer_child = zak_autho_lookup_role_handle (zak_autho, "app:writer-child");
+	handle_paragraph = zak_autho_lookup_resource_handle (zak_autho, "app:paragraph");
+
+	/* recursive evaluation, compiled matrix, and the decision cache in front */
+	for (mode = 0; mode < 3; mode++)
+		{
+			zak_autho_set_compiled (zak_autho, mode == 1);
+			zak_autho_set_cache_size (zak_autho, mode == 2 ? 16 : 0);
+
+			/* warm up */
+			allowed = zak_autho_is_allowed (zak_autho, ZAK_AUTHO_IROLE (role_writer_child), ZAK_AUTHO_IRESOURCE (resource_paragraph), FALSE);
+			allowed = zak_autho_is_allowed (zak_autho, ZAK_AUTHO_IROLE (role_read_only), ZAK_AUTHO_IRESOURCE (resource_page), FALSE);
+			allowed = zak_autho_is_allowed (zak_autho, ZAK_AUTHO_IROLE (role_external), ZAK_AUTHO_IRESOURCE (resource_external), FALSE);
+
+			counting = TRUE;
+			for (i = 0; i < CHECKS; i++)
+				{
+					allowed = zak_autho_is_allowed (zak_autho, ZAK_AUTHO_IROLE (role_writer_child), ZAK_AUTHO_IRESOURCE (resource_paragraph), FALSE);
+					allowed = zak_autho_is_allowed (zak_autho, ZAK_AUTHO_IROLE (role_read_only), ZAK_AUTHO_IRESOURCE (resource_page), FALSE) || allowed;
+					allowed = zak_autho_is_allowed (zak_autho, ZAK_AUTHO_IROLE (role_writer), ZAK_AUTHO_IRESOURCE (resource_paragraph), TRUE) && allowed;
+					allowed = zak_autho_is_allowed_h (zak_autho, handle_writer_child, handle_paragraph, FALSE) && allowed;
+					allowed = zak_autho_is_allowed (zak_autho, ZAK_AUTHO_IROLE (role_external), ZAK_AUTHO_IRESOURCE (resource_external), FALSE) && allowed;
+				}
+			counting = FALSE;
+
+			if (!allowed)
+				{
+					g_fprintf (stderr, "wrong decision (mode %u)\n", mode);
+					return 1;
+				}
+		}
+
+	zak_autho_get_cache_stats (zak_autho, &hits, &misses);
+
+	g_fprintf (stdout, "%u checks, %" G_GSIZE_FORMAT " allocations, %" G_GUINT64_FORMAT " cache hits, %" G_GUINT64_FORMAT " misses\n",
+	           CHECKS * 15, allocations, hits, misses);
+
+	if (allocations > 0)
+		{
+			return 1;
+		}
+
+	return 0;
+}
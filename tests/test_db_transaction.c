@@ -0,0 +1,194 @@
+/*
+ * Copyright (C) 2010-2015 Andrea Zagli <azagli@libero.it>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/* checks that a policy is loaded inside the caller's transaction as
+ * outside, from tables without the optional ones (changelog,
+ * timestamp_update), and that the transaction is still usable after;
+ * test_db_transaction [connection string], SQLite in a temporary
+ * directory by default */
+
+#include <glib/gprintf.h>
+#include <glib/gstdio.h>
+
+#include <libgda/libgda.h>
+
+#include "bench_policy.h"
+
+static const gchar *schema[] =
+	{
+		"DROP TABLE IF EXISTS roles",
+		"DROP TABLE IF EXISTS roles_parents",
+		"DROP TABLE IF EXISTS resources",
+		"DROP TABLE IF EXISTS resources_parents",
+		"DROP TABLE IF EXISTS rules",
+		"DROP TABLE IF EXISTS changelog",
+		"DROP TABLE IF EXISTS timestamp_update",
+		"CREATE TABLE roles (id integer NOT NULL PRIMARY KEY, role_id varchar(255) DEFAULT '')",
+		"CREATE TABLE roles_parents (id_roles integer NOT NULL, id_roles_parent integer NOT NULL,"
+		" PRIMARY KEY (id_roles, id_roles_parent))",
+		"CREATE TABLE resources (id integer NOT NULL PRIMARY KEY, resource_id varchar(255) DEFAULT '')",
+		"CREATE TABLE resources_parents (id_resources integer NOT NULL, id_resources_parent integer NOT NULL,"
+		" PRIMARY KEY (id_resources, id_resources_parent))",
+		"CREATE TABLE rules (id integer NOT NULL PRIMARY KEY, type integer, id_roles integer, id_resources integer)"
+	};
+
+static gboolean
+same_decisions (BenchPolicy *policy, ZakAutho *expected, ZakAutho *actual)
+{
+	guint i;
+	guint j;
+	guint exclude_null;
+
+	for (i = 0; i < policy->n_roles; i++)
+		{
+			for (j = 0; j < policy->n_resources; j++)
+				{
+					for (exclude_null = 0; exclude_null < 2; exclude_null++)
+						{
+							if (zak_autho_is_allowed (expected, policy->iroles[i], policy->iresources[j], exclude_null)
+							    != zak_autho_is_allowed (actual, policy->iroles[i], policy->iresources[j], exclude_null))
+								{
+									g_fprintf (stderr, "different decision for «%s» on «%s»\n",
+									           policy->role_ids[i], policy->resource_ids[j]);
+									return FALSE;
+								}
+						}
+				}
+		}
+
+	return TRUE;
+}
+
+int
+main (int argc, char **argv)
+{
+	BenchPolicyParams params;
+	BenchPolicy *policy;
+	ZakAutho *zak_autho;
+	ZakAutho *zak_autho_expected;
+	ZakAutho *zak_autho_loaded;
+
+	GdaConnection *gdacon;
+	GdaDataModel *dm;
+	GError *error;
+	gchar *dir;
+	gchar *filename;
+	gchar *cnc_string;
+	guint i;
+
+	gint ret;
+
+	gda_init ();
+
+	dir = NULL;
+	filename = NULL;
+	if (argc > 1)
+		{
+			cnc_string = g_strdup (argv[1]);
+		}
+	else
+		{
+			dir = g_dir_make_tmp ("zakautho-XXXXXX", NULL);
+			filename = g_build_filename (dir, "zakautho-test.db", NULL);
+			cnc_string = g_strdup_printf ("SQLite://DB_DIR=%s;DB_NAME=zakautho-test", dir);
+		}
+
+	error = NULL;
+	gdacon = gda_connection_open_from_string (NULL, cnc_string, NULL, 0, &error);
+	g_free (cnc_string);
+	if (gdacon == NULL)
+		{
+			g_error ("Error on creating GdaConnection: %s",
+			         error != NULL && error->message != NULL ? error->message : "no details");
+		}
+
+	for (i = 0; i < G_N_ELEMENTS (schema); i++)
+		{
+			gda_connection_execute_non_select_command (gdacon, schema[i], NULL);
+		}
+
+	bench_policy_params_init (&params);
+	params.role_depth = 4;
+	params.role_width = 6;
+	params.resource_depth = 4;
+	params.resource_fanout = 3;
+	params.rule_density = 0.1;
+
+	policy = bench_policy_generate (&params);
+	zak_autho = bench_policy_load (policy);
+	zak_autho_expected = zak_autho_new ();
+	zak_autho_loaded = zak_autho_new ();
+
+	ret = 1;
+	if (!zak_autho_save_to_db (zak_autho, gdacon, NULL, TRUE)
+	    || !zak_autho_load_from_db (zak_autho_expected, gdacon, NULL, TRUE))
+		{
+			g_fprintf (stderr, "unable to save or load the policy\n");
+		}
+	else if (!gda_connection_begin_transaction (gdacon, "test", GDA_TRANSACTION_ISOLATION_REPEATABLE_READ, NULL))
+		{
+			g_fprintf (stderr, "unable to begin a transaction\n");
+		}
+	else
+		{
+			if (!zak_autho_load_from_db (zak_autho_loaded, gdacon, NULL, TRUE))
+				{
+					g_fprintf (stderr, "unable to load the policy in a transaction\n");
+				}
+			else if (!same_decisions (policy, zak_autho_expected, zak_autho_loaded))
+				{
+					/* same_decisions () already told where */
+				}
+			else if ((dm = gda_connection_execute_select_command (gdacon, "SELECT COUNT (*) FROM rules", NULL)) == NULL)
+				{
+					g_fprintf (stderr, "the transaction is unusable after the load\n");
+				}
+			else
+				{
+					g_object_unref (dm);
+					ret = 0;
+				}
+
+			if (!gda_connection_commit_transaction (gdacon, "test", NULL))
+				{
+					g_fprintf (stderr, "unable to commit the transaction\n");
+					ret = 1;
+				}
+		}
+
+	g_object_unref (gdacon);
+	if (filename != NULL)
+		{
+			g_remove (filename);
+			g_rmdir (dir);
+		}
+
+	g_free (filename);
+	g_free (dir);
+	g_object_unref (zak_autho);
+	g_object_unref (zak_autho_expected);
+	g_object_unref (zak_autho_loaded);
+	bench_policy_free (policy);
+
+	if (ret == 0)
+		{
+			g_fprintf (stdout, "db transaction ok\n");
+		}
+
+	return ret;
+}
@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2010-2015 Andrea Zagli <azagli@libero.it>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/* checks that a policy read back from a snapshot file takes the same
+ * decisions, before and after it's changed, and that a damaged file is
+ * refused */
+
+#include <string.h>
+
+#include <glib/gprintf.h>
+#include <glib/gstdio.h>
+
+#include "bench_policy.h"
+
+static gboolean
+same_decisions (BenchPolicy *policy, ZakAutho *expected, ZakAutho *actual)
+{
+	guint i;
+	guint j;
+	guint exclude_null;
+
+	for (i = 0; i < policy->n_roles; i++)
+		{
+			for (j = 0; j < policy->n_resources; j++)
+				{
+					for (exclude_null = 0; exclude_null < 2; exclude_null++)
+						{
+							if (zak_autho_is_allowed (expected, policy->iroles[i], policy->iresources[j], exclude_null)
+							    != zak_autho_is_allowed (actual, policy->iroles[i], policy->iresources[j], exclude_null))
+								{
+									g_fprintf (stderr, "different decision for «%s» on «%s»\n",
+									           policy->role_ids[i], policy->resource_ids[j]);
+									return FALSE;
+								}
+						}
+				}
+			j = (i * 7) % policy->n_roles;
+			if (zak_autho_role_is_child (expected, policy->iroles[i], policy->iroles[j])
+			    != zak_autho_role_is_child (actual, policy->iroles[i], policy->iroles[j]))
+				{
+					g_fprintf (stderr, "different hierarchy for «%s» and «%s»\n",
+					           policy->role_ids[i], policy->role_ids[j]);
+					return FALSE;
+				}
+		}
+
+	return TRUE;
+}
+
+static gboolean
+same_contents (const gchar *filename1, const gchar *filename2)
+{
+	gboolean ret;
+	gchar *contents1;
+	gchar *contents2;
+	gsize length1;
+	gsize length2;
+
+	contents1 = NULL;
+	contents2 = NULL;
+	ret = g_file_get_contents (filename1, &contents1, &length1, NULL)
+	      && g_file_get_contents (filename2, &contents2, &length2, NULL)
+	      && length1 == length2
+	      && memcmp (contents1, contents2, length1) == 0;
+
+	g_free (contents1);
+	g_free (contents2);
+
+	return ret;
+}
+
+int
+main (int argc, char **argv)
+{
+	BenchPolicyParams params;
+	BenchPolicy *policy;
+	ZakAutho *zak_autho;
+	ZakAutho *zak_autho_loaded;
+
+	gchar *dir;
+	gchar *filename;
+	gchar *filename_again;
+	gchar *contents;
+	gsize length;
+
+	gint ret;
+
+	bench_policy_params_init (&params);
+	params.role_depth = 4;
+	params.role_width = 6;
+	params.resource_depth = 4;
+	params.resource_fanout = 3;
+	params.rule_density = 0.1;
+
+	policy = bench_policy_generate (&params);
+	zak_autho = bench_policy_load (policy);
+	zak_autho_deny (zak_autho, policy->iroles[0], NULL);
+	zak_autho_allow (zak_autho, policy->iroles[policy->n_roles - 1], NULL);
+
+	dir = g_dir_make_tmp ("zakautho-XXXXXX", NULL);
+	filename = g_build_filename (dir, "policy.snapshot", NULL);
+	filename_again = g_build_filename (dir, "policy-again.snapshot", NULL);
+
+	ret = 1;
+	zak_autho_loaded = zak_autho_new ();
+	if (!zak_autho_save_snapshot (zak_autho, filename)
+	    || !zak_autho_load_snapshot (zak_autho_loaded, filename))
+		{
+			g_fprintf (stderr, "unable to save or load the snapshot\n");
+		}
+	else if (!same_decisions (policy, zak_autho, zak_autho_loaded))
+		{
+			/* the loaded file must answer as the policy it was written
+			 * from; same_decisions () already told where it doesn't */
+		}
+	else if (!zak_autho_save_snapshot (zak_autho_loaded, filename_again)
+	         || !same_contents (filename, filename_again))
+		{
+			g_fprintf (stderr, "the snapshot of the loaded policy is different\n");
+		}
+	else
+		{
+			/* a change turns the file into objects */
+			zak_autho_allow (zak_autho, policy->iroles[1], policy->iresources[2]);
+			zak_autho_allow (zak_autho_loaded, policy->iroles[1], policy->iresources[2]);
+			zak_autho_set_compiled (zak_autho_loaded, TRUE);
+			if (same_decisions (policy, zak_autho, zak_autho_loaded))
+				{
+					ret = 0;
+				}
+		}
+
+	/* a damaged file leaves the policy as it was */
+	if (ret == 0
+	    && g_file_get_contents (filename, &contents, &length, NULL))
+		{
+			contents[length - 1] ^= 1;
+			g_file_set_contents (filename, contents, length, NULL);
+			g_free (contents);
+
+			if (zak_autho_load_snapshot (zak_autho_loaded, filename)
+			    || !same_decisions (policy, zak_autho, zak_autho_loaded))
+				{
+					g_fprintf (stderr, "a damaged snapshot was loaded\n");
+					ret = 1;
+				}
+		}
+
+	g_remove (filename);
+	g_remove (filename_again);
+	g_rmdir (dir);
+
+	g_free (filename);
+	g_free (filename_again);
+	g_free (dir);
+	g_object_unref (zak_autho);
+	g_object_unref (zak_autho_loaded);
+	bench_policy_free (policy);
+
+	if (ret == 0)
+		{
+			g_fprintf (stdout, "snapshot ok\n");
+		}
+
+	return ret;
+}